@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Coalescer.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Coalescing window for coordinated moves of the
+//                ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ShapeokoTinyG.h"
+#include "Coalescer.h"
+
+ShapeokoTinyGCoalescer::ShapeokoTinyGCoalescer(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    running_(false),
+    stop_(false),
+    pendingAxes_(0),
+    pendingFeed_(0.0),
+    result_(DEVICE_OK)
+{
+  pendingTarget_[0] = pendingTarget_[1] = pendingTarget_[2] = 0.0;
+}
+
+ShapeokoTinyGCoalescer::~ShapeokoTinyGCoalescer()
+{
+  Stop();
+}
+
+int ShapeokoTinyGCoalescer::Start()
+{
+  if (running_)
+    return DEVICE_OK;
+  stop_ = false;
+  running_ = true;
+  if (activate() != 0)
+  {
+    running_ = false;
+    return DEVICE_ERR;
+  }
+  return DEVICE_OK;
+}
+
+// Sends anything still pending, so no target is lost
+void ShapeokoTinyGCoalescer::Stop()
+{
+  if (running_)
+  {
+    stop_ = true;
+    wait();
+    running_ = false;
+  }
+  Flush();
+}
+
+void ShapeokoTinyGCoalescer::Add(unsigned axes, const double* target_mm, double feed, long windowMs)
+{
+  MMThreadGuard guard(lock_);
+  if (pendingAxes_ == 0)
+  {
+    deadline_ = hub_->GetCurrentMMTimeH() + MM::MMTime(windowMs * 1000.0);
+    pendingFeed_ = 0.0;
+  }
+  if (feed > 0.0 && (pendingFeed_ <= 0.0 || feed < pendingFeed_))
+    pendingFeed_ = feed;
+  for (int i = 0; i < 3; ++i)
+    if (axes & (1u << i))
+      pendingTarget_[i] = target_mm[i];
+  pendingAxes_ |= axes;
+}
+
+// A running move is held and flushed first.  That takes as long as the
+// machine needs to decelerate; targets arriving meanwhile replace the
+// pending ones, and only the newest is sent.  The held move stops short,
+// so the axes it was moving that the pending move leaves out are sent to
+// their targets again with it.
+int ShapeokoTinyGCoalescer::Flush()
+{
+  if (pendingAxes_ == 0)
+    return DEVICE_OK;
+  MMThreadGuard flushGuard(flushLock_);
+  bool held = false;
+  if (hub_->IsMachineMoving())
+  {
+    int ret = hub_->HoldAndFlush();
+    if (ret != DEVICE_OK)
+    {
+      MMThreadGuard guard(lock_);
+      pendingAxes_ = 0;
+      result_ = ret;
+      return ret;
+    }
+    held = true;
+  }
+
+  MMThreadGuard guard(lock_);
+  // discarded while the hold ran: the user stopped the stage
+  if (pendingAxes_ == 0)
+    return DEVICE_OK;
+  unsigned axes = pendingAxes_;
+  double target[3] = {pendingTarget_[0], pendingTarget_[1], pendingTarget_[2]};
+  if (held)
+  {
+    double sent[3];
+    unsigned resend = hub_->GetSentTargets(sent) & ~axes;
+    for (int i = 0; i < 3; ++i)
+      if (resend & (1u << i))
+        target[i] = sent[i];
+    axes |= resend;
+  }
+  // the hub reports the stage moving from here on, so clearing the
+  // pending mask afterwards leaves no gap in which Busy() is false
+  int ret = hub_->SendAxesMove(axes, target, false, pendingFeed_);
+  pendingAxes_ = 0;
+  if (ret != DEVICE_OK)
+    result_ = ret;
+  return ret;
+}
+
+void ShapeokoTinyGCoalescer::Discard()
+{
+  {
+    MMThreadGuard guard(lock_);
+    pendingAxes_ = 0;
+  }
+  MMThreadGuard flushGuard(flushLock_);
+}
+
+int ShapeokoTinyGCoalescer::TakeResult()
+{
+  MMThreadGuard guard(lock_);
+  int ret = result_;
+  result_ = DEVICE_OK;
+  return ret;
+}
+
+int ShapeokoTinyGCoalescer::svc()
+{
+  while (!stop_)
+  {
+    if (pendingAxes_ != 0)
+    {
+      bool due;
+      {
+        MMThreadGuard guard(lock_);
+        due = !(hub_->GetCurrentMMTimeH() < deadline_);
+      }
+      if (due)
+        Flush();
+    }
+    CDeviceUtils::SleepMs(1);
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Coalescer.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Move arbitration for the hub's coordinated moves.
+//                Targets for different axes that arrive within a short
+//                window, typically an XY move followed by a Z move to the
+//                next tile's focus, are merged and sent as one G0 so that
+//                all axes travel at the same time.  Targets that arrive
+//                while the machine moves replace the running move, newest
+//                target first.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_COALESCER_H_
+#define _SHAPEOKO_TINYG_COALESCER_H_
+
+#include "MMDevice.h"
+#include "DeviceThreads.h"
+
+class ShapeokoTinyGHub;
+
+class ShapeokoTinyGCoalescer : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGCoalescer(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGCoalescer();
+
+  int Start();
+  void Stop();
+  bool IsRunning() const { return running_; }
+
+  // Merges the targets (mm) for the axes in the mask into the pending
+  // move.  The window opens with the first target and is not extended by
+  // later ones, so a steady stream of targets still moves the stage.  The
+  // merged move runs at the lowest feed given, or as a G0 if none was.
+  void Add(unsigned axes, const double* target_mm, double feed, long windowMs);
+  bool IsPending() const { return pendingAxes_ != 0; }
+  unsigned GetPendingAxes() const { return pendingAxes_; }
+  // Sends the pending move now, if there is one
+  int Flush();
+  // Drops the pending move without sending it, and waits for a flush
+  // already under way, which then sends nothing
+  void Discard();
+  // DEVICE_OK, or the error from the last move sent in the background
+  int TakeResult();
+
+  int svc();
+
+ private:
+  ShapeokoTinyGHub* hub_;
+  volatile bool running_;
+  volatile bool stop_;
+
+  // held while a move is merged or sent, so a target never falls between
+  MMThreadLock lock_;
+  // held for the whole of a flush, hold included
+  MMThreadLock flushLock_;
+  volatile unsigned pendingAxes_;
+  double pendingTarget_[3];
+  double pendingFeed_;
+  MM::MMTime deadline_;
+  int result_;
+};
+
+#endif // _SHAPEOKO_TINYG_COALESCER_H_
@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Homing.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background homing cycle for the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ShapeokoTinyG.h"
+#include "Homing.h"
+#include "TinyGFormat.h"
+
+ShapeokoTinyGHomer::ShapeokoTinyGHomer(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    axes_(0),
+    homed_(0),
+    timeoutMs_(0),
+    active_(false),
+    stop_(false),
+    joinable_(false),
+    result_(DEVICE_OK)
+{
+}
+
+ShapeokoTinyGHomer::~ShapeokoTinyGHomer()
+{
+  Stop();
+}
+
+int ShapeokoTinyGHomer::Start(unsigned axes, long timeoutMs)
+{
+  if (active_)
+    return ERR_STAGE_MOVING;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  axes_ = axes;
+  // the cycle moves the axes off their reference until it completes
+  homed_ = homed_ & ~axes;
+  timeoutMs_ = timeoutMs;
+  result_ = DEVICE_OK;
+  stop_ = false;
+
+  active_ = true;
+  if (activate() != 0)
+  {
+    active_ = false;
+    return DEVICE_ERR;
+  }
+  joinable_ = true;
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGHomer::Stop()
+{
+  stop_ = true;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  active_ = false;
+}
+
+int ShapeokoTinyGHomer::svc()
+{
+  // the axis words only select the axes; their values are ignored
+  TinyGCommand command("G28.2");
+  static const char* const words[3] = {" X0", " Y0", " Z0"};
+  for (int i = 0; i < 3; ++i)
+    if (axes_ & (1u << i))
+      command.Append(words[i]);
+  // a G28.2 the controller rejects fails here, from the status in the
+  // response footer, without waiting for a cycle that never starts
+  int ret = hub_->StartMotionCommand(command.c_str());
+  if (ret == DEVICE_OK)
+    ret = WaitForCycle();
+  if (ret == DEVICE_OK)
+    homed_ = homed_ | axes_;
+  result_ = ret;
+  active_ = false;
+  return 0;
+}
+
+// TinyG is in state 9 while it homes.  Success leaves it stopped; a switch
+// that is never found raises an alarm (state 2).  A cycle over before any
+// report showed it, e.g. with the switches already closed, leaves the
+// machine ready (1), stopped (3) or ended (4) after the grace period.
+int ShapeokoTinyGHomer::WaitForCycle()
+{
+  MM::MMTime start = hub_->GetCurrentMMTimeH();
+  MM::MMTime deadline = start + MM::MMTime(timeoutMs_ * 1000.0);
+  MM::MMTime nextPoll = start;
+  bool seenHoming = false;
+  while (!stop_)
+  {
+    MM::MMTime now = hub_->GetCurrentMMTimeH();
+    if (now > deadline)
+      return ERR_ANSWER_TIMEOUT;
+    if (now > nextPoll)
+    {
+      hub_->GetStatus();
+      nextPoll = now + MM::MMTime(kPollMs * 1000.0);
+    }
+    TinyGMachineStatus status;
+    hub_->GetMachineStatus(status);
+    if (status.stat == 9)
+      seenHoming = true;
+    else if (seenHoming)
+      return status.stat == 2 ? ERR_CONTROLLER_STATUS : DEVICE_OK;
+    else if (now - start > MM::MMTime(kGraceMs * 1000.0) && status.valid)
+    {
+      if (status.stat == 2)
+        return ERR_CONTROLLER_STATUS;
+      if (status.stat == 1 || status.stat == 3 || status.stat == 4)
+        return DEVICE_OK;
+    }
+    CDeviceUtils::SleepMs(10);
+  }
+  return ERR_HOMING_ABORTED;
+}
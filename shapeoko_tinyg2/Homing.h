@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Homing.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background homing cycle for the ShapeokoTinyG hub.  G28.2
+//                takes tens of seconds, so it runs on its own thread and
+//                the stages report it through Busy() instead of blocking
+//                the caller.  The controller's status reports tell when the
+//                cycle has ended and whether it succeeded.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_HOMING_H_
+#define _SHAPEOKO_TINYG_HOMING_H_
+
+#include "MMDevice.h"
+#include "DeviceThreads.h"
+
+class ShapeokoTinyGHub;
+
+class ShapeokoTinyGHomer : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGHomer(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGHomer();
+
+  // Starts homing the axes in the mask (TINYG_AXIS_*).  The cycle fails if
+  // it has not ended after timeoutMs.
+  int Start(unsigned axes, long timeoutMs);
+  // Abandons the cycle; the hub stops the motion itself
+  void Stop();
+  void RequestStop() { stop_ = true; }
+  bool IsActive() const { return active_; }
+  // axes of the running or the last cycle
+  unsigned GetAxes() const { return axes_; }
+  // axes homed by a cycle that succeeded, since the hub was initialized
+  unsigned GetHomedAxes() const { return homed_; }
+  // DEVICE_OK, or the error that ended the last cycle
+  int GetResult() const { return result_; }
+
+  int svc();
+
+ private:
+  enum {
+    kPollMs = 250,   // status is requested this often too, in case reports are switched off
+    kGraceMs = 1000  // after this, a machine at rest has ended the cycle
+  };
+
+  int WaitForCycle();
+
+  ShapeokoTinyGHub* hub_;
+  unsigned axes_;
+  volatile unsigned homed_;
+  long timeoutMs_;
+  volatile bool active_;
+  volatile bool stop_;
+  bool joinable_;
+  volatile int result_;
+};
+
+#endif // _SHAPEOKO_TINYG_HOMING_H_
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Jog.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Continuous XY velocity mode for the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ShapeokoTinyG.h"
+#include "Jog.h"
+#include "TinyGFormat.h"
+#include <math.h>
+
+ShapeokoTinyGJogger::ShapeokoTinyGJogger(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    vx_(0.0),
+    vy_(0.0),
+    endX_(0.0),
+    endY_(0.0),
+    active_(false),
+    stop_(false),
+    joinable_(false),
+    result_(DEVICE_OK)
+{
+}
+
+ShapeokoTinyGJogger::~ShapeokoTinyGJogger()
+{
+  Stop();
+}
+
+int ShapeokoTinyGJogger::Start(double x_mm, double y_mm, double vx, double vy, long lookaheadMs)
+{
+  if (active_)
+    return ERR_STAGE_MOVING;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  endX_ = x_mm;
+  endY_ = y_mm;
+  SetVelocity(vx, vy);
+  // two segments per look-ahead: one running, one queued behind it
+  if (lookaheadMs < 2 * kMinSegmentMs)
+    lookaheadMs = 2 * kMinSegmentMs;
+  lookahead_ = MM::MMTime(lookaheadMs * 1000.0);
+  segment_ = MM::MMTime(lookaheadMs * 1000.0 / 2);
+  queuedUntil_ = hub_->GetCurrentMMTimeH();
+  result_ = DEVICE_OK;
+  stop_ = false;
+
+  active_ = true;
+  if (activate() != 0)
+  {
+    active_ = false;
+    return DEVICE_ERR;
+  }
+  joinable_ = true;
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGJogger::SetVelocity(double vx, double vy)
+{
+  MMThreadGuard guard(lock_);
+  vx_ = vx;
+  vy_ = vy;
+}
+
+void ShapeokoTinyGJogger::Stop()
+{
+  stop_ = true;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  active_ = false;
+}
+
+int ShapeokoTinyGJogger::svc()
+{
+  while (!stop_)
+  {
+    MM::MMTime now = hub_->GetCurrentMMTimeH();
+    // a starved planner has stopped; count the next segment from now
+    if (queuedUntil_ < now)
+      queuedUntil_ = now;
+    if (queuedUntil_ - now < lookahead_ && hub_->GetQueueFree() > kReservedBuffers)
+    {
+      int ret = QueueSegment();
+      if (ret != DEVICE_OK)
+      {
+        result_ = ret;
+        break;
+      }
+      queuedUntil_ = queuedUntil_ + segment_;
+      continue;
+    }
+    CDeviceUtils::SleepMs(1);
+  }
+  active_ = false;
+  return 0;
+}
+
+// One segment's worth of travel at the current velocity, as an absolute
+// G1 from the end of the previous segment
+int ShapeokoTinyGJogger::QueueSegment()
+{
+  double vx, vy;
+  {
+    MMThreadGuard guard(lock_);
+    vx = vx_;
+    vy = vy_;
+  }
+  double speed = sqrt(vx * vx + vy * vy);
+  if (speed <= 0.0)
+    return DEVICE_OK;
+  double seconds = segment_.getMsec() / 1000.0;
+  endX_ += vx * seconds;
+  endY_ += vy * seconds;
+  TinyGCommand command("G1 F");
+  command.AppendFixed(speed * 60.0, 1)
+      .Append(" X").AppendFixed(endX_, 4)
+      .Append(" Y").AppendFixed(endY_, 4);
+  return hub_->StartMotionCommand(command.c_str());
+}
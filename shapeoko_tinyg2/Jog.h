@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Jog.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Continuous XY velocity mode for the ShapeokoTinyG hub.
+//                TinyG has no velocity command, so the jogger keeps a short
+//                look-ahead of straight G1 segments at the requested feed in
+//                the planner.  A new velocity applies to the next segment,
+//                so it takes effect once the look-ahead, one status report
+//                interval, has run out.  Stopping is left to the hub, which
+//                holds and flushes whatever is still queued.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_JOG_H_
+#define _SHAPEOKO_TINYG_JOG_H_
+
+#include "MMDevice.h"
+#include "DeviceThreads.h"
+
+class ShapeokoTinyGHub;
+
+class ShapeokoTinyGJogger : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGJogger(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGJogger();
+
+  // Starts feeding segments from x_mm, y_mm, the machine's position at
+  // rest, with lookaheadMs of motion kept queued
+  int Start(double x_mm, double y_mm, double vx, double vy, long lookaheadMs);
+  // New velocity in mm/s for the segments still to be queued
+  void SetVelocity(double vx, double vy);
+  // Stops feeding the planner; segments already queued still run
+  void Stop();
+  // Stop() without waiting for the thread to finish
+  void RequestStop() { stop_ = true; }
+  bool IsActive() const { return active_; }
+  // DEVICE_OK, or the error that ended the last jog
+  int GetResult() const { return result_; }
+
+  int svc();
+
+ private:
+  // planner buffers left free so commands sent outside the jog still fit
+  enum { kReservedBuffers = 4 };
+  // shortest segment worth a planner buffer
+  enum { kMinSegmentMs = 20 };
+
+  int QueueSegment();
+
+  ShapeokoTinyGHub* hub_;
+  MMThreadLock lock_;
+  double vx_;             // mm/s
+  double vy_;
+  double endX_;           // end of the last queued segment, mm
+  double endY_;
+  MM::MMTime lookahead_;
+  MM::MMTime segment_;
+  MM::MMTime queuedUntil_; // when the queued segments run out
+  volatile bool active_;
+  volatile bool stop_;
+  bool joinable_;
+  int result_;
+};
+
+#endif // _SHAPEOKO_TINYG_JOG_H_
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Latency.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Latency histograms for the hub's serial command paths.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "Latency.h"
+#include <cstdio>
+#include <math.h>
+
+void TinyGLatencyHistogram::Clear()
+{
+  for (int i = 0; i < kBuckets; ++i)
+    buckets_[i] = 0;
+  count_ = 0;
+  total_ = 0.0;
+  max_ = 0.0;
+}
+
+int TinyGLatencyHistogram::Bucket(double us)
+{
+  if (us < 1.0)
+    return 0;
+  int bucket = 1 + (int) (log(us) / log(2.0) * kPerOctave);
+  return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+double TinyGLatencyHistogram::UpperEdge(int bucket)
+{
+  return pow(2.0, (double) bucket / kPerOctave);
+}
+
+void TinyGLatencyHistogram::Add(double us)
+{
+  ++buckets_[Bucket(us)];
+  ++count_;
+  total_ += us;
+  if (us > max_)
+    max_ = us;
+}
+
+double TinyGLatencyHistogram::Percentile(double p) const
+{
+  if (count_ == 0)
+    return 0.0;
+  unsigned long rank = (unsigned long) ceil(p * count_);
+  if (rank == 0)
+    rank = 1;
+  unsigned long seen = 0;
+  for (int i = 0; i < kBuckets; ++i)
+  {
+    seen += buckets_[i];
+    if (seen >= rank)
+    {
+      // never report more than was actually measured
+      double edge = UpperEdge(i);
+      return edge < max_ ? edge : max_;
+    }
+  }
+  return max_;
+}
+
+ShapeokoTinyGLatency::ShapeokoTinyGLatency()
+{
+  for (int i = 0; i < kLatencyPaths; ++i)
+    stats_[i].errors = 0;
+}
+
+void ShapeokoTinyGLatency::Record(TinyGLatencyPath path, double start, double written, double done)
+{
+  MMThreadGuard guard(lock_);
+  Stats& s = stats_[path];
+  s.write.Add(written - start);
+  s.answer.Add(done - written);
+  s.total.Add(done - start);
+}
+
+void ShapeokoTinyGLatency::RecordError(TinyGLatencyPath path)
+{
+  MMThreadGuard guard(lock_);
+  ++stats_[path].errors;
+}
+
+void ShapeokoTinyGLatency::Clear()
+{
+  MMThreadGuard guard(lock_);
+  for (int i = 0; i < kLatencyPaths; ++i)
+  {
+    stats_[i].write.Clear();
+    stats_[i].answer.Clear();
+    stats_[i].total.Clear();
+    stats_[i].errors = 0;
+  }
+}
+
+const char* ShapeokoTinyGLatency::PathName(TinyGLatencyPath path)
+{
+  switch (path)
+  {
+    case kLatencySendCommand: return "SendCommand";
+    case kLatencySendConfigCommand: return "SendConfigCommand";
+    case kLatencySendMotionCommand: return "SendMotionCommand";
+    case kLatencyStartMotionCommand: return "StartMotionCommand";
+    case kLatencyGetStatus: return "GetStatus";
+    default: return "?";
+  }
+}
+
+// e.g. "GetStatus n=1000 err=0 p50=1.19 p99=2.83 max=3.10 ms
+//       (write p50=0.05, answer p50=1.14) 841.2/s"
+// The rate is back to back throughput, count over time spent in the path.
+std::string ShapeokoTinyGLatency::Report(const char* separator)
+{
+  MMThreadGuard guard(lock_);
+  std::string report;
+  for (int i = 0; i < kLatencyPaths; ++i)
+  {
+    const Stats& s = stats_[i];
+    if (s.total.Count() == 0 && s.errors == 0)
+      continue;
+    double rate = s.total.Total() > 0.0 ? s.total.Count() * 1e6 / s.total.Total() : 0.0;
+    char buff[256];
+    sprintf(buff, "%s n=%lu err=%lu p50=%.2f p99=%.2f max=%.2f ms "
+        "(write p50=%.2f, answer p50=%.2f) %.1f/s",
+        PathName((TinyGLatencyPath) i), s.total.Count(), s.errors,
+        s.total.Percentile(0.50) / 1000.0, s.total.Percentile(0.99) / 1000.0,
+        s.total.Max() / 1000.0,
+        s.write.Percentile(0.50) / 1000.0, s.answer.Percentile(0.50) / 1000.0,
+        rate);
+    report += buff;
+    report += separator;
+  }
+  return report;
+}
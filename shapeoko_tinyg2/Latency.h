@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Latency.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Latency histograms for the hub's serial command paths.
+//                Every command records how long the write took, how long
+//                the answer took after that, and the total; the hub's
+//                "Latency Report" property and benchmark print p50/p99/max
+//                and commands per second from them.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_LATENCY_H_
+#define _SHAPEOKO_TINYG_LATENCY_H_
+
+#include "DeviceThreads.h"
+#include <string>
+
+// Log-scale histogram of durations in microseconds, four buckets per
+// octave from 1 us to about 4.5 minutes.  Percentiles are accurate to
+// within one bucket, i.e. about 19%.
+class TinyGLatencyHistogram
+{
+ public:
+  TinyGLatencyHistogram() { Clear(); }
+
+  void Clear();
+  void Add(double us);
+  unsigned long Count() const { return count_; }
+  double Total() const { return total_; }
+  double Max() const { return max_; }
+  // upper edge of the bucket holding the p-th fraction of samples, in us
+  double Percentile(double p) const;
+
+ private:
+  enum { kPerOctave = 4, kBuckets = 28 * kPerOctave + 1 };
+  static int Bucket(double us);
+  static double UpperEdge(int bucket);
+
+  unsigned long buckets_[kBuckets];
+  unsigned long count_;
+  double total_;
+  double max_;
+};
+
+// the hub entry points that are measured
+enum TinyGLatencyPath
+{
+  kLatencySendCommand,
+  kLatencySendConfigCommand,
+  kLatencySendMotionCommand,
+  kLatencyStartMotionCommand,
+  kLatencyGetStatus,
+  kLatencyPaths
+};
+
+class ShapeokoTinyGLatency
+{
+ public:
+  ShapeokoTinyGLatency();
+
+  // Times are in microseconds as from GetCurrentMMTime().getUsec():
+  // entry, write returned, and answer complete.
+  void Record(TinyGLatencyPath path, double start, double written, double done);
+  void RecordError(TinyGLatencyPath path);
+  void Clear();
+  // one line per path that has samples, ended by separator
+  std::string Report(const char* separator = "\n");
+  static const char* PathName(TinyGLatencyPath path);
+
+ private:
+  struct Stats
+  {
+    TinyGLatencyHistogram write;
+    TinyGLatencyHistogram answer;
+    TinyGLatencyHistogram total;
+    unsigned long errors;
+  };
+
+  MMThreadLock lock_;
+  Stats stats_[kLatencyPaths];
+};
+
+#endif // _SHAPEOKO_TINYG_LATENCY_H_
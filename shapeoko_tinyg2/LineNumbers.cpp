@@ -0,0 +1,35 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          LineNumbers.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Line numbers for streamed G-code.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "LineNumbers.h"
+
+long TinyGFirstStreamLine(long lastLine, long reservedEnd, long count)
+{
+  long first = lastLine + 1 > reservedEnd ? lastLine + 1 : reservedEnd;
+  if (first < 1 || first + count > TINYG_MAX_LINE_NUMBER)
+    first = 1;
+  return first;
+}
+
+long TinyGItemsReached(long line, long firstLine, long items, long linesPerItem)
+{
+  long offset = line - firstLine;
+  if (linesPerItem < 1 || offset < 0 || offset >= items * linesPerItem)
+    return -1;
+  return (offset + 1) / linesPerItem;
+}
@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          LineNumbers.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Line numbers for streamed G-code.  Sweeps, scans and Z
+//                sequences number their lines so the N value in status
+//                reports tells how far the controller has got.  Each stream
+//                gets its own range, so a report still in flight from
+//                whatever ran before it is told apart and not counted.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_LINENUMBERS_H_
+#define _SHAPEOKO_TINYG_LINENUMBERS_H_
+
+// TinyG reads the N word as a float, exact only up to 2^24
+#define TINYG_MAX_LINE_NUMBER (1L << 24)
+
+// First of count line numbers for a new stream, past both the last line
+// reported and the end of the last range handed out.  Starts again from 1
+// rather than run into numbers TinyG cannot hold.
+long TinyGFirstStreamLine(long lastLine, long reservedEnd, long count);
+
+// Items reached once line has run, for a stream of items numbered from
+// firstLine with linesPerItem lines each.  An item is reached when its
+// last line has started: a sweep pulse when its own line does, a scan tile
+// or Z slice when its dwell does.  Returns -1 for a line from outside the
+// stream.
+long TinyGItemsReached(long line, long firstLine, long items, long linesPerItem);
+
+#endif // _SHAPEOKO_TINYG_LINENUMBERS_H_
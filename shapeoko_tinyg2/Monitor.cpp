@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Monitor.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Lock and condition for the ShapeokoTinyG hub's threads.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "Monitor.h"
+#ifndef WIN32
+#include <cerrno>
+#include <sys/time.h>
+#endif
+
+#ifdef WIN32
+
+ShapeokoTinyGMonitor::ShapeokoTinyGMonitor()
+{
+  InitializeCriticalSection(&lock_);
+  InitializeConditionVariable(&cond_);
+}
+
+ShapeokoTinyGMonitor::~ShapeokoTinyGMonitor()
+{
+  DeleteCriticalSection(&lock_);
+}
+
+void ShapeokoTinyGMonitor::Lock() { EnterCriticalSection(&lock_); }
+void ShapeokoTinyGMonitor::Unlock() { LeaveCriticalSection(&lock_); }
+void ShapeokoTinyGMonitor::Wait() { SleepConditionVariableCS(&cond_, &lock_, INFINITE); }
+void ShapeokoTinyGMonitor::NotifyAll() { WakeAllConditionVariable(&cond_); }
+
+bool ShapeokoTinyGMonitor::Wait(long timeoutMs)
+{
+  if (timeoutMs <= 0)
+    return false;
+  return SleepConditionVariableCS(&cond_, &lock_, (DWORD) timeoutMs) != 0;
+}
+
+#else
+
+ShapeokoTinyGMonitor::ShapeokoTinyGMonitor()
+{
+  pthread_mutex_init(&lock_, 0);
+  pthread_cond_init(&cond_, 0);
+}
+
+ShapeokoTinyGMonitor::~ShapeokoTinyGMonitor()
+{
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&lock_);
+}
+
+void ShapeokoTinyGMonitor::Lock() { pthread_mutex_lock(&lock_); }
+void ShapeokoTinyGMonitor::Unlock() { pthread_mutex_unlock(&lock_); }
+void ShapeokoTinyGMonitor::Wait() { pthread_cond_wait(&cond_, &lock_); }
+void ShapeokoTinyGMonitor::NotifyAll() { pthread_cond_broadcast(&cond_); }
+
+bool ShapeokoTinyGMonitor::Wait(long timeoutMs)
+{
+  if (timeoutMs <= 0)
+    return false;
+  // the default condition clock is the wall clock
+  timeval now;
+  gettimeofday(&now, 0);
+  long usec = now.tv_usec + (timeoutMs % 1000) * 1000;
+  timespec until;
+  until.tv_sec = now.tv_sec + timeoutMs / 1000 + usec / 1000000;
+  until.tv_nsec = (usec % 1000000) * 1000;
+  return pthread_cond_timedwait(&cond_, &lock_, &until) != ETIMEDOUT;
+}
+
+#endif // WIN32
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Monitor.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   A lock with a condition to wait on, which MMThreadLock
+//                lacks, for the ShapeokoTinyG hub's threads to hand work
+//                and answers to each other without polling.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_MONITOR_H_
+#define _SHAPEOKO_TINYG_MONITOR_H_
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Waiters are woken all at once and check what they wait for themselves.
+class ShapeokoTinyGMonitor
+{
+ public:
+  ShapeokoTinyGMonitor();
+  ~ShapeokoTinyGMonitor();
+
+  void Lock();
+  void Unlock();
+  // with the lock held; releases it while asleep
+  void Wait();
+  // Like Wait, for at most timeoutMs; false if the time ran out
+  bool Wait(long timeoutMs);
+  void NotifyAll();
+
+  class Guard
+  {
+   public:
+    Guard(ShapeokoTinyGMonitor& monitor) : monitor_(monitor) { monitor_.Lock(); }
+    ~Guard() { monitor_.Unlock(); }
+   private:
+    ShapeokoTinyGMonitor& monitor_;
+    Guard& operator=(const Guard&);
+  };
+
+ private:
+#ifdef WIN32
+  CRITICAL_SECTION lock_;
+  CONDITION_VARIABLE cond_;
+#else
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+#endif
+  ShapeokoTinyGMonitor(const ShapeokoTinyGMonitor&);
+  ShapeokoTinyGMonitor& operator=(const ShapeokoTinyGMonitor&);
+};
+
+#endif // _SHAPEOKO_TINYG_MONITOR_H_
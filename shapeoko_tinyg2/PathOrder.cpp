@@ -0,0 +1,512 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PathOrder.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Visiting order for scattered stage positions.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PathOrder.h"
+#include <algorithm>
+#include <ctime>
+#include <math.h>
+
+namespace {
+
+// candidate points per point for the improvement moves
+const int kNeighbours = 8;
+// longest run of points an Or-opt move relocates
+const long kMaxSegment = 3;
+// smallest saving, in s, worth a move; stops rounding noise from cycling
+const double kMinGain = 1e-9;
+
+// Candidate lists come from a uniform grid over the points, in coordinates
+// divided by each axis' velocity so that grid distance approximates cruise
+// time.  The nearest neighbour tour uses the same grid, removing points as
+// they are visited.
+class PathOptimizer
+{
+ public:
+  PathOptimizer(const std::vector<TinyGPathPoint>& points, const TinyGPathOptions& options);
+  void Run(std::vector<long>& order);
+
+ private:
+  double Cost(long a, long b) const { return TinyGMoveTime(points_[a], points_[b], options_); }
+  // cost of the edge leaving position p, 0 past the end of the path
+  double EdgeCost(long p) const { return p + 1 < n_ ? Cost(order_[p], order_[p + 1]) : 0.0; }
+  bool Expired() const;
+
+  void BuildGrid();
+  long CellX(long i) const;
+  long CellY(long i) const;
+  double Distance2(long a, long b) const;
+  void FindNeighbours();
+  void RemoveFromGrid(long i);
+  long NearestUnvisited(long a) const;
+  void NearestNeighbourTour();
+
+  void Activate(long i);
+  bool ImproveTwoOpt(long a);
+  bool TryTwoOpt(long p, long q);
+  bool ImproveOrOpt(long a);
+  bool TryOrOpt(long i, long len);
+  void UpdatePositions(long from, long to);
+
+  const std::vector<TinyGPathPoint>& points_;
+  const TinyGPathOptions& options_;
+  long n_;
+  clock_t deadline_;
+  bool limited_;
+
+  std::vector<double> u_;
+  std::vector<double> v_;
+  double minU_;
+  double minV_;
+  double cell_;
+  long cols_;
+  long rows_;
+  std::vector<long> cellStart_;   // per cell, into cellItems_
+  std::vector<long> cellCount_;   // points of the cell not yet visited
+  std::vector<long> cellItems_;
+  std::vector<long> slot_;        // index of each point in cellItems_
+
+  std::vector<long> neighbours_;  // kNeighbours per point, -1 if fewer
+  std::vector<long> order_;
+  std::vector<long> pos_;         // position of each point in order_
+
+  // points whose surroundings changed since they were last tried; the
+  // rest are skipped ("don't look bits")
+  std::vector<long> queue_;
+  long queueHead_;
+  std::vector<char> queued_;
+};
+
+PathOptimizer::PathOptimizer(const std::vector<TinyGPathPoint>& points, const TinyGPathOptions& options) :
+    points_(points),
+    options_(options),
+    n_((long) points.size()),
+    limited_(options.timeLimitMs > 0.0)
+{
+  deadline_ = clock() + (clock_t) (options.timeLimitMs / 1000.0 * CLOCKS_PER_SEC);
+}
+
+bool PathOptimizer::Expired() const
+{
+  return limited_ && clock() > deadline_;
+}
+
+void PathOptimizer::BuildGrid()
+{
+  u_.resize(n_);
+  v_.resize(n_);
+  for (long i = 0; i < n_; ++i)
+  {
+    u_[i] = points_[i].x_um / options_.x.velocity;
+    v_[i] = points_[i].y_um / options_.y.velocity;
+  }
+  minU_ = *std::min_element(u_.begin(), u_.end());
+  minV_ = *std::min_element(v_.begin(), v_.end());
+  double spanU = *std::max_element(u_.begin(), u_.end()) - minU_;
+  double spanV = *std::max_element(v_.begin(), v_.end()) - minV_;
+
+  // about two points per cell; a line of points gets a row of cells
+  if (spanU > 0.0 && spanV > 0.0)
+    cell_ = sqrt(spanU * spanV * 2.0 / n_);
+  else
+    cell_ = (spanU > spanV ? spanU : spanV) * 2.0 / n_;
+  if (!(cell_ > 0.0))
+    cell_ = 1.0;
+  cols_ = (long) (spanU / cell_) + 1;
+  rows_ = (long) (spanV / cell_) + 1;
+
+  long cells = cols_ * rows_;
+  cellStart_.assign(cells + 1, 0);
+  for (long i = 0; i < n_; ++i)
+    ++cellStart_[CellY(i) * cols_ + CellX(i) + 1];
+  for (long c = 0; c < cells; ++c)
+    cellStart_[c + 1] += cellStart_[c];
+  cellCount_.assign(cells, 0);
+  cellItems_.resize(n_);
+  slot_.resize(n_);
+  for (long i = 0; i < n_; ++i)
+  {
+    long c = CellY(i) * cols_ + CellX(i);
+    slot_[i] = cellStart_[c] + cellCount_[c]++;
+    cellItems_[slot_[i]] = i;
+  }
+}
+
+long PathOptimizer::CellX(long i) const
+{
+  long x = (long) ((u_[i] - minU_) / cell_);
+  return x < cols_ ? x : cols_ - 1;
+}
+
+long PathOptimizer::CellY(long i) const
+{
+  long y = (long) ((v_[i] - minV_) / cell_);
+  return y < rows_ ? y : rows_ - 1;
+}
+
+double PathOptimizer::Distance2(long a, long b) const
+{
+  double du = u_[a] - u_[b];
+  double dv = v_[a] - v_[b];
+  return du * du + dv * dv;
+}
+
+// Searches square rings of cells around each point; once the ring radius
+// exceeds the kth best distance no closer point can remain.
+void PathOptimizer::FindNeighbours()
+{
+  neighbours_.assign(n_ * kNeighbours, -1);
+  long maxRing = cols_ > rows_ ? cols_ : rows_;
+  for (long a = 0; a < n_; ++a)
+  {
+    long* best = &neighbours_[a * kNeighbours];
+    double bestD[kNeighbours];
+    int count = 0;
+    long cx = CellX(a);
+    long cy = CellY(a);
+    for (long r = 0; r <= maxRing; ++r)
+    {
+      for (long y = cy - r; y <= cy + r; ++y)
+      {
+        if (y < 0 || y >= rows_)
+          continue;
+        long step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+        for (long x = cx - r; x <= cx + r; x += (step > 0 ? step : 1))
+        {
+          if (x < 0 || x >= cols_)
+            continue;
+          long c = y * cols_ + x;
+          for (long s = cellStart_[c]; s < cellStart_[c + 1]; ++s)
+          {
+            long b = cellItems_[s];
+            if (b == a)
+              continue;
+            double d = Distance2(a, b);
+            if (count == kNeighbours && d >= bestD[count - 1])
+              continue;
+            int k = count < kNeighbours ? count++ : count - 1;
+            while (k > 0 && bestD[k - 1] > d)
+            {
+              bestD[k] = bestD[k - 1];
+              best[k] = best[k - 1];
+              --k;
+            }
+            bestD[k] = d;
+            best[k] = b;
+          }
+        }
+      }
+      double reach = r * cell_;
+      if (count == kNeighbours && bestD[count - 1] <= reach * reach)
+        break;
+    }
+  }
+}
+
+void PathOptimizer::RemoveFromGrid(long i)
+{
+  long c = CellY(i) * cols_ + CellX(i);
+  long last = cellStart_[c] + --cellCount_[c];
+  long moved = cellItems_[last];
+  cellItems_[slot_[i]] = moved;
+  slot_[moved] = slot_[i];
+  cellItems_[last] = i;
+  slot_[i] = last;
+}
+
+long PathOptimizer::NearestUnvisited(long a) const
+{
+  long maxRing = cols_ > rows_ ? cols_ : rows_;
+  long cx = CellX(a);
+  long cy = CellY(a);
+  long best = -1;
+  double bestD = 0.0;
+  for (long r = 0; r <= maxRing; ++r)
+  {
+    for (long y = cy - r; y <= cy + r; ++y)
+    {
+      if (y < 0 || y >= rows_)
+        continue;
+      long step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+      for (long x = cx - r; x <= cx + r; x += (step > 0 ? step : 1))
+      {
+        if (x < 0 || x >= cols_)
+          continue;
+        long c = y * cols_ + x;
+        for (long s = cellStart_[c]; s < cellStart_[c] + cellCount_[c]; ++s)
+        {
+          long b = cellItems_[s];
+          double d = Distance2(a, b);
+          if (best < 0 || d < bestD)
+          {
+            best = b;
+            bestD = d;
+          }
+        }
+      }
+    }
+    double reach = r * cell_;
+    if (best >= 0 && bestD <= reach * reach)
+      break;
+  }
+  return best;
+}
+
+void PathOptimizer::NearestNeighbourTour()
+{
+  order_.clear();
+  order_.reserve(n_);
+  long current = options_.start >= 0 && options_.start < n_ ? options_.start : 0;
+  RemoveFromGrid(current);
+  order_.push_back(current);
+  while ((long) order_.size() < n_)
+  {
+    current = NearestUnvisited(current);
+    RemoveFromGrid(current);
+    order_.push_back(current);
+  }
+  pos_.resize(n_);
+  UpdatePositions(0, n_);
+}
+
+void PathOptimizer::UpdatePositions(long from, long to)
+{
+  for (long p = from; p < to; ++p)
+    pos_[order_[p]] = p;
+}
+
+// Reverses order_[p+1..q], replacing edges (p, p+1) and (q, q+1) with
+// (p, q) and (p+1, q+1).  Position 0 never moves.
+bool PathOptimizer::TryTwoOpt(long p, long q)
+{
+  if (p < 0 || q <= p + 1)
+    return false;
+  double gain = Cost(order_[p], order_[p + 1]) + EdgeCost(q) - Cost(order_[p], order_[q]);
+  if (q + 1 < n_)
+    gain -= Cost(order_[p + 1], order_[q + 1]);
+  if (gain <= kMinGain)
+    return false;
+  std::reverse(order_.begin() + p + 1, order_.begin() + q + 1);
+  UpdatePositions(p + 1, q + 1);
+  Activate(order_[p]);
+  Activate(order_[p + 1]);
+  Activate(order_[q]);
+  if (q + 1 < n_)
+    Activate(order_[q + 1]);
+  return true;
+}
+
+// Tries the two reversals that would make a adjacent to each candidate
+bool PathOptimizer::ImproveTwoOpt(long a)
+{
+  for (int k = 0; k < kNeighbours; ++k)
+  {
+    long c = neighbours_[a * kNeighbours + k];
+    if (c < 0)
+      break;
+    long lo = pos_[a] < pos_[c] ? pos_[a] : pos_[c];
+    long hi = pos_[a] < pos_[c] ? pos_[c] : pos_[a];
+    if (TryTwoOpt(lo, hi) || TryTwoOpt(lo - 1, hi - 1))
+      return true;
+  }
+  return false;
+}
+
+// Moves order_[i..i+len) elsewhere, forwards or reversed, next to a
+// candidate of one of its ends.  Only the best placement is made.
+bool PathOptimizer::TryOrOpt(long i, long len)
+{
+  long first = order_[i];
+  long last = order_[i + len - 1];
+  long prev = order_[i - 1];
+  bool hasNext = i + len < n_;
+  double removeGain = Cost(prev, first);
+  if (hasNext)
+    removeGain += Cost(last, order_[i + len]) - Cost(prev, order_[i + len]);
+  if (removeGain <= kMinGain)
+    return false;
+
+  double bestGain = kMinGain;
+  long bestJ = -1;
+  bool bestReversed = false;
+  long ends[2] = {first, last};
+  for (int e = 0; e < 2; ++e)
+  {
+    for (int k = 0; k < kNeighbours; ++k)
+    {
+      long c = neighbours_[ends[e] * kNeighbours + k];
+      if (c < 0)
+        break;
+      // insert after c, or before it
+      for (long j = pos_[c]; j >= pos_[c] - 1; --j)
+      {
+        if (j < 0 || (j >= i - 1 && j <= i + len - 1))
+          continue;
+        bool hasAfter = j + 1 < n_;
+        double base = EdgeCost(j);
+        for (int reversed = 0; reversed < 2; ++reversed)
+        {
+          long f = reversed ? last : first;
+          long l = reversed ? first : last;
+          double add = Cost(order_[j], f) - base;
+          if (hasAfter)
+            add += Cost(l, order_[j + 1]);
+          if (removeGain - add > bestGain)
+          {
+            bestGain = removeGain - add;
+            bestJ = j;
+            bestReversed = reversed != 0;
+          }
+        }
+      }
+    }
+  }
+  if (bestJ < 0)
+    return false;
+  Activate(prev);
+  if (hasNext)
+    Activate(order_[i + len]);
+  Activate(first);
+  Activate(last);
+  Activate(order_[bestJ]);
+  if (bestJ + 1 < n_)
+    Activate(order_[bestJ + 1]);
+
+  long from, to, seg;
+  if (bestJ > i)
+  {
+    std::rotate(order_.begin() + i, order_.begin() + i + len, order_.begin() + bestJ + 1);
+    from = i;
+    to = bestJ + 1;
+    seg = bestJ + 1 - len;
+  }
+  else
+  {
+    std::rotate(order_.begin() + bestJ + 1, order_.begin() + i, order_.begin() + i + len);
+    from = bestJ + 1;
+    to = i + len;
+    seg = bestJ + 1;
+  }
+  if (bestReversed)
+    std::reverse(order_.begin() + seg, order_.begin() + seg + len);
+  UpdatePositions(from, to);
+  return true;
+}
+
+// Tries moving the runs that start or end at a
+bool PathOptimizer::ImproveOrOpt(long a)
+{
+  for (long len = 1; len <= kMaxSegment; ++len)
+  {
+    long i = pos_[a];
+    if (i >= 1 && i + len <= n_ && TryOrOpt(i, len))
+      return true;
+    i = pos_[a] - len + 1;
+    if (len > 1 && i >= 1 && TryOrOpt(i, len))
+      return true;
+  }
+  return false;
+}
+
+void PathOptimizer::Activate(long i)
+{
+  if (queued_[i])
+    return;
+  queued_[i] = 1;
+  queue_.push_back(i);
+}
+
+void PathOptimizer::Run(std::vector<long>& order)
+{
+  if (n_ < 3)
+  {
+    order.clear();
+    long start = options_.start >= 0 && options_.start < n_ ? options_.start : 0;
+    for (long i = 0; i < n_; ++i)
+      order.push_back((start + i) % n_);
+    return;
+  }
+  BuildGrid();
+  FindNeighbours();
+  NearestNeighbourTour();
+
+  queued_.assign(n_, 0);
+  queue_.clear();
+  for (long p = 0; p < n_; ++p)
+    Activate(order_[p]);
+  queueHead_ = 0;
+  while (queueHead_ < (long) queue_.size() && !Expired())
+  {
+    long a = queue_[queueHead_++];
+    queued_[a] = 0;
+    // a point that led to an improvement is tried again
+    if (ImproveTwoOpt(a) || ImproveOrOpt(a))
+      Activate(a);
+    // reclaim the consumed front of the queue now and then
+    if (queueHead_ >= n_ && queueHead_ * 2 >= (long) queue_.size())
+    {
+      queue_.erase(queue_.begin(), queue_.begin() + queueHead_);
+      queueHead_ = 0;
+    }
+  }
+  order.swap(order_);
+}
+
+} // namespace
+
+double TinyGAxisMoveTime(double distance, const TinyGAxisLimits& limits)
+{
+  if (distance <= 0.0)
+    return 0.0;
+  // the axis reaches full speed only if the move is long enough to
+  // accelerate and decelerate, v^2 / a in all
+  double ramp = limits.velocity * limits.velocity / limits.accel;
+  if (distance < ramp)
+    return 2.0 * sqrt(distance / limits.accel);
+  return distance / limits.velocity + limits.velocity / limits.accel;
+}
+
+double TinyGMoveTime(const TinyGPathPoint& a, const TinyGPathPoint& b, const TinyGPathOptions& options)
+{
+  double t = TinyGAxisMoveTime(fabs(a.x_um - b.x_um), options.x);
+  double ty = TinyGAxisMoveTime(fabs(a.y_um - b.y_um), options.y);
+  if (ty > t)
+    t = ty;
+  if (options.useZ)
+  {
+    double tz = TinyGAxisMoveTime(fabs(a.z_um - b.z_um), options.z);
+    if (tz > t)
+      t = tz;
+  }
+  return t;
+}
+
+double TinyGPathTime(const std::vector<TinyGPathPoint>& points, const std::vector<long>& order,
+    const TinyGPathOptions& options)
+{
+  double t = 0.0;
+  for (size_t i = 1; i < order.size(); ++i)
+    t += TinyGMoveTime(points[order[i - 1]], points[order[i]], options);
+  return t;
+}
+
+void TinyGOrderPath(const std::vector<TinyGPathPoint>& points, const TinyGPathOptions& options,
+    std::vector<long>& order)
+{
+  PathOptimizer optimizer(points, options);
+  optimizer.Run(order);
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PathOrder.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Visiting order for scattered stage positions.  A nearest
+//                neighbour tour is improved with 2-opt and Or-opt moves,
+//                both restricted to each point's nearest candidates.  Moves
+//                are costed in seconds from each axis' velocity and
+//                acceleration, so a slow axis is crossed less often than
+//                plain distances would suggest.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_PATHORDER_H_
+#define _SHAPEOKO_TINYG_PATHORDER_H_
+
+#include <vector>
+
+struct TinyGPathPoint
+{
+  double x_um;
+  double y_um;
+  double z_um;
+};
+
+struct TinyGAxisLimits
+{
+  double velocity;  // um/s
+  double accel;     // um/s^2
+};
+
+struct TinyGPathOptions
+{
+  TinyGAxisLimits x;
+  TinyGAxisLimits y;
+  TinyGAxisLimits z;
+  bool useZ;            // also cost the Z travel between points
+  long start;           // index of the point visited first
+  double timeLimitMs;   // improvement stops after this much CPU time
+};
+
+// Time in s for one axis to travel distance and stop, on a trapezoidal
+// (or, for short moves, triangular) velocity profile
+double TinyGAxisMoveTime(double distance, const TinyGAxisLimits& limits);
+
+// Time in s of a move between two points; the axes travel together, so
+// the slowest one decides
+double TinyGMoveTime(const TinyGPathPoint& a, const TinyGPathPoint& b, const TinyGPathOptions& options);
+
+// Total move time in s along points in the given order
+double TinyGPathTime(const std::vector<TinyGPathPoint>& points, const std::vector<long>& order,
+    const TinyGPathOptions& options);
+
+// Fills order with a permutation of the point indices that starts at
+// options.start and keeps the total move time low.  The path is open: it
+// ends wherever the last point is.
+void TinyGOrderPath(const std::vector<TinyGPathPoint>& points, const TinyGPathOptions& options,
+    std::vector<long>& order);
+
+#endif // _SHAPEOKO_TINYG_PATHORDER_H_
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PositionTimeline.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Bounded history of timestamped TinyG positions.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PositionTimeline.h"
+
+ShapeokoTinyGTimeline::ShapeokoTinyGTimeline() :
+    count_(0)
+{
+  for (int i = 0; i < kSlots; ++i)
+  {
+    slots_[i].seq = 0;
+    slots_[i].index = 0;
+  }
+}
+
+void ShapeokoTinyGTimeline::Append(const TinyGPositionSample& sample)
+{
+  unsigned long index = count_;
+  Slot& slot = slots_[index % kSlots];
+  slot.seq = slot.seq + 1;
+  TINYG_MEMORY_BARRIER();
+  slot.index = index;
+  slot.sample = sample;
+  TINYG_MEMORY_BARRIER();
+  slot.seq = slot.seq + 1;
+  TINYG_MEMORY_BARRIER();
+  count_ = index + 1;
+}
+
+bool ShapeokoTinyGTimeline::ReadSample(unsigned long index, TinyGPositionSample& sample) const
+{
+  const Slot& slot = slots_[index % kSlots];
+  unsigned long before, after, stored;
+  do
+  {
+    before = slot.seq;
+    TINYG_MEMORY_BARRIER();
+    stored = slot.index;
+    sample = slot.sample;
+    TINYG_MEMORY_BARRIER();
+    after = slot.seq;
+  } while (before != after || (before & 1) != 0);
+  return stored == index;
+}
+
+bool ShapeokoTinyGTimeline::PositionAt(double time_us, TinyGPositionSample& estimate) const
+{
+  unsigned long count = count_;
+  if (count == 0)
+    return false;
+  TinyGPositionSample newest;
+  if (!ReadSample(count - 1, newest))
+    return false;
+  if (time_us >= newest.time_us)
+  {
+    // same motion states as ShapeokoTinyGHub::IsMotionState
+    if (time_us > newest.time_us && newest.stat >= 5 && newest.stat <= 9)
+      return false;
+    estimate = newest;
+    estimate.time_us = time_us;
+    return true;
+  }
+
+  // the last sample at or before time_us; samples the writer overwrites
+  // during the search fail to read, as if they had never been kept
+  unsigned long lo = count > (unsigned long) kSlots ? count - kSlots : 0;
+  unsigned long hi = count - 1;
+  TinyGPositionSample before;
+  if (!ReadSample(lo, before) || before.time_us > time_us)
+    return false;
+  while (hi - lo > 1)
+  {
+    unsigned long mid = lo + (hi - lo) / 2;
+    TinyGPositionSample sample;
+    if (!ReadSample(mid, sample))
+      return false;
+    if (sample.time_us <= time_us)
+    {
+      lo = mid;
+      before = sample;
+    }
+    else
+      hi = mid;
+  }
+  TinyGPositionSample after;
+  if (!ReadSample(hi, after))
+    return false;
+
+  double span = after.time_us - before.time_us;
+  double f = span > 0.0 ? (time_us - before.time_us) / span : 0.0;
+  for (int i = 0; i < 3; ++i)
+    estimate.pos[i] = before.pos[i] + f * (after.pos[i] - before.pos[i]);
+  estimate.stat = before.stat;
+  estimate.time_us = time_us;
+  return true;
+}
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PositionTimeline.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Bounded history of timestamped positions from the TinyG
+//                status reports, for working out where the stage was at a
+//                given moment, e.g. when a camera frame was exposed.  The
+//                hub's reader thread is the only writer; any thread can
+//                query without taking a lock.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_POSITIONTIMELINE_H_
+#define _SHAPEOKO_TINYG_POSITIONTIMELINE_H_
+
+#include "StatusCache.h"
+
+struct TinyGPositionSample
+{
+  double time_us;   // host time the report arrived, as GetCurrentMMTime()
+  double pos[3];    // measured work position, mm
+  int stat;         // machine state
+};
+
+class ShapeokoTinyGTimeline
+{
+ public:
+  enum { kSlots = 4096 };   // about 40 s of reports at a 10 ms interval
+
+  ShapeokoTinyGTimeline();
+
+  // Single writer only, in time order.  Each slot has its own sequence
+  // number, so readers retry only when they hit the slot being written.
+  void Append(const TinyGPositionSample& sample);
+
+  // Estimates the position at time_us by interpolating linearly between
+  // the samples either side of it.  After the newest sample the position
+  // is known only if the machine had stopped; while it moves the caller
+  // has to ask again once the next report is in.  Returns false for such
+  // times and for times older than the samples kept.
+  bool PositionAt(double time_us, TinyGPositionSample& estimate) const;
+
+  // samples appended so far, kept or not
+  unsigned long Count() const { return count_; }
+
+ private:
+  struct Slot
+  {
+    volatile unsigned long seq;   // odd while a write is in progress
+    unsigned long index;          // which sample the slot holds
+    TinyGPositionSample sample;
+  };
+
+  // False if the sample has been overwritten
+  bool ReadSample(unsigned long index, TinyGPositionSample& sample) const;
+
+  volatile unsigned long count_;
+  Slot slots_[kSlots];
+};
+
+#endif // _SHAPEOKO_TINYG_POSITIONTIMELINE_H_
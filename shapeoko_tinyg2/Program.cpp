@@ -0,0 +1,301 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Program.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Streams a G-code program file to the TinyG controller.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ShapeokoTinyG.h"
+#include "Program.h"
+#include <cstring>
+
+ShapeokoTinyGProgram::ShapeokoTinyGProgram(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    data_(0),
+    size_(0),
+    offset_(0),
+    lineLen_(0),
+    haveLine_(false),
+    linesSent_(0),
+    active_(false),
+    paused_(false),
+    stop_(false),
+    joinable_(false),
+    result_(DEVICE_OK)
+{
+}
+
+ShapeokoTinyGProgram::~ShapeokoTinyGProgram()
+{
+  Stop();
+}
+
+int ShapeokoTinyGProgram::Start(const std::string& path)
+{
+  if (active_)
+    return ERR_STAGE_MOVING;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  Unmap();
+  int ret = Map(path);
+  if (ret != DEVICE_OK)
+    return ret;
+  offset_ = 0;
+  haveLine_ = false;
+  linesSent_ = 0;
+  result_ = DEVICE_OK;
+  paused_ = false;
+  stop_ = false;
+
+  // as in ShapeokoTinyGStreamer::Start, the reader keeps this current
+  ret = hub_->SendCommand("{\"qr\":null}", kLaneStatus);
+  if (ret != DEVICE_OK)
+  {
+    Unmap();
+    return ret;
+  }
+
+  active_ = true;
+  if (activate() != 0)
+  {
+    active_ = false;
+    Unmap();
+    return DEVICE_ERR;
+  }
+  joinable_ = true;
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGProgram::Stop()
+{
+  stop_ = true;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  active_ = false;
+  paused_ = false;
+  Unmap();
+}
+
+double ShapeokoTinyGProgram::Progress() const
+{
+  if (size_ == 0)
+    return active_ ? 0.0 : 1.0;
+  return (double) offset_ / size_;
+}
+
+int ShapeokoTinyGProgram::Map(const std::string& path)
+{
+#ifdef WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+      FILE_FLAG_SEQUENTIAL_SCAN, 0);
+  if (file == INVALID_HANDLE_VALUE)
+    return ERR_PROGRAM_FILE;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.HighPart != 0)
+  {
+    CloseHandle(file);
+    return ERR_PROGRAM_FILE;
+  }
+  size_ = size.LowPart;
+  if (size_ == 0)
+  {
+    CloseHandle(file);
+    return DEVICE_OK;
+  }
+  HANDLE mapping = CreateFileMapping(file, 0, PAGE_READONLY, 0, 0, 0);
+  void* view = mapping != 0 ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+  // the view keeps the file and the mapping open
+  if (mapping != 0)
+    CloseHandle(mapping);
+  CloseHandle(file);
+  if (view == 0)
+    return ERR_PROGRAM_FILE;
+  data_ = (const char*) view;
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return ERR_PROGRAM_FILE;
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return ERR_PROGRAM_FILE;
+  }
+  size_ = (unsigned long) st.st_size;
+  if (size_ == 0)
+  {
+    close(fd);
+    return DEVICE_OK;
+  }
+  void* view = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file open
+  close(fd);
+  if (view == MAP_FAILED)
+    return ERR_PROGRAM_FILE;
+  madvise(view, size_, MADV_SEQUENTIAL);
+  data_ = (const char*) view;
+#endif
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGProgram::Unmap()
+{
+  if (data_ == 0)
+    return;
+#ifdef WIN32
+  UnmapViewOfFile(data_);
+#else
+  munmap((void*) data_, size_);
+#endif
+  data_ = 0;
+}
+
+/*
+ * Reads the next line worth sending into line_.  Comments, in parentheses
+ * or after ';', and blanks are left out, as are '%' program delimiters.
+ * TinyG acts on '!', '~' and '%' wherever they appear, so a line that
+ * still holds one is refused rather than sent.
+ */
+int ShapeokoTinyGProgram::NextLine()
+{
+  haveLine_ = false;
+  while (!haveLine_ && offset_ < size_)
+  {
+    const char* start = data_ + offset_;
+    const char* end = (const char*) memchr(start, '\n', size_ - offset_);
+    if (end == 0)
+      end = data_ + size_;
+    offset_ = (unsigned long) (end - data_) + (end < data_ + size_ ? 1 : 0);
+
+    lineLen_ = 0;
+    bool inComment = false;
+    bool delimiter = false;
+    for (const char* c = start; c < end && *c != ';'; ++c)
+    {
+      if (inComment)
+      {
+        inComment = (*c != ')');
+        continue;
+      }
+      if (*c == '(')
+      {
+        inComment = true;
+        continue;
+      }
+      if (*c == ' ' || *c == '\t' || *c == '\r')
+        continue;
+      if (*c == '%' && lineLen_ == 0)
+      {
+        delimiter = true;
+        continue;
+      }
+      // one byte is kept for the terminator
+      if (*c == '!' || *c == '~' || *c == '%' || lineLen_ + 1 >= (unsigned) kStreamBytes)
+        return ERR_PROGRAM_LINE;
+      line_[lineLen_++] = *c;
+    }
+    if (delimiter && lineLen_ != 0)
+      return ERR_PROGRAM_LINE;
+    haveLine_ = (lineLen_ != 0);
+  }
+  return DEVICE_OK;
+}
+
+/*
+ * Writes as many lines as fit in the part of the receive buffer that is
+ * not taken by lines still unanswered.  TinyG answers lines in the order
+ * it reads them, and the hub matches the answers up, so one write can
+ * carry several lines and none of them waits for a round trip.
+ */
+int ShapeokoTinyGProgram::SendBatch()
+{
+  unsigned long used = hub_->GetUnansweredBytes();
+  unsigned len = 0;
+  unsigned long lines = 0;
+  int ret = DEVICE_OK;
+  while (haveLine_ && used + lineLen_ + 1 <= (unsigned long) kStreamBytes)
+  {
+    if (len != 0)
+      batch_[len++] = '\r';
+    memcpy(batch_ + len, line_, lineLen_);
+    len += lineLen_;
+    used += lineLen_ + 1;
+    ++lines;
+    ret = NextLine();
+    if (ret != DEVICE_OK)
+      break;
+  }
+  if (lines == 0)
+    return ret;
+  batch_[len] = '\0';
+  int sendRet = hub_->SendCommandNoResponse(batch_, kLaneMotion);
+  if (sendRet != DEVICE_OK)
+    return sendRet;
+  linesSent_ += lines;
+  return ret;
+}
+
+// Answers come as the planner takes the lines, which can take as long as
+// a move, so there is no timeout; Stop() ends the wait.
+void ShapeokoTinyGProgram::WaitForAnswers()
+{
+  while (!stop_ && hub_->GetUnansweredLines() != 0)
+    CDeviceUtils::SleepMs(1);
+}
+
+int ShapeokoTinyGProgram::svc()
+{
+  int ret = NextLine();
+  while (ret == DEVICE_OK && haveLine_ && !stop_)
+  {
+    ret = hub_->TakeUnansweredError();
+    if (ret != DEVICE_OK)
+      break;
+    if (paused_ || hub_->GetQueueFree() <= kReservedBuffers)
+    {
+      CDeviceUtils::SleepMs(1);
+      continue;
+    }
+    unsigned long sent = linesSent_;
+    ret = SendBatch();
+    // nothing fitted; wait for answers to free the receive buffer
+    if (ret == DEVICE_OK && linesSent_ == sent)
+      CDeviceUtils::SleepMs(1);
+  }
+  if (ret == DEVICE_OK)
+  {
+    WaitForAnswers();
+    ret = hub_->TakeUnansweredError();
+  }
+  if (ret == DEVICE_OK && stop_)
+    ret = ERR_PROGRAM_ABORTED;
+  result_ = ret;
+  active_ = false;
+  return 0;
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Program.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Streams a G-code program file to the TinyG controller.  The
+//                file is memory mapped and its lines are written in batches
+//                without waiting for each response; the bytes not yet
+//                answered are counted so the controller's receive buffer
+//                never overflows.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_PROGRAM_H_
+#define _SHAPEOKO_TINYG_PROGRAM_H_
+
+#include "MMDevice.h"
+#include "DeviceThreads.h"
+#include <string>
+
+class ShapeokoTinyGHub;
+
+class ShapeokoTinyGProgram : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGProgram(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGProgram();
+
+  // Maps the file and starts streaming it.  Fails if a program is running.
+  int Start(const std::string& path);
+  // Stops sending; lines already sent still run.  The file is unmapped.
+  void Stop();
+  void RequestStop() { stop_ = true; }
+  // Pausing only stops sending; the hub holds the motion itself
+  void Pause() { paused_ = true; }
+  void Resume() { paused_ = false; }
+  bool IsActive() const { return active_; }
+  bool IsPaused() const { return paused_; }
+  unsigned long LinesSent() const { return linesSent_; }
+  // share of the file sent so far, 0 to 1
+  double Progress() const;
+  // DEVICE_OK, or the error that ended the last program
+  int GetResult() const { return result_; }
+
+  int svc();
+
+ private:
+  enum {
+    // TinyG's serial receive buffer
+    kRxBytes = 254,
+    // left free for the adapter's own commands, such as status requests
+    kReservedRx = 54,
+    kStreamBytes = kRxBytes - kReservedRx,
+    // planner buffers left free, as for ShapeokoTinyGStreamer
+    kReservedBuffers = 4
+  };
+
+  int Map(const std::string& path);
+  void Unmap();
+  int NextLine();
+  int SendBatch();
+  void WaitForAnswers();
+
+  ShapeokoTinyGHub* hub_;
+  const char* data_;
+  unsigned long size_;
+  volatile unsigned long offset_;   // start of the next line in the file
+  // the next line to send, comments and blanks taken out
+  char line_[kStreamBytes];
+  unsigned lineLen_;
+  bool haveLine_;
+  // lines batched for one write, separated by '\r'
+  char batch_[kStreamBytes + 1];
+  volatile unsigned long linesSent_;
+  volatile bool active_;
+  volatile bool paused_;
+  volatile bool stop_;
+  bool joinable_;
+  volatile int result_;
+};
+
+#endif // _SHAPEOKO_TINYG_PROGRAM_H_
@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanPath.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Tile layout for the XY stage's scan engine.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ScanPath.h"
+#include <math.h>
+
+namespace {
+
+// Number of tiles of the given size and step needed to cover length.  The
+// small tolerance keeps rounding in the step from adding a tile that
+// would only cover a few nanometres.
+long TileCount(double length, double tile, double step)
+{
+  if (length <= tile)
+    return 1;
+  return 1 + (long) ceil((length - tile) / step - 1e-9);
+}
+
+} // namespace
+
+bool BuildSerpentineScan(const TinyGScanRegion& region, std::vector<TinyGScanTile>& tiles)
+{
+  if (region.tileWidth_um <= 0.0 || region.tileHeight_um <= 0.0 ||
+      region.overlap < 0.0 || region.overlap >= 1.0 ||
+      region.xMax_um < region.xMin_um || region.yMax_um < region.yMin_um)
+    return false;
+
+  double stepX = region.tileWidth_um * (1.0 - region.overlap);
+  double stepY = region.tileHeight_um * (1.0 - region.overlap);
+  long cols = TileCount(region.xMax_um - region.xMin_um, region.tileWidth_um, stepX);
+  long rows = TileCount(region.yMax_um - region.yMin_um, region.tileHeight_um, stepY);
+  double x0 = region.xMin_um + region.tileWidth_um / 2.0;
+  double y0 = region.yMin_um + region.tileHeight_um / 2.0;
+
+  tiles.reserve(tiles.size() + rows * cols);
+  for (long row = 0; row < rows; ++row)
+  {
+    for (long i = 0; i < cols; ++i)
+    {
+      TinyGScanTile tile;
+      tile.row = row;
+      tile.col = (row % 2 == 0) ? i : cols - 1 - i;
+      tile.x_um = x0 + tile.col * stepX;
+      tile.y_um = y0 + row * stepY;
+      tiles.push_back(tile);
+    }
+  }
+  return true;
+}
+
+double ScanPathLength(const std::vector<TinyGScanTile>& tiles)
+{
+  double length = 0.0;
+  for (size_t i = 1; i < tiles.size(); ++i)
+  {
+    double dx = tiles[i].x_um - tiles[i - 1].x_um;
+    double dy = tiles[i].y_um - tiles[i - 1].y_um;
+    length += sqrt(dx * dx + dy * dy);
+  }
+  return length;
+}
+
+bool BuildSweepTriggers(const TinyGSweepLine& line, std::vector<TinyGScanTile>& triggers)
+{
+  double dx = line.endX_um - line.startX_um;
+  double dy = line.endY_um - line.startY_um;
+  double length = sqrt(dx * dx + dy * dy);
+  if (length <= 0.0 || line.interval_um <= 0.0)
+    return false;
+
+  // same rounding tolerance as TileCount
+  long count = 1 + (long) floor(length / line.interval_um + 1e-9);
+  triggers.reserve(triggers.size() + count);
+  for (long i = 0; i < count; ++i)
+  {
+    double f = i * line.interval_um / length;
+    TinyGScanTile trigger;
+    trigger.row = 0;
+    trigger.col = i;
+    trigger.x_um = line.startX_um + f * dx;
+    trigger.y_um = line.startY_um + f * dy;
+    triggers.push_back(trigger);
+  }
+  return true;
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanPath.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Tile layout for the XY stage's scan engine.  A region is
+//                covered with overlapping tiles visited row by row in
+//                serpentine (boustrophedon) order: odd rows run backwards,
+//                so the stage never flies back across the region between
+//                rows as it would in raster order.  A sweep instead images
+//                on the fly along one line, with a trigger every interval.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_SCANPATH_H_
+#define _SHAPEOKO_TINYG_SCANPATH_H_
+
+#include <vector>
+
+struct TinyGScanTile
+{
+  double x_um;      // tile centre
+  double y_um;
+  long row;
+  long col;
+};
+
+struct TinyGScanRegion
+{
+  double xMin_um;   // area to cover; tiles may overhang the far edges
+  double yMin_um;
+  double xMax_um;
+  double yMax_um;
+  double tileWidth_um;
+  double tileHeight_um;
+  double overlap;   // fraction of a tile shared with its neighbour, [0, 1)
+};
+
+// Appends the tiles in visiting order.  Returns false if the region or
+// tile size makes no sense.
+bool BuildSerpentineScan(const TinyGScanRegion& region, std::vector<TinyGScanTile>& tiles);
+
+// Total XY travel from the first tile to the last, in um
+double ScanPathLength(const std::vector<TinyGScanTile>& tiles);
+
+struct TinyGSweepLine
+{
+  double startX_um;   // first trigger position
+  double startY_um;
+  double endX_um;     // no trigger lies beyond this
+  double endY_um;
+  double interval_um; // distance between trigger positions
+};
+
+// Appends the trigger positions along the line as tiles of row 0, one per
+// frame.  Returns false if the line has no length or the interval is not
+// positive.
+bool BuildSweepTriggers(const TinyGSweepLine& line, std::vector<TinyGScanTile>& triggers);
+
+#endif // _SHAPEOKO_TINYG_SCANPATH_H_
@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Scheduler.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Command scheduler for the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ShapeokoTinyG.h"
+#include "Scheduler.h"
+
+ShapeokoTinyGScheduler::ShapeokoTinyGScheduler(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    running_(false),
+    stop_(false)
+{
+  for (int i = 0; i < kLanes; ++i)
+    head_[i] = tail_[i] = 0;
+}
+
+ShapeokoTinyGScheduler::~ShapeokoTinyGScheduler()
+{
+  Stop();
+}
+
+int ShapeokoTinyGScheduler::Start()
+{
+  if (running_)
+    return DEVICE_OK;
+  stop_ = false;
+  running_ = true;
+  if (activate() != 0)
+  {
+    running_ = false;
+    return DEVICE_ERR;
+  }
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGScheduler::Stop()
+{
+  if (!running_)
+    return;
+  {
+    ShapeokoTinyGMonitor::Guard guard(queueLock_);
+    stop_ = true;
+    queueLock_.NotifyAll();
+  }
+  wait();
+  running_ = false;
+  while (TinyGRequest* request = Pop(0, kLanes - 1))
+    Complete(*request, ERR_COMMUNICATION);
+}
+
+int ShapeokoTinyGScheduler::Submit(TinyGRequest& request)
+{
+  request.start = hub_->GetCurrentMMTimeH();
+  request.done = false;
+  request.next = 0;
+  int lane = request.lane;
+  {
+    ShapeokoTinyGMonitor::Guard guard(queueLock_);
+    if (!running_ || stop_)
+      return ERR_COMMUNICATION;
+    if (tail_[lane] != 0)
+      tail_[lane]->next = &request;
+    else
+      head_[lane] = &request;
+    tail_[lane] = &request;
+    queueLock_.NotifyAll();
+  }
+  // the scheduler thread may be blocked on an answer; it writes urgent
+  // requests in between
+  if (lane == kLaneUrgent)
+    hub_->InterruptAnswerWait();
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGScheduler::Wait(TinyGRequest& request)
+{
+  ShapeokoTinyGMonitor::Guard guard(queueLock_);
+  while (!request.done)
+    queueLock_.Wait();
+  return request.result;
+}
+
+TinyGRequest* ShapeokoTinyGScheduler::Pop(int firstLane, int lastLane)
+{
+  ShapeokoTinyGMonitor::Guard guard(queueLock_);
+  return PopLocked(firstLane, lastLane);
+}
+
+// First request of the highest priority non-empty lane in the range
+TinyGRequest* ShapeokoTinyGScheduler::PopLocked(int firstLane, int lastLane)
+{
+  for (int lane = firstLane; lane <= lastLane; ++lane)
+  {
+    TinyGRequest* request = head_[lane];
+    if (request == 0)
+      continue;
+    head_[lane] = request->next;
+    if (head_[lane] == 0)
+      tail_[lane] = 0;
+    request->next = 0;
+    return request;
+  }
+  return 0;
+}
+
+void ShapeokoTinyGScheduler::Complete(TinyGRequest& request, int result)
+{
+  ShapeokoTinyGMonitor::Guard guard(queueLock_);
+  request.result = result;
+  // the waiter may return and destroy the request once the lock is released
+  request.done = true;
+  queueLock_.NotifyAll();
+}
+
+void ShapeokoTinyGScheduler::ServiceUrgent()
+{
+  while (TinyGRequest* request = Pop(kLaneUrgent, kLaneUrgent))
+    Complete(*request, hub_->ExecuteRequest(*request));
+}
+
+int ShapeokoTinyGScheduler::svc()
+{
+  for (;;)
+  {
+    TinyGRequest* request = 0;
+    {
+      ShapeokoTinyGMonitor::Guard guard(queueLock_);
+      while (!stop_ && (request = PopLocked(kLaneUrgent, kLanes - 1)) == 0)
+        queueLock_.Wait();
+      if (stop_)
+        break;
+    }
+    Complete(*request, hub_->ExecuteRequest(*request));
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Scheduler.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Command scheduler for the ShapeokoTinyG hub.  One thread
+//                owns the write side of the port and runs every exchange
+//                with the controller in turn, so commands from the stages,
+//                the background threads and the "Command" property can
+//                never interleave or take each other's answers.
+//
+//                Requests wait in four lanes, served strictly in order:
+//                urgent single-character commands (feedhold, flush, cycle
+//                start), status queries, motion, then configuration and
+//                console commands.  Urgent requests are also written while
+//                the thread waits for another command's answer, so a stop
+//                is never held up by the exchange in progress.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_SCHEDULER_H_
+#define _SHAPEOKO_TINYG_SCHEDULER_H_
+
+#include "MMDevice.h"
+#include "DeviceThreads.h"
+#include "SerialReader.h"
+#include "TinyGJson.h"
+#include "Latency.h"
+#include "Monitor.h"
+
+class ShapeokoTinyGHub;
+
+// in order of priority
+enum TinyGLane
+{
+  kLaneUrgent,
+  kLaneStatus,
+  kLaneMotion,
+  kLaneConfig,
+  kLanes
+};
+
+enum TinyGRequestKind
+{
+  kRequestCommand,      // a line; waits for its response
+  kRequestNoResponse,   // a line whose response is left to the reader
+  kRequestRealtime      // characters written as they are, e.g. "!"
+};
+
+// One exchange with the controller, and its completion handle.  The caller
+// owns it, typically on its stack, and must keep it and the command text
+// alive until it is done, so scheduling allocates nothing.
+struct TinyGRequest
+{
+  TinyGRequest(TinyGLane lane, TinyGRequestKind kind, const char* command,
+      TinyGLatencyPath path = kLatencySendCommand, long timeoutMs = 300) :
+      lane(lane), kind(kind), command(command), path(path), timeoutMs(timeoutMs),
+      recordLatency(true), result(DEVICE_OK), done(false), next(0)
+  {
+    answer.text[0] = '\0';
+    answer.len = 0;
+  }
+
+  TinyGLane lane;
+  TinyGRequestKind kind;
+  const char* command;      // without terminator
+  TinyGLatencyPath path;
+  long timeoutMs;           // for the response
+  bool recordLatency;       // false if the caller records the path itself
+
+  // set by the scheduler
+  MM::MMTime start;         // submitted
+  MM::MMTime written;
+  TinyGLine answer;         // the response line, with its parsed fields
+  TinyGReport report;
+  int result;               // result and done under the scheduler's lock
+  bool done;
+
+  TinyGRequest* next;       // lane queue link
+};
+
+class ShapeokoTinyGScheduler : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGScheduler(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGScheduler();
+
+  int Start();
+  // Fails every request still queued
+  void Stop();
+  bool IsRunning() const { return running_; }
+
+  // Queues the request and returns at once
+  int Submit(TinyGRequest& request);
+  // Blocks until the request is done and returns its result.  Must not be
+  // called on the scheduler thread.
+  int Wait(TinyGRequest& request);
+
+  // Scheduler thread only: writes the urgent requests queued so far.  The
+  // hub calls it while it waits for a response.
+  void ServiceUrgent();
+
+  int svc();
+
+ private:
+  TinyGRequest* Pop(int firstLane, int lastLane);
+  TinyGRequest* PopLocked(int firstLane, int lastLane);
+  void Complete(TinyGRequest& request, int result);
+
+  ShapeokoTinyGHub* hub_;
+  volatile bool running_;
+  volatile bool stop_;
+
+  // guards the lanes and the requests' results; the scheduler thread sleeps
+  // on it for work, Wait() for the request's completion
+  ShapeokoTinyGMonitor queueLock_;
+  TinyGRequest* head_[kLanes];
+  TinyGRequest* tail_[kLanes];
+};
+
+#endif // _SHAPEOKO_TINYG_SCHEDULER_H_
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SerialReader.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background reader for the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ShapeokoTinyG.h"
+#include "SerialReader.h"
+#include <cstring>
+
+ShapeokoTinyGReader::ShapeokoTinyGReader(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    running_(false),
+    stop_(false),
+    failed_(false),
+    partialLen_(0),
+    interrupted_(false),
+    lineSeq_(0)
+{
+  memset(lineLens_, 0, sizeof(lineLens_));
+}
+
+ShapeokoTinyGReader::~ShapeokoTinyGReader()
+{
+  Stop();
+}
+
+int ShapeokoTinyGReader::Start()
+{
+  if (running_)
+    return DEVICE_OK;
+  stop_ = false;
+  failed_ = false;
+  partialLen_ = 0;
+  running_ = true;
+  if (activate() != 0)
+  {
+    running_ = false;
+    return DEVICE_ERR;
+  }
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGReader::Stop()
+{
+  if (!running_)
+    return;
+  stop_ = true;
+  wait();
+  ShapeokoTinyGMonitor::Guard guard(ringLock_);
+  running_ = false;
+  ringLock_.NotifyAll();
+}
+
+int ShapeokoTinyGReader::svc()
+{
+  unsigned char buf[kReadChunk];
+  while (!stop_)
+  {
+    unsigned long bytesRead = 0;
+    // the transport wakes on the first byte if it can, or sleeps briefly
+    int ret = hub_->ReadFromComPortH(buf, kReadChunk, bytesRead, kReadWaitMs);
+    if (ret != DEVICE_OK)
+    {
+      // nothing more will come; let the waiters fail now, not at their timeouts
+      if (hub_->IsTransportLost())
+      {
+        ShapeokoTinyGMonitor::Guard guard(ringLock_);
+        failed_ = true;
+        ringLock_.NotifyAll();
+        break;
+      }
+      CDeviceUtils::SleepMs(1);
+      continue;
+    }
+    if (bytesRead == 0)
+      continue;
+    Consume(buf, bytesRead);
+  }
+  return 0;
+}
+
+void ShapeokoTinyGReader::Consume(const unsigned char* data, unsigned long len)
+{
+  for (unsigned long i = 0; i < len; ++i)
+  {
+    char c = (char) data[i];
+    if (c == '\r' || c == '\n')
+    {
+      // TinyG ends lines with CR, LF or both; empty lines carry nothing
+      if (partialLen_ > 0)
+      {
+        partial_[partialLen_] = '\0';
+        if (!hub_->DispatchLine(partial_, partialLen_))
+          PublishLine(partial_, partialLen_);
+        partialLen_ = 0;
+      }
+    }
+    else if (partialLen_ < kMaxLine - 1)
+    {
+      partial_[partialLen_++] = c;
+    }
+  }
+}
+
+void ShapeokoTinyGReader::PublishLine(const char* line, unsigned len)
+{
+  ShapeokoTinyGMonitor::Guard guard(ringLock_);
+  unsigned slot = (unsigned) ((lineSeq_ + 1) % kLineSlots);
+  memcpy(lines_[slot], line, len + 1);
+  lineLens_[slot] = len;
+  ++lineSeq_;
+  ringLock_.NotifyAll();
+}
+
+unsigned long ShapeokoTinyGReader::LastLineSeq()
+{
+  ShapeokoTinyGMonitor::Guard guard(ringLock_);
+  return lineSeq_;
+}
+
+void ShapeokoTinyGReader::Interrupt()
+{
+  ShapeokoTinyGMonitor::Guard guard(ringLock_);
+  interrupted_ = true;
+  ringLock_.NotifyAll();
+}
+
+int ShapeokoTinyGReader::WaitForLine(unsigned long& seq, TinyGLine& line, long timeoutMs)
+{
+  MM::MMTime deadline = hub_->GetCurrentMMTimeH() + MM::MMTime(timeoutMs * 1000.0);
+  ShapeokoTinyGMonitor::Guard guard(ringLock_);
+  while (true)
+  {
+    if (lineSeq_ > seq)
+    {
+      // a waiter that fell more than a ring behind resumes at the oldest line
+      unsigned long next = seq + 1;
+      if (lineSeq_ - next >= kLineSlots)
+        next = lineSeq_ - kLineSlots + 1;
+      unsigned slot = (unsigned) (next % kLineSlots);
+      memcpy(line.text, lines_[slot], lineLens_[slot] + 1);
+      line.len = lineLens_[slot];
+      seq = next;
+      return DEVICE_OK;
+    }
+    if (failed_)
+      return ERR_COMMUNICATION;
+    if (interrupted_)
+    {
+      interrupted_ = false;
+      return ERR_ANSWER_TIMEOUT;
+    }
+    MM::MMTime now = hub_->GetCurrentMMTimeH();
+    if (!running_ || !(now < deadline))
+      return ERR_ANSWER_TIMEOUT;
+    // rounded up, so the wait does not end just short of the deadline
+    ringLock_.Wait((long) (deadline - now).getMsec() + 1);
+  }
+}
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SerialReader.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background reader for the ShapeokoTinyG hub.  Drains the
+//                serial port continuously, frames the byte stream into lines
+//                and hands every line to the hub or to the caller waiting
+//                for a command response.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_SERIALREADER_H_
+#define _SHAPEOKO_TINYG_SERIALREADER_H_
+
+#include "DeviceThreads.h"
+#include "Monitor.h"
+
+class ShapeokoTinyGHub;
+
+// A response line as copied out of the reader, so that waiting for one
+// needs no heap allocation
+struct TinyGLine
+{
+  enum { kMaxLen = 512 };   // longest line kept; the rest is truncated
+  char text[kMaxLen];
+  unsigned len;
+};
+
+class ShapeokoTinyGReader : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGReader(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGReader();
+
+  int Start();
+  void Stop();
+  bool IsRunning() const { return running_; }
+  // True if the thread ended because the connection was lost
+  bool IsFailed() const { return failed_; }
+
+  // Sequence number of the newest response line.  Note it before writing a
+  // command, then pass it to WaitForLine to get the lines that follow.
+  unsigned long LastLineSeq();
+
+  // Copies the first response line newer than seq into line and advances
+  // seq to it.  Blocks until one is published; returns ERR_ANSWER_TIMEOUT
+  // if nothing arrives in time or Interrupt() is called, and
+  // ERR_COMMUNICATION at once if the connection is lost.
+  int WaitForLine(unsigned long& seq, TinyGLine& line, long timeoutMs);
+  // Ends the current or the next WaitForLine early, for the scheduler
+  // thread to write an urgent request
+  void Interrupt();
+
+  int svc();
+
+ private:
+  enum {
+    kReadChunk = 256,    // bytes per ReadFromComPort call
+    kReadWaitMs = 10,    // longest a read waits for input; bounds Stop()
+    kMaxLine = TinyGLine::kMaxLen,
+    kLineSlots = 64      // response lines retained for late waiters
+  };
+
+  void Consume(const unsigned char* data, unsigned long len);
+  void PublishLine(const char* line, unsigned len);
+
+  ShapeokoTinyGHub* hub_;
+  volatile bool running_;
+  volatile bool stop_;
+  volatile bool failed_;
+
+  // line currently being assembled from the byte stream
+  char partial_[kMaxLine];
+  unsigned partialLen_;
+
+  // ring of completed response lines, indexed by sequence number; also
+  // signalled when a line is published or the reader fails
+  ShapeokoTinyGMonitor ringLock_;
+  bool interrupted_;
+  char lines_[kLineSlots][kMaxLine];
+  unsigned lineLens_[kLineSlots];
+  unsigned long lineSeq_;
+};
+
+#endif // _SHAPEOKO_TINYG_SERIALREADER_H_
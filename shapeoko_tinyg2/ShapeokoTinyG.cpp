@@ -25,7 +25,20 @@
 #include "ShapeokoTinyG.h"
 #include "XYStage.h"
 #include "ZStage.h"
+#include "SerialReader.h"
+#include "TinyGJson.h"
+#include "Streamer.h"
+#include "Coalescer.h"
+#include "Jog.h"
+#include "Homing.h"
+#include "Program.h"
+#include "Transport.h"
+#include "StatusPoller.h"
+#include "TinyGFormat.h"
+#include "LineNumbers.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <math.h>
 #include "ModuleInterface.h"
@@ -42,6 +55,28 @@ const char* g_XYStageDeviceName = "DXYStage";
 const char* g_ZStageDeviceName = "DZStage";
 const char* g_HubDeviceName = "DHub";
 const char* g_versionProp = "Version";
+const char* g_TraceLevelProp = "Trace Level";
+const char* g_TraceLevelNames[] = {"Off", "Error", "Info", "Debug", "Verbose"};
+const char* g_TransportProp = "Transport";
+const char* g_TransportMM = "Micro-Manager Port";
+const char* g_TransportDirect = "Direct Serial";
+const char* g_TransportTcp = "TCP";
+const char* g_TransportAddressProp = "Transport Address";
+const char* g_TransportBaudProp = "Direct Serial Baud";
+const char* g_PositionClockProp = "Position Clock (ms)";
+const char* g_PositionQueryTimeProp = "Position Query Time (ms)";
+const char* g_PositionAtQueryTimeProp = "Position At Query Time";
+const char* g_ProgramFileProp = "Program File";
+const char* g_ProgramProp = "Program";
+const char* g_ProgramStatusProp = "Program Status";
+const char* g_ProgramProgressProp = "Program Progress (%)";
+const char* g_ProgramLinesProp = "Program Lines Sent";
+const char* g_HomeProp = "Home";
+const char* g_HomingStatusProp = "Homing Status";
+// axes the "Home" property offers, as named by AxisNames
+const unsigned g_HomeAxes[] = {TINYG_AXIS_X | TINYG_AXIS_Y, TINYG_AXIS_X | TINYG_AXIS_Y | TINYG_AXIS_Z, TINYG_AXIS_Z};
+// longest a homing cycle may take before it is given up
+const long g_HomingTimeoutMs = 120000;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
@@ -83,38 +118,91 @@ MODULE_API void DeleteDevice(MM::Device* pDevice)
   delete pDevice;
 }
 
-std::vector<std::string> &split(const std::string &s, char delim, std::vector<std::string> &elems) {
-  std::stringstream ss(s);
-  std::string item;
-  while (std::getline(ss, item, delim)) {
-    elems.push_back(item);
-  }
-  return elems;
-}
-
-
-std::vector<std::string> split(const std::string &s, char delim) {
-  std::vector<std::string> elems;
-  split(s, delim, elems);
-  return elems;
-}
-
-
-
 ShapeokoTinyGHub::ShapeokoTinyGHub():
     initialized_(false),
-    busy_(false)
+    busy_(false),
+    portAvailable_(false),
+    transport_(0),
+    transportType_(g_TransportMM),
+    transportBaud_(115200),
+    reader_(0),
+    scheduler_(0),
+    streamer_(0),
+    coalescer_(0),
+    jogger_(0),
+    homer_(0),
+    program_(0),
+    lastTargetAxes_(0),
+    coalescingWindowMs_(0),
+    lateResponses_(0),
+    lateResponseSeq_(0),
+    reportEvents_(0),
+    machineState_(0),
+    statusSeq_(0),
+    linesWritten_(0),
+    linesAnswered_(0),
+    unansweredBytes_(0),
+    unansweredError_(DEVICE_OK),
+    queueFree_(0),
+    lineNumber_(0),
+    streamLineEnd_(1),
+    lineListener_(0),
+    poller_(0),
+    motionPending_(false),
+    motionAccepted_(false),
+    motionTargetAxes_(0),
+    positionQueryMs_(0.0),
+    statusIntervalMs_(250),
+    benchmarkIterations_(1000)
 {
-  LogMessage("TinyG Constructor");
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG Constructor");
+  SetErrorText(ERR_ANSWER_TIMEOUT, "Timed out waiting for an answer from the TinyG controller");
+  SetErrorText(ERR_CONTROLLER_STATUS, "The TinyG controller reported an error for the command");
+  SetErrorText(ERR_HOMING_ABORTED, "The homing cycle was stopped before it completed");
+  SetErrorText(ERR_POSITION_UNKNOWN_AT_TIME, "No position has been recorded for that time");
+  SetErrorText(ERR_PROGRAM_FILE, "Could not open the G-code program file");
+  SetErrorText(ERR_PROGRAM_LINE, "The G-code program has a line that is too long or holds a '!', '~' or '%'");
+  SetErrorText(ERR_PROGRAM_ABORTED, "The G-code program was aborted");
   CPropertyAction* pAct  = new CPropertyAction(this, &ShapeokoTinyGHub::OnPort);
   CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
+
+  // the port above, or a serial device or TCP server opened directly
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnTransport);
+  CreateProperty(g_TransportProp, g_TransportMM, MM::String, false, pAct, true);
+  AddAllowedValue(g_TransportProp, g_TransportMM);
+#ifndef WIN32
+  AddAllowedValue(g_TransportProp, g_TransportDirect);
+#endif
+  AddAllowedValue(g_TransportProp, g_TransportTcp);
+  // e.g. /dev/ttyUSB0 for direct serial, host:port for TCP
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnTransportAddress);
+  CreateProperty(g_TransportAddressProp, "", MM::String, false, pAct, true);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnTransportBaud);
+  CreateProperty(g_TransportBaudProp, "115200", MM::Integer, false, pAct, true);
+  AddAllowedValue(g_TransportBaudProp, "9600");
+  AddAllowedValue(g_TransportBaudProp, "19200");
+  AddAllowedValue(g_TransportBaudProp, "38400");
+  AddAllowedValue(g_TransportBaudProp, "57600");
+  AddAllowedValue(g_TransportBaudProp, "115200");
+  AddAllowedValue(g_TransportBaudProp, "230400");
+
+  // pre-initialization, so that Initialize itself can be traced
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnTraceLevel);
+  CreateProperty(g_TraceLevelProp, g_TraceLevelNames[g_TinyGTraceLevel], MM::String, false, pAct, true);
+  for (int i = TINYG_TRACE_OFF; i <= TINYG_TRACE_MAX_LEVEL; ++i)
+    AddAllowedValue(g_TraceLevelProp, g_TraceLevelNames[i]);
+
+  status_.valid = false;
+  status_.pos[0] = status_.pos[1] = status_.pos[2] = 0.0;
+  status_.vel = 0.0;
+  status_.stat = 0;
 }
 
 ShapeokoTinyGHub::~ShapeokoTinyGHub() { Shutdown();}
 
 int ShapeokoTinyGHub::Initialize()
 {
-  LogMessage("TinyG Initialize");
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG Initialize");
   /* From EVA's XYStage */
   int ret = DEVICE_ERR;
 
@@ -165,14 +253,24 @@ int ShapeokoTinyGHub::Initialize()
   if (DEVICE_OK != ret)
      return ret;
 
+  ret = OpenTransport();
+  if (ret != DEVICE_OK)
+    return ret;
+
   // // turn off verbose serial debug messages
-  GetCoreCallback()->SetDeviceProperty(port_.c_str(), "Verbose", "1");
+  if (transportType_ == g_TransportMM)
+    GetCoreCallback()->SetDeviceProperty(port_.c_str(), "Verbose", "1");
   // synchronize all properties
   // --------------------------
 
   PurgeComPortH();
-  std::string expected; 
+  // from here on the reader thread owns the receive side of the port, and
+  // the scheduler thread the write side
+  ret = StartReader();
+  if (ret != DEVICE_OK)
+    return ret;
   /*
+  std::string expected;
   LogMessage(std::string("Sending reset!"));
   SetAnswerTimeoutMs(10000.0);
   const char* controlx = "";
@@ -194,52 +292,136 @@ int ShapeokoTinyGHub::Initialize()
 
   PurgeComPortH();
   */
+  // Switch to JSON mode.  Every command then gets a {"r":...,"f":[...]}
+  // answer whose footer carries the command's status code, and status and
+  // queue reports arrive as {"sr":...} and {"qr":...} lines.
   std::string answer;
-  ret = SendConfigCommand("$ee=0", answer);
-  if (ret != DEVICE_OK)
+  ret = SendConfigCommand("{\"ej\":1}", answer);
+  if (ret != DEVICE_OK) {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "Got unexpected response to enable JSON mode.");
     return ret;
-  expected = "[ee]";
-  if (answer.find(expected) == std::string::npos) {
-    LogMessage("Got unexpected response to disable echo.");
-    return DEVICE_ERR;
   }
 
-  PurgeComPortH();
+  ret = SendConfigCommand("{\"ee\":0}", answer);
+  if (ret != DEVICE_OK) {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "Got unexpected response to disable echo.");
+    return ret;
+  }
 
-  ret = SendConfigCommand("$tv=0", answer);
-  if (ret != DEVICE_OK)
+  // footers on every response, including plain G-code lines
+  ret = SendConfigCommand("{\"jv\":3}", answer);
+  if (ret != DEVICE_OK) {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "Got unexpected response to set JSON verbosity.");
     return ret;
-  expected = "[tv]";
-  if (answer.find(expected) == std::string::npos) {
-    LogMessage("Got unexpected response to disable verbosity.");
-    return DEVICE_ERR;
   }
 
+  // queue reports drive the flow control of streamed moves
+  ret = SendConfigCommand("{\"qv\":1}", answer);
+  if (ret != DEVICE_OK) {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "Got unexpected response to enable queue reports.");
+    return ret;
+  }
+
+  ret = ConfigureStatusReports();
+  if (ret != DEVICE_OK) {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "Got unexpected response to configure status reports.");
+    return ret;
+  }
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnStatusInterval);
+  CreateProperty("Status Report Interval (ms)", CDeviceUtils::ConvertToString(statusIntervalMs_), MM::Integer, false, pAct);
+  SetPropertyLimits("Status Report Interval (ms)", 0, 5000);
+
+  // XY and Z targets arriving this close together move as one; 0 is off
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnCoalescingWindow);
+  CreateProperty("Coalescing Window (ms)", CDeviceUtils::ConvertToString(coalescingWindowMs_), MM::Integer, false, pAct);
+  SetPropertyLimits("Coalescing Window (ms)", 0, 200);
+
+  // command latency statistics, and a benchmark that fills them
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnLatencyReport);
+  CreateProperty("Latency Report", "", MM::String, true, pAct);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnBenchmarkIterations);
+  CreateProperty("Benchmark Iterations", CDeviceUtils::ConvertToString(benchmarkIterations_), MM::Integer, false, pAct);
+  SetPropertyLimits("Benchmark Iterations", 1, 100000);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnBenchmark);
+  CreateProperty("Benchmark", "Idle", MM::String, false, pAct);
+  AddAllowedValue("Benchmark", "Idle");
+  AddAllowedValue("Benchmark", "Run");
+
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnTraceRing);
+  CreateProperty("Trace Ring", "Off", MM::String, false, pAct);
+  AddAllowedValue("Trace Ring", "Off");
+  AddAllowedValue("Trace Ring", "On");
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnTraceDump);
+  CreateProperty("Trace Dump", "Idle", MM::String, false, pAct);
+  AddAllowedValue("Trace Dump", "Idle");
+  AddAllowedValue("Trace Dump", "Dump");
+
+  // position history for scripts: read the clock when a frame is taken,
+  // then set the query time to it and read the position back as "X Y Z" mm
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnPositionClock);
+  CreateProperty(g_PositionClockProp, "0", MM::Float, true, pAct);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnPositionQueryTime);
+  CreateProperty(g_PositionQueryTimeProp, "0", MM::Float, false, pAct);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnPositionAtQueryTime);
+  CreateProperty(g_PositionAtQueryTimeProp, "Unknown", MM::String, true, pAct);
+
+  // G-code programs from disk; "Program" reads back "Idle" once it ends
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnProgramFile);
+  CreateProperty(g_ProgramFileProp, "", MM::String, false, pAct);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnProgram);
+  CreateProperty(g_ProgramProp, "Idle", MM::String, false, pAct);
+  AddAllowedValue(g_ProgramProp, "Idle");
+  AddAllowedValue(g_ProgramProp, "Run");
+  AddAllowedValue(g_ProgramProp, "Pause");
+  AddAllowedValue(g_ProgramProp, "Resume");
+  AddAllowedValue(g_ProgramProp, "Abort");
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnProgramStatus);
+  CreateProperty(g_ProgramStatusProp, "Idle", MM::String, true, pAct);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnProgramProgress);
+  CreateProperty(g_ProgramProgressProp, "0", MM::Float, true, pAct);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnProgramLines);
+  CreateProperty(g_ProgramLinesProp, "0", MM::Integer, true, pAct);
+
+  // homing runs in the background; setting axes starts it, and the
+  // property reads back "Idle" once it has ended
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnHome);
+  CreateProperty(g_HomeProp, "Idle", MM::String, false, pAct);
+  AddAllowedValue(g_HomeProp, "Idle");
+  for (size_t i = 0; i < sizeof(g_HomeAxes) / sizeof(g_HomeAxes[0]); ++i)
+    AddAllowedValue(g_HomeProp, AxisNames(g_HomeAxes[i]).c_str());
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnHomingStatus);
+  CreateProperty(g_HomingStatusProp, "Not homed", MM::String, true, pAct);
 
-  PurgeComPortH();
   ret = GetControllerVersion(version_);
   if( DEVICE_OK != ret)
     return ret;
   pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnVersion);
-  std::ostringstream sversion;
-  sversion << version_;
-  CreateProperty(g_versionProp, sversion.str().c_str(), MM::String, true, pAct);
-
-  PurgeComPortH();
+  CreateProperty(g_versionProp, version_.c_str(), MM::String, true, pAct);
 
   string command = "G90";
-  LogMessage("Writing relative mode to com port");
-  LogMessage(command);
-  ret = SendCommandNoResponse(command);
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "Writing absolute mode to com port");
+  TINYG_TRACE(TINYG_TRACE_DEBUG, command);
+  ret = SendCommand(command.c_str(), answer);
   if (ret != DEVICE_OK)
     return ret;
 
-  PurgeComPortH();
-
   ret = GetStatus();
   if (ret != DEVICE_OK)
     return ret;
 
+  // live position for the stages' position-changed notifications
+  if (poller_ == 0)
+    poller_ = new ShapeokoTinyGPoller(this);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnPositionUpdateInterval);
+  CreateProperty("Position Update Interval (ms)", CDeviceUtils::ConvertToString(poller_->GetUpdateIntervalMs()), MM::Integer, false, pAct);
+  SetPropertyLimits("Position Update Interval (ms)", 0, 5000);
+  pAct = new CPropertyAction(this, &ShapeokoTinyGHub::OnIdlePollInterval);
+  CreateProperty("Idle Poll Interval (ms)", CDeviceUtils::ConvertToString(poller_->GetIdlePollMs()), MM::Integer, false, pAct);
+  SetPropertyLimits("Idle Poll Interval (ms)", 0, 60000);
+  ret = poller_->Start();
+  if (ret != DEVICE_OK)
+    return ret;
+
   ret = UpdateStatus();
   if (ret != DEVICE_OK)
     return ret;
@@ -248,35 +430,95 @@ int ShapeokoTinyGHub::Initialize()
   return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::Shutdown() {initialized_ = false; return DEVICE_OK;};
-bool ShapeokoTinyGHub::Busy() {   LogMessage("TinyG busy");
-return busy_;} ;
+int ShapeokoTinyGHub::Shutdown()
+{
+  if (poller_ != 0)
+  {
+    poller_->Stop();
+    delete poller_;
+    poller_ = 0;
+  }
+  if (program_ != 0)
+  {
+    // nor a program
+    if (program_->IsActive())
+      AbortProgram();
+    delete program_;
+    program_ = 0;
+  }
+  if (homer_ != 0)
+  {
+    // leave no cycle running on a controller nobody watches
+    if (homer_->IsActive())
+      StopMotion();
+    delete homer_;
+    homer_ = 0;
+  }
+  if (jogger_ != 0)
+  {
+    StopJog();
+    delete jogger_;
+    jogger_ = 0;
+  }
+  if (coalescer_ != 0)
+  {
+    coalescer_->Stop();
+    delete coalescer_;
+    coalescer_ = 0;
+  }
+  if (streamer_ != 0)
+  {
+    streamer_->Stop();
+    delete streamer_;
+    streamer_ = 0;
+  }
+  // fails whatever is still queued, so stop it before the reader it waits on
+  if (scheduler_ != 0)
+  {
+    scheduler_->Stop();
+    delete scheduler_;
+    scheduler_ = 0;
+  }
+  StopReader();
+  CloseTransport();
+  initialized_ = false;
+  return DEVICE_OK;
+}
+
+bool ShapeokoTinyGHub::Busy()
+{
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG busy");
+  return busy_;
+}
 
 // private and expects caller to:
 // 1. guard the port
 // 2. purge the port
 int ShapeokoTinyGHub::GetControllerVersion(string& version)
 {
-  LogMessage("TinyG GetControllerVersion");
-  int ret = DEVICE_OK;
-  const char* command = "$fv";
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG GetControllerVersion");
   version = "";
 
-  LogMessage("Writing to com port");
-  LogMessage(command);
   std::string answer;
-  ret = SendCommand(command, answer);
+  int ret = SendCommand("{\"fv\":null}", answer);
   if (ret != DEVICE_OK)
     return ret;
-  LogMessage("Got answer:");
-  LogMessage(answer.c_str());
-  version = answer;
-  return ret;
-
+  TinyGReport report;
+  ParseTinyGJson(answer.c_str(), (unsigned) answer.size(), report);
+  if (!report.Has(TinyGReport::kVersion))
+  {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "No firmware version in answer: " + answer);
+    return ERR_COMMUNICATION;
+  }
+  char buff[32];
+  sprintf(buff, "%.3f", report.firmwareVersion);
+  version = buff;
+  return DEVICE_OK;
 }
+
 int ShapeokoTinyGHub::DetectInstalledDevices()
 {
-  LogMessage("TinyG DetectInstalledDevices");
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG DetectInstalledDevices");
   ClearInstalledDevices();
 
   // make sure this method is called before we look for available devices
@@ -287,12 +529,12 @@ int ShapeokoTinyGHub::DetectInstalledDevices()
   for (unsigned i=0; i<GetNumberOfDevices(); i++)
   {
     char deviceName[MM::MaxStrLength];
-    LogMessage("Get device");
+    TINYG_TRACE(TINYG_TRACE_DEBUG, "Get device");
     bool success = GetDeviceName(i, deviceName, MM::MaxStrLength);
     if (success && (strcmp(hubName, deviceName) != 0))
     {
-      LogMessage("Got device");
-      LogMessage(deviceName);
+      TINYG_TRACE(TINYG_TRACE_DEBUG, "Got device");
+      TINYG_TRACE(TINYG_TRACE_DEBUG, deviceName);
       MM::Device* pDev = CreateDevice(deviceName);
       AddInstalledDevice(pDev);
     }
@@ -307,7 +549,7 @@ void ShapeokoTinyGHub::GetName(char* pName) const
 
 int ShapeokoTinyGHub::OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG OnVersion");
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG OnVersion");
   if (pAct == MM::BeforeGet)
   {
     pProp->Set(version_.c_str());
@@ -316,7 +558,7 @@ int ShapeokoTinyGHub::OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct)
 }
 int ShapeokoTinyGHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG OnPort");
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG OnPort");
   if (pAct == MM::BeforeGet)
   {
     pProp->Set(port_.c_str());
@@ -329,394 +571,1803 @@ int ShapeokoTinyGHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
   return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::OnCommand(MM::PropertyBase* pProp, MM::ActionType pAct)
+int ShapeokoTinyGHub::OnTransport(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG OnCommand");
   if (pAct == MM::BeforeGet)
   {
-    pProp->Set(commandResult_.c_str());
+    pProp->Set(transportType_.c_str());
   }
   else if (pAct == MM::AfterSet)
   {
-    std::string cmd;
-    pProp->Get(cmd);
-    if(cmd.compare(commandResult_) ==0)  // command result still there
-      return DEVICE_OK;
-    int ret = SendCommand(cmd,commandResult_);
-    if(DEVICE_OK != ret){
-      commandResult_.assign("Error!");
-      return DEVICE_ERR;
-    }
+    pProp->Get(transportType_);
   }
   return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::SendCommand(std::string command, std::string &returnString)
+int ShapeokoTinyGHub::OnTransportAddress(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG SendCommand");
-  LogMessage("command=" + command);
-  if(!portAvailable_)
-    return ERR_NO_PORT_SET;
-  // needs a lock because the other Thread will also use this function
-  MMThreadGuard(this->executeLock_);
-  PurgeComPortH();
-  int ret = DEVICE_OK;
-  SetAnswerTimeoutMs(300.0); //for normal command
-
-  LogMessage("Write command.");
-  ret = SetCommandComPortH(command.c_str(),"\r");
-  LogMessage("set command, ret=" + ret);
-  if (ret != DEVICE_OK)
-  {
-    LogMessage("command write fail");
-    return ret;
-  }
-  std::string an;
-  try
+  if (pAct == MM::BeforeGet)
   {
-
-    ret = GetSerialAnswerComPortH(an,"\r");
-    if (ret != DEVICE_OK)
-    {
-      LogMessage(std::string("answer get error!_"));
-      return ret;
-    }
-    LogMessage("answer:");
-    LogMessage(an);
-    returnString = an;
+    pProp->Set(transportAddress_.c_str());
   }
-  catch(...)
+  else if (pAct == MM::AfterSet)
   {
-    LogMessage("Exception in send command!");
-    return DEVICE_ERR;
+    pProp->Get(transportAddress_);
   }
   return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::SendMotionCommand(std::string command)
+int ShapeokoTinyGHub::OnTransportBaud(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG SendMotionCommand");
-  LogMessage("command=" + command);
-  if(!portAvailable_)
-    return ERR_NO_PORT_SET;
-  // needs a lock because the other Thread will also use this function
-  MMThreadGuard(this->executeLock_);
-  PurgeComPortH();
-  int ret = DEVICE_OK;
-  SetAnswerTimeoutMs(300.0); //for normal command
-
-  LogMessage("Write command.");
-  ret = SetCommandComPortH(command.c_str(),"\r");
-  LogMessage("set command, ret=" + ret);
-  if (ret != DEVICE_OK)
+  if (pAct == MM::BeforeGet)
   {
-    LogMessage("command write fail");
-    return ret;
+    pProp->Set(transportBaud_);
   }
-  bool done = false;
-  while(!done) {
-    std::string an;
-    try
-    {
-      ret = GetSerialAnswerComPortH(an,"\r");
-      if (ret != DEVICE_OK)
-      {
-        LogMessage(std::string("answer get error!_"));
-        return ret;
-      }
-      LogMessage("answer:");
-      LogMessage(an);
-      std::vector<std::string> result = split(an, ',');
-      for(std::vector<std::string>::iterator item = result.begin(); item != result.end(); ++item) {
-        std::vector<std::string> p = split(*item, ':');
-        if (p[0] == "stat" && p[1] == "3\n") {
-          LogMessage("Move done.");
-          done = true;
-          break;
-        }
-      }
-    }
-    catch(...)
-    {
-      LogMessage("Exception in send command!");
-      return DEVICE_ERR;
-    }
+  else if (pAct == MM::AfterSet)
+  {
+    pProp->Get(transportBaud_);
   }
   return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::SendCommandNoResponse(std::string command)
+int ShapeokoTinyGHub::OpenTransport()
 {
-  LogMessage("TinyG SendCommand");
-  LogMessage("command=" + command);
-  if(!portAvailable_)
-    return ERR_NO_PORT_SET;
-  // needs a lock because the other Thread will also use this function
-  MMThreadGuard(this->executeLock_);
-  PurgeComPortH();
-  int ret = DEVICE_OK;
-  SetAnswerTimeoutMs(300.0); //for normal command
-
-  LogMessage("Write command.");
-  ret = SetCommandComPortH(command.c_str(),"\r");
-  LogMessage("set command, ret=" + ret);
+  CloseTransport();
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG transport: " + transportType_);
+#ifndef WIN32
+  if (transportType_ == g_TransportDirect)
+    transport_ = new ShapeokoTinyGTermiosTransport(transportAddress_, transportBaud_);
+  else
+#endif
+  if (transportType_ == g_TransportTcp)
+    transport_ = new ShapeokoTinyGTcpTransport(transportAddress_);
+  else
+    transport_ = new ShapeokoTinyGMMSerialTransport(this, GetCoreCallback(), port_);
+  int ret = transport_->Open();
   if (ret != DEVICE_OK)
   {
-    LogMessage("command write fail");
+    TINYG_TRACE(TINYG_TRACE_ERROR, "TinyG could not open the transport");
+    CloseTransport();
     return ret;
   }
+  portAvailable_ = true;
   return DEVICE_OK;
 }
 
-
-int ShapeokoTinyGHub::SendConfigCommand(string command, string& answer)
+void ShapeokoTinyGHub::CloseTransport()
 {
-  LogMessage("TinyG SendConfigCommand");
-  if(!portAvailable_)
-    return ERR_NO_PORT_SET;
-  // needs a lock because the other Thread will also use this function
-  MMThreadGuard(this->executeLock_);
-  PurgeComPortH();
-  int ret = DEVICE_OK;
-  SetAnswerTimeoutMs(10000.0); //for normal command
-
-  LogMessage("Writing command to com port");
-  LogMessage(command);
-  ret = SetCommandComPortH(command.c_str(),"\r");
-  LogMessage("set command, ret=" + ret);
-  if (ret != DEVICE_OK)
+  if (transport_ != 0)
   {
-    LogMessage("command write fail");
-    return ret;
+    transport_->Close();
+    delete transport_;
+    transport_ = 0;
   }
-  try
-  {
+}
 
-    LogMessage("Reading answer.");
-    ret = GetSerialAnswerComPortH(answer,"\r");
-    if (ret != DEVICE_OK)
-    {
-      LogMessage(std::string("answer get error!_"));
-      return ret;
-    }
-    LogMessage("answer:");
-    LogMessage(std::string(answer));
-    if (answer.length() <1)
-      return DEVICE_ERR;
+int ShapeokoTinyGHub::OnStatusInterval(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(statusIntervalMs_);
   }
-  catch(...)
+  else if (pAct == MM::AfterSet)
   {
-    LogMessage("Exception in send command!");
-    return DEVICE_ERR;
+    pProp->Get(statusIntervalMs_);
+    return ConfigureStatusReports();
   }
   return DEVICE_OK;
 }
 
-MM::DeviceDetectionStatus ShapeokoTinyGHub::DetectDevice(void)
+int ShapeokoTinyGHub::OnCoalescingWindow(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG DetectDevice");
-  if (initialized_)
-    return MM::CanCommunicate;
-
-  // all conditions must be satisfied...
-  MM::DeviceDetectionStatus result = MM::Misconfigured;
-  char answerTO[MM::MaxStrLength];
-
-  try
+  if (pAct == MM::BeforeGet)
   {
-    std::string portLowerCase = port_;
-    for( std::string::iterator its = portLowerCase.begin(); its != portLowerCase.end(); ++its)
-    {
-      *its = (char)tolower(*its);
-    }
-    if( 0< portLowerCase.length() &&  0 != portLowerCase.compare("undefined")  && 0 != portLowerCase.compare("unknown") )
-    {
-      result = MM::CanNotCommunicate;
-      // record the default answer time out
-      GetCoreCallback()->GetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
-
-      // device specific default communication parameters
-      // for Arduino Duemilanova
-      GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_Handshaking, "Off");
-      GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_BaudRate, "115200" );
-      GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_StopBits, "1");
-      // Arduino timed out in GetControllerVersion even if AnswerTimeout  = 300 ms
-      GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", "500.0");
-      GetCoreCallback()->SetDeviceProperty(port_.c_str(), "DelayBetweenCharsMs", "0");
-      MM::Device* pS = GetCoreCallback()->GetDevice(this, port_.c_str());
-      pS->Initialize();
-      // The first second or so after opening the serial port, the Arduino is waiting for firmwareupgrades.  Simply sleep 1 second.
-      CDeviceUtils::SleepMs(2000);
-      MMThreadGuard myLock(executeLock_);
-      PurgeComPort(port_.c_str());
-      int ret = GetStatus();
-      // later, Initialize will explicitly check the version #
-      if( DEVICE_OK != ret )
-      {
-        LogMessage("Got:");
-        LogMessageCode(ret,true);
-      }
-      else
-      {
-        // to succeed must reach here....
-        result = MM::CanCommunicate;
-      }
-      pS->Shutdown();
-      // always restore the AnswerTimeout to the default
-      GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
-
-    }
+    pProp->Set(coalescingWindowMs_);
   }
-  catch(...)
+  else if (pAct == MM::AfterSet)
   {
-    LogMessage("Exception in DetectDevice!",false);
+    pProp->Get(coalescingWindowMs_);
+    // sends whatever is still waiting for the old window
+    if (coalescingWindowMs_ <= 0 && coalescer_ != 0)
+      coalescer_->Stop();
   }
-
-  return result;
+  return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::SetAnswerTimeoutMs(double timeout)
+int ShapeokoTinyGHub::OnLatencyReport(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG SetAnswerTimeoutMs");
-  if(!portAvailable_)
-    return ERR_NO_PORT_SET;
-  GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout",  CDeviceUtils::ConvertToString(timeout));
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(latency_.Report("; ").c_str());
+  }
   return DEVICE_OK;
 }
 
-template <class Type>
-Type stringToNum(const std::string& str)
+int ShapeokoTinyGHub::OnBenchmarkIterations(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  std::istringstream iss(str);
-  Type num;
-  iss >> num;
-  return num;
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(benchmarkIterations_);
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    pProp->Get(benchmarkIterations_);
+  }
+  return DEVICE_OK;
 }
 
-// private and expects caller to:
-// 1. guard the port
-// 2. purge the port
-int ShapeokoTinyGHub::GetStatus()
+// Setting "Run" runs the benchmark to completion, then reads back "Idle".
+int ShapeokoTinyGHub::OnBenchmark(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG GetStatus");
-  std::string cmd;
-  cmd.assign("$sr"); // x step/mm
-  std::string returnString;
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set("Idle");
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    if (value == "Run")
+      return RunBenchmark(benchmarkIterations_);
+  }
+  return DEVICE_OK;
+}
 
-  if(!portAvailable_)
-    return ERR_NO_PORT_SET;
-  // needs a lock because the other Thread will also use this function
-  MMThreadGuard(this->executeLock_);
-  PurgeComPortH();
+// Drives each command path back to back against whatever is on the port,
+// a controller or tinyg_sim, and logs the latency report.  The motion paths
+// step X by 1 um and back.  Earlier statistics are discarded.
+int ShapeokoTinyGHub::RunBenchmark(long iterations)
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG RunBenchmark");
+  if (IsStreaming() || IsMoving())
+    return ERR_STAGE_MOVING;
+  TinyGMachineStatus status;
+  GetMachineStatus(status);
+  if (!status.valid)
+    return ERR_UNKNOWN_POSITION;
+
+  latency_.Clear();
+  std::string answer;
   int ret = DEVICE_OK;
-  SetAnswerTimeoutMs(1000.0); //for normal command
+  for (long i = 0; i < iterations && ret == DEVICE_OK; ++i)
+    ret = SendCommand("{\"fv\":null}", answer);
+  for (long i = 0; i < iterations && ret == DEVICE_OK; ++i)
+    ret = SendConfigCommand("{\"ee\":0}", answer);
+  for (long i = 0; i < iterations && ret == DEVICE_OK; ++i)
+    ret = GetStatus();
+
+  char buff[64];
+  for (long i = 0; i < iterations && ret == DEVICE_OK; ++i)
+  {
+    sprintf(buff, "G0 X%.3f", status.pos[0] + (i % 2 == 0 ? 0.001 : 0.0));
+    ret = SendMotionCommand(buff);
+  }
+  for (long i = 0; i < iterations && ret == DEVICE_OK; ++i)
+  {
+    sprintf(buff, "G0 X%.3f", status.pos[0] + (i % 2 == 0 ? 0.001 : 0.0));
+    ret = StartMotionCommand(buff);
+    while (ret == DEVICE_OK && IsMoving())
+      CDeviceUtils::SleepMs(1);
+  }
+
+  LogMessage("TinyG benchmark, " + std::string(CDeviceUtils::ConvertToString(iterations)) +
+      " iterations per path:\n" + latency_.Report());
+  return ret;
+}
 
-  LogMessage("Write command.");
-  ret = SetCommandComPortH(cmd.c_str(),"\r");
-  LogMessage("set command, ret=" + ret);
+void ShapeokoTinyGHub::RecordLatency(TinyGLatencyPath path, int ret, const MM::MMTime& start, const MM::MMTime& written)
+{
   if (ret != DEVICE_OK)
   {
-    LogMessage("command write fail");
-    return ret;
+    latency_.RecordError(path);
+    TINYG_TRACE_EVENT(kTraceError, ret, 0.0, ShapeokoTinyGLatency::PathName(path));
   }
+  else
+    latency_.Record(path, start.getUsec(), written.getUsec(), GetCurrentMMTime().getUsec());
+}
 
-
-  while(true) {
-    try
-    {
-      string an;
-      ret = GetSerialAnswerComPortH(an,"\r");
-      if (ret != DEVICE_OK)
-      {
-        LogMessage(std::string("answer get error!_"));
-        return ret;
-      }
-      LogMessage("answer:");
-      LogMessage(an);
-      if (an.length() <1)
-        return DEVICE_ERR;
-      returnString += an;
-      if (an.find("Machine state:") != std::string::npos) {
-        break;
-      }
-    }
-    catch(...)
-    {
-      LogMessage("Exception in send command!");
-      return DEVICE_ERR;
-    }
+int ShapeokoTinyGHub::OnTraceLevel(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(g_TraceLevelNames[g_TinyGTraceLevel]);
   }
-  LogMessage("ReturnString:");
-  LogMessage(returnString);
-
-  std::vector<std::string> tokenInput;
-  //      char* pEnd;
-  CDeviceUtils::Tokenize(returnString, tokenInput, "\r\n");
-  for(std::vector<std::string>::iterator i = tokenInput.begin(); i != tokenInput.end(); ++i) {
-    LogMessage("Token input: ");
-    LogMessage(*i);
-    string x;
-    if (i->substr(0, 10) == "X position") {
-      x = i->substr(21,10);
-      std::vector<std::string> spl;
-      spl = split(x, ' ');
-      MPos[0] = stringToNum<double>(spl[0]);
-    }
-    if (i->substr(0, 10) == "Y position") {
-      x = i->substr(21,10);
-      std::vector<std::string> spl;
-      spl = split(x, ' ');
-      MPos[1] = stringToNum<double>(spl[0]);
-    }
-    if (i->substr(0, 10) == "Z position") {
-      x = i->substr(21,10);
-      std::vector<std::string> spl;
-      spl = split(x, ' ');
-      MPos[2] = stringToNum<double>(spl[0]);
-    }
-    if (i->substr(0, 9) == "Velocity:") {
-      x = i->substr(21,10);
-    }
-    if (i->substr(0, 6) == "Units:") {
-      // TODO(dek): correct these if wrong.
-      x = i->substr(21,10);
-    }
-    if (i->substr(0, 18) == "Coordinate system:") {
-      x = i->substr(21,10);
-    }
-    if (i->substr(0, 14) == "Distance mode:") {
-      // TODO(dek): correct these if wrong.
-      x = i->substr(21,10);
-    }
-    if (i->substr(0, 14) == "Machine state:") {
-      x = i->substr(21,10);
-      SetProperty("Status",x.c_str());
-    }
-    if (!x.empty()) {
-      LogMessage("Parsed line:");
-      LogMessage(x);
-    }
+  else if (pAct == MM::AfterSet)
+  {
+    std::string level;
+    pProp->Get(level);
+    for (int i = TINYG_TRACE_OFF; i <= TINYG_TRACE_MAX_LEVEL; ++i)
+      if (level == g_TraceLevelNames[i])
+        g_TinyGTraceLevel = i;
+  }
+  return DEVICE_OK;
+}
 
+int ShapeokoTinyGHub::OnTraceRing(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(g_TinyGTraceRing.IsEnabled() ? "On" : "Off");
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    g_TinyGTraceRing.Enable(value == "On");
   }
   return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::ReadFromComPortH(unsigned char* answer, unsigned maxLen, unsigned long& bytesRead)
+int ShapeokoTinyGHub::OnTraceDump(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG ReadFromComPortH");
-  return ReadFromComPort(port_.c_str(), answer, maxLen, bytesRead);
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set("Idle");
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    if (value == "Dump")
+      DumpTrace();
+  }
+  return DEVICE_OK;
 }
-int ShapeokoTinyGHub::SetCommandComPortH(const char* command, const char* term)
+
+int ShapeokoTinyGHub::OnPositionUpdateInterval(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG SetCommandComPortH");
-  return SendSerialCommand(port_.c_str(),command,term);
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(poller_->GetUpdateIntervalMs());
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    long ms;
+    pProp->Get(ms);
+    poller_->SetUpdateIntervalMs(ms);
+  }
+  return DEVICE_OK;
 }
-int ShapeokoTinyGHub::GetSerialAnswerComPortH (std::string& ans,  const char* term)
+
+int ShapeokoTinyGHub::OnIdlePollInterval(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
-  LogMessage("TinyG GetSerialAnswerComPortH");
-  return GetSerialAnswer(port_.c_str(),term,ans);
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(poller_->GetIdlePollMs());
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    long ms;
+    pProp->Get(ms);
+    poller_->SetIdlePollMs(ms);
+  }
+  return DEVICE_OK;
 }
 
-int ShapeokoTinyGHub::PurgeComPortH() {  LogMessage("TinyG PurgeComPortH");
-return PurgeComPort(port_.c_str());}
-int ShapeokoTinyGHub::WriteToComPortH(const unsigned char* command, unsigned len) {LogMessage("TinyG WriteToComPortH"); return WriteToComPort(port_.c_str(), command, len);}
+int ShapeokoTinyGHub::OnHome(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(IsHoming() ? AxisNames(homer_->GetAxes()).c_str() : "Idle");
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    for (size_t i = 0; i < sizeof(g_HomeAxes) / sizeof(g_HomeAxes[0]); ++i)
+      if (value == AxisNames(g_HomeAxes[i]))
+        return StartHoming(g_HomeAxes[i]);
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnProgramFile(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+    pProp->Set(programPath_.c_str());
+  else if (pAct == MM::AfterSet)
+    pProp->Get(programPath_);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnProgram(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    if (!IsProgramRunning())
+      pProp->Set("Idle");
+    else
+      pProp->Set(program_->IsPaused() ? "Pause" : "Run");
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    if (value == "Run")
+      return StartProgram(programPath_);
+    if (value == "Pause")
+      return PauseProgram();
+    if (value == "Resume")
+      return ResumeProgram();
+    if (value == "Abort")
+      return AbortProgram();
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnProgramStatus(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    std::string status;
+    if (program_ == 0)
+      status = "Idle";
+    else if (program_->IsActive())
+      status = program_->IsPaused() ? "Paused" : "Running";
+    else if (program_->GetResult() == ERR_PROGRAM_ABORTED)
+      status = "Aborted";
+    else if (program_->GetResult() != DEVICE_OK)
+      status = "Failed (error " + std::string(CDeviceUtils::ConvertToString(program_->GetResult())) + ")";
+    else
+      status = "Done";
+    pProp->Set(status.c_str());
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnProgramProgress(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+    pProp->Set(program_ != 0 ? program_->Progress() * 100.0 : 0.0);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnProgramLines(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+    pProp->Set(program_ != 0 ? (long) program_->LinesSent() : 0L);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnPositionClock(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+    pProp->Set(GetCurrentMMTime().getMsec());
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnPositionQueryTime(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+    pProp->Set(positionQueryMs_);
+  else if (pAct == MM::AfterSet)
+    pProp->Get(positionQueryMs_);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnPositionAtQueryTime(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    TinyGPositionSample sample;
+    if (GetPositionAt(MM::MMTime(positionQueryMs_ * 1000.0), sample) != DEVICE_OK)
+    {
+      pProp->Set("Unknown");
+      return DEVICE_OK;
+    }
+    char buff[100];
+    sprintf(buff, "%.4f %.4f %.4f", sample.pos[0], sample.pos[1], sample.pos[2]);
+    pProp->Set(buff);
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::OnHomingStatus(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  if (pAct == MM::BeforeGet)
+  {
+    std::string status;
+    if (homer_ == 0)
+      status = "Not homed";
+    else if (homer_->IsActive())
+      status = "Homing " + AxisNames(homer_->GetAxes());
+    else if (homer_->GetResult() != DEVICE_OK)
+      status = "Failed (error " + std::string(CDeviceUtils::ConvertToString(homer_->GetResult())) + ")";
+    else
+      status = "Homed " + AxisNames(homer_->GetHomedAxes());
+    pProp->Set(status.c_str());
+  }
+  return DEVICE_OK;
+}
+
+// "X Y Z" style names of the axes in the mask
+std::string ShapeokoTinyGHub::AxisNames(unsigned axes)
+{
+  static const char* const names[3] = {"X", "Y", "Z"};
+  std::string result;
+  for (int i = 0; i < 3; ++i)
+  {
+    if (!(axes & (1u << i)))
+      continue;
+    if (!result.empty())
+      result += " ";
+    result += names[i];
+  }
+  return result;
+}
+
+// Writes the trace ring to the log regardless of the trace level, one line
+// per record with the time relative to the oldest record.
+void ShapeokoTinyGHub::DumpTrace()
+{
+  std::vector<TinyGTraceRecord> records;
+  g_TinyGTraceRing.Snapshot(records);
+  LogMessage("TinyG trace, " + std::string(CDeviceUtils::ConvertToString((long) records.size())) + " records");
+  for (std::vector<TinyGTraceRecord>::const_iterator r = records.begin(); r != records.end(); ++r)
+  {
+    char buff[128];
+    sprintf(buff, "TinyG trace %10.3f ms %-8s %6ld %10.3f %s",
+        (r->timeUs - records.front().timeUs) / 1000.0, TinyGTraceRing::EventName(r->event),
+        r->arg, r->value, r->text);
+    LogMessage(buff);
+  }
+}
+
+// Selects the status report fields and turns on automatic, filtered reports
+// every statusIntervalMs_ while the machine moves; 0 turns them off.
+int ShapeokoTinyGHub::ConfigureStatusReports()
+{
+  std::string answer;
+  int ret = SendConfigCommand("{\"sr\":{\"posx\":true,\"posy\":true,\"posz\":true,"
+      "\"vel\":true,\"stat\":true,\"line\":true}}", answer);
+  if (ret != DEVICE_OK)
+    return ret;
+  if (statusIntervalMs_ <= 0)
+    return SendConfigCommand("{\"sv\":0}", answer);
+  ret = SendConfigCommand("{\"sv\":1}", answer);
+  if (ret != DEVICE_OK)
+    return ret;
+  char buff[32];
+  sprintf(buff, "{\"si\":%ld}", statusIntervalMs_);
+  return SendConfigCommand(buff, answer);
+}
+
+int ShapeokoTinyGHub::OnCommand(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG OnCommand");
+  if (pAct == MM::BeforeGet)
+  {
+    pProp->Set(commandResult_.c_str());
+  }
+  else if (pAct == MM::AfterSet)
+  {
+    std::string cmd;
+    pProp->Get(cmd);
+    if(cmd.compare(commandResult_) ==0)  // command result still there
+      return DEVICE_OK;
+    int ret = SendCommand(cmd.c_str(),commandResult_);
+    if(DEVICE_OK != ret){
+      commandResult_.assign("Error!");
+      return DEVICE_ERR;
+    }
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::SendCommand(const char* command, std::string &returnString)
+{
+  TinyGRequest request(kLaneConfig, kRequestCommand, command);
+  int ret = Execute(request);
+  if (ret != DEVICE_OK)
+    return ret;
+  returnString.assign(request.answer.text, request.answer.len);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::SendCommand(const char* command, TinyGLane lane)
+{
+  TinyGRequest request(lane, kRequestCommand, command);
+  return Execute(request);
+}
+
+int ShapeokoTinyGHub::SendRealtime(const char* chars)
+{
+  TinyGRequest request(kLaneUrgent, kRequestRealtime, chars);
+  return Execute(request);
+}
+
+int ShapeokoTinyGHub::SubmitRequest(TinyGRequest& request)
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, std::string("command=") + request.command);
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  if (scheduler_ == 0)
+    return ERR_COMMUNICATION;
+  return scheduler_->Submit(request);
+}
+
+int ShapeokoTinyGHub::WaitForRequest(TinyGRequest& request)
+{
+  if (scheduler_ == 0)
+    return ERR_COMMUNICATION;
+  return scheduler_->Wait(request);
+}
+
+int ShapeokoTinyGHub::Execute(TinyGRequest& request)
+{
+  int ret = SubmitRequest(request);
+  if (ret != DEVICE_OK)
+    return ret;
+  return WaitForRequest(request);
+}
+
+// Scheduler thread.  Writes the request and reads its response into it.
+int ShapeokoTinyGHub::ExecuteRequest(TinyGRequest& request)
+{
+  if (request.kind == kRequestRealtime)
+  {
+    // single character commands act at once, without a line terminator
+    TINYG_TRACE_EVENT(kTraceWrite, (long) strlen(request.command), 0.0, request.command);
+    int ret = WriteToComPortH((const unsigned char*) request.command, (unsigned) strlen(request.command));
+    request.written = GetCurrentMMTime();
+    return ret;
+  }
+
+  TINYG_TRACE(TINYG_TRACE_DEBUG, std::string("TinyG ") + ShapeokoTinyGLatency::PathName(request.path));
+  if (request.kind == kRequestNoResponse)
+  {
+    int ret = ExpectResponses(request.command);
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  unsigned long seq;
+  int ret = WriteCommand(request.command, seq);
+  request.written = GetCurrentMMTime();
+  if (ret != DEVICE_OK && request.kind == kRequestNoResponse)
+  {
+    // no telling how much of it went out
+    MMThreadGuard guard(statusLock_);
+    linesAnswered_ = linesWritten_;
+    unansweredBytes_ = 0;
+  }
+  if (ret != DEVICE_OK || request.kind == kRequestNoResponse)
+    return ret;
+  // a response still owed to a command that timed out comes first; read on
+  // from where that command stopped, so it is found and dropped
+  if (lateResponses_ > 0)
+  {
+    if (GetCurrentMMTime() < lateResponseDeadline_)
+      seq = lateResponseSeq_;
+    else
+      lateResponses_ = 0;
+  }
+  ret = ReadResponse(seq, request.answer, request.report, request.timeoutMs);
+  if (request.recordLatency)
+    RecordLatency(request.path, ret, request.start, request.written);
+  if (ret != DEVICE_OK)
+    return ret;
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "answer:");
+  TINYG_TRACE(TINYG_TRACE_DEBUG, request.answer.text);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::SendMotionCommand(const char* command, unsigned axes, const double* target_mm)
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG SendMotionCommand");
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  TinyGRequest request(kLaneMotion, kRequestCommand, command, kLatencySendMotionCommand);
+  // measured up to the end of the move, below
+  request.recordLatency = false;
+  int ret = ExecuteMotion(request, axes, target_mm);
+
+  // the reader thread consumes the status reports; wait for the ones that
+  // show the move done
+  if (ret == DEVICE_OK)
+    ret = WaitForMotionEnd(1000);
+  RecordLatency(kLatencySendMotionCommand, ret, request.start, request.written);
+  if (ret != DEVICE_OK)
+  {
+    TINYG_TRACE(TINYG_TRACE_ERROR, std::string("answer get error!_"));
+    return ret;
+  }
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "Move done.");
+  return DEVICE_OK;
+}
+
+// Writes a move and returns once the controller has accepted it, without
+// waiting for it to finish.  IsMoving() reports true until the controller
+// says the machine has stopped, at target_mm for the axes in the mask.
+int ShapeokoTinyGHub::StartMotionCommand(const char* command, unsigned axes, const double* target_mm)
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG StartMotionCommand");
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  TinyGRequest request(kLaneMotion, kRequestCommand, command, kLatencyStartMotionCommand);
+  return ExecuteMotion(request, axes, target_mm);
+}
+
+/*
+ * Status reports answered or pushed before the controller has taken the
+ * move describe the machine before it, so a stop in one of them must not
+ * end the move: motionPending_ is only cleared by reports applied after the
+ * "ok", and with a target only once the axes are there.
+ */
+int ShapeokoTinyGHub::ExecuteMotion(TinyGRequest& request, unsigned axes, const double* target_mm)
+{
+  {
+    MMThreadGuard guard(statusLock_);
+    motionPending_ = true;
+    motionAccepted_ = false;
+    motionTargetAxes_ = target_mm != 0 ? axes : 0;
+    for (int i = 0; i < 3 && target_mm != 0; ++i)
+      motionTarget_[i] = target_mm[i];
+    lastReportTime_ = GetCurrentMMTime();
+  }
+  int ret = Execute(request);
+  MMThreadGuard guard(statusLock_);
+  if (ret != DEVICE_OK)
+  {
+    motionPending_ = false;
+    return ret;
+  }
+  motionAccepted_ = true;
+  // already there, e.g. the move ended before its "ok" was read
+  if (motionTargetAxes_ != 0 && !IsMotionState(machineState_) && IsMotionTargetReached())
+    motionPending_ = false;
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::MoveAxes(unsigned axes, const double* target_mm, bool wait, double feed)
+{
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  // a stream or a homing cycle owns the planner; it must be stopped first
+  if (IsStreaming() || IsHoming())
+    return ERR_STAGE_MOVING;
+  // a position ends a jog
+  if (IsJogging())
+  {
+    int ret = StopJog();
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  if (IsNoOpMove(axes, target_mm))
+  {
+    TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG dropping move to the current target");
+    return DEVICE_OK;
+  }
+  bool queued = coalescer_ != 0 && coalescer_->IsPending();
+  if (coalescingWindowMs_ <= 0 && !queued && !IsMachineMoving())
+    return SendAxesMove(axes, target_mm, wait, feed);
+
+  if (coalescer_ == 0)
+    coalescer_ = new ShapeokoTinyGCoalescer(this);
+  int ret = coalescer_->Start();
+  if (ret != DEVICE_OK)
+    return ret;
+  coalescer_->Add(axes, target_mm, feed, coalescingWindowMs_ > 0 ? coalescingWindowMs_ : 0);
+  // a failure of an earlier merged move surfaces here
+  ret = coalescer_->TakeResult();
+  if (ret != DEVICE_OK || !wait || coalescingWindowMs_ > 0)
+    return ret;
+  ret = WaitForIdle(1000);
+  if (ret != DEVICE_OK)
+    return ret;
+  return coalescer_->TakeResult();
+}
+
+// True if every axis in the mask already has this target, and the machine
+// is either on its way there or, by its last report, already there.
+bool ShapeokoTinyGHub::IsNoOpMove(unsigned axes, const double* target_mm)
+{
+  // a pending move may still take these axes somewhere else
+  if (coalescer_ != 0 && (coalescer_->GetPendingAxes() & axes) != 0)
+    return false;
+  double sent[3];
+  if ((GetSentTargets(sent) & axes) != axes)
+    return false;
+  for (int i = 0; i < 3; ++i)
+    if ((axes & (1u << i)) && fabs(sent[i] - target_mm[i]) > 1e-6)
+      return false;
+  if (IsMoving())
+    return true;
+  TinyGMachineStatus status;
+  GetMachineStatus(status);
+  if (!status.valid)
+    return false;
+  // status reports carry positions to the micrometre
+  for (int i = 0; i < 3; ++i)
+    if ((axes & (1u << i)) && fabs(status.pos[i] - target_mm[i]) > 0.001)
+      return false;
+  return true;
+}
+
+int ShapeokoTinyGHub::SendAxesMove(unsigned axes, const double* target_mm, bool wait, double feed)
+{
+  const char* names = "XYZ";
+  TinyGCommand command;
+  if (feed > 0.0)
+    command.Append("G1 F").AppendFixed(feed, 1);
+  else
+    command.Append("G0");
+  for (int i = 0; i < 3; ++i)
+  {
+    if (axes & (1u << i))
+      command.Append(' ').Append(names[i]).AppendFixed(target_mm[i], 6);
+  }
+  int ret = wait ? SendMotionCommand(command.c_str(), axes, target_mm) :
+      StartMotionCommand(command.c_str(), axes, target_mm);
+  // after a failure there is no telling where the axes are headed
+  if (ret == DEVICE_OK)
+    SetSentTargets(axes, target_mm);
+  else
+    ForgetSentTargets(axes);
+  return ret;
+}
+
+unsigned ShapeokoTinyGHub::GetSentTargets(double* target_mm)
+{
+  MMThreadGuard guard(targetLock_);
+  for (int i = 0; i < 3; ++i)
+    target_mm[i] = lastTarget_[i];
+  return lastTargetAxes_;
+}
+
+void ShapeokoTinyGHub::SetSentTargets(unsigned axes, const double* target_mm)
+{
+  MMThreadGuard guard(targetLock_);
+  for (int i = 0; i < 3; ++i)
+    if (axes & (1u << i))
+      lastTarget_[i] = target_mm[i];
+  lastTargetAxes_ |= axes;
+}
+
+void ShapeokoTinyGHub::ForgetSentTargets(unsigned axes)
+{
+  MMThreadGuard guard(targetLock_);
+  lastTargetAxes_ &= ~axes;
+}
+
+/*
+ * The controller is switched back to absolute distances (G90) right after
+ * the move has been accepted, whatever its answer, since every other move
+ * the adapter sends is absolute.  The end position is worked out from the
+ * last report, which is exact once the previous move has finished.
+ */
+int ShapeokoTinyGHub::MoveRelative(unsigned axes, const double* delta_mm, bool wait)
+{
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  if (IsStreaming() || IsHoming())
+    return ERR_STAGE_MOVING;
+  if (IsJogging())
+  {
+    int ret = StopJog();
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  // the step starts where the previous move ends
+  int ret = WaitForIdle(1000);
+  if (ret != DEVICE_OK)
+    return ret;
+
+  TinyGMachineStatus status;
+  GetMachineStatus(status);
+  static const char* const words[3] = {" X", " Y", " Z"};
+  TinyGCommand command("G91 G0");
+  double target[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    target[i] = status.pos[i] + delta_mm[i];
+    if (axes & (1u << i))
+      command.Append(words[i]).AppendFixed(delta_mm[i], 6);
+  }
+  if (command.Overflowed())
+    return ERR_COMMUNICATION;
+
+  TinyGRequest request(kLaneMotion, kRequestCommand, command.c_str(), kLatencySendMotionCommand);
+  // measured up to the end of the move, below
+  request.recordLatency = false;
+  ret = ExecuteMotion(request, status.valid ? axes : 0, target);
+  int absRet = SendCommand("G90", kLaneMotion);
+  if (ret == DEVICE_OK)
+    ret = absRet;
+  if (ret != DEVICE_OK)
+  {
+    {
+      MMThreadGuard guard(statusLock_);
+      motionPending_ = false;
+    }
+    ForgetSentTargets(axes);
+    return ret;
+  }
+
+  if (status.valid)
+    SetSentTargets(axes, target);
+  else
+    ForgetSentTargets(axes);
+  if (!wait)
+    return DEVICE_OK;
+  ret = WaitForIdle(1000);
+  RecordLatency(kLatencySendMotionCommand, ret, request.start, request.written);
+  return ret;
+}
+
+int ShapeokoTinyGHub::GetConfigValue(const char* key, double& value)
+{
+  TinyGCommand command("{\"");
+  command.Append(key).Append("\":null}");
+  if (command.Overflowed())
+    return ERR_COMMUNICATION;
+  TinyGRequest request(kLaneConfig, kRequestCommand, command.c_str(), kLatencySendConfigCommand, 10000);
+  int ret = Execute(request);
+  if (ret != DEVICE_OK)
+    return ret;
+  if (!request.report.Has(TinyGReport::kValue))
+  {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "No value for " + std::string(key) + " in answer: " + request.answer.text);
+    return ERR_COMMUNICATION;
+  }
+  value = request.report.value;
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::SetConfigValue(const char* key, double value)
+{
+  TinyGCommand command("{\"");
+  command.Append(key).Append("\":").AppendFixed(value, 3).Append('}');
+  if (command.Overflowed())
+    return ERR_COMMUNICATION;
+  TinyGRequest request(kLaneConfig, kRequestCommand, command.c_str(), kLatencySendConfigCommand, 10000);
+  return Execute(request);
+}
+
+bool ShapeokoTinyGHub::IsMoving()
+{
+  if (coalescer_ != 0 && coalescer_->IsPending())
+    return true;
+  return IsJogging() || IsHoming() || IsMachineMoving();
+}
+
+bool ShapeokoTinyGHub::IsMachineMoving()
+{
+  MMThreadGuard guard(statusLock_);
+  if (motionPending_)
+  {
+    // a move too short to produce a report, or a controller with status
+    // reports switched off, must not leave us busy forever
+    if (GetCurrentMMTime() - lastReportTime_ > MM::MMTime(1000 * 1000.0))
+      motionPending_ = false;
+    else
+      return true;
+  }
+  return IsMotionState(machineState_);
+}
+
+int ShapeokoTinyGHub::HoldAndFlush()
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG HoldAndFlush");
+  unsigned long statusSeq;
+  {
+    MMThreadGuard guard(statusLock_);
+    statusSeq = statusSeq_;
+  }
+  int ret = SendRealtime("!");
+  if (ret != DEVICE_OK)
+    return ret;
+  ret = WaitForHold(statusSeq, 2000);
+  if (ret != DEVICE_OK)
+    return ret;
+  {
+    MMThreadGuard guard(statusLock_);
+    statusSeq = statusSeq_;
+    // a move that ended before the hold took effect needs no flush
+    if (!IsMotionState(machineState_))
+    {
+      motionPending_ = false;
+      return DEVICE_OK;
+    }
+  }
+  ret = SendRealtime("%");
+  if (ret != DEVICE_OK)
+    return ret;
+  return FinishFlush(statusSeq);
+}
+
+// Waits for the stop that follows a queue flush written after statusSeq
+int ShapeokoTinyGHub::FinishFlush(unsigned long statusSeq)
+{
+  if (WaitForMachineState(statusSeq, 3, 500) != DEVICE_OK)
+  {
+    // firmware that stays in hold after the flush needs a cycle start
+    {
+      MMThreadGuard guard(statusLock_);
+      statusSeq = statusSeq_;
+    }
+    int ret = SendRealtime("~");
+    if (ret != DEVICE_OK)
+      return ret;
+    ret = WaitForMachineState(statusSeq, 3, 1000);
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  MMThreadGuard guard(statusLock_);
+  motionPending_ = false;
+  return DEVICE_OK;
+}
+
+/*
+ * The stop goes through the scheduler's urgent lane, which is written even
+ * while another command waits for its answer, so it is not held back by
+ * that command's timeout.  TinyG acts on "!" and "%" as soon as they
+ * arrive, even in the middle of a line, so the stop takes effect within
+ * two byte times.  The answer to the interrupted command still arrives and
+ * is collected by whoever sent it.
+ */
+int ShapeokoTinyGHub::StopMotion()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG stop motion");
+  if (!portAvailable_)
+    return ERR_NO_PORT_SET;
+
+  // keep the background senders from queueing more behind the flush
+  if (streamer_ != 0)
+    streamer_->RequestStop();
+  if (jogger_ != 0)
+    jogger_->RequestStop();
+  if (homer_ != 0)
+    homer_->RequestStop();
+  if (program_ != 0)
+    program_->RequestStop();
+  // waits for a merged move being sent, so it cannot follow the flush below
+  if (coalescer_ != 0)
+    coalescer_->Discard();
+
+  // Lines still in the controller's receive buffer would run after the
+  // flush.  With the motion held they are read into the planner first, so
+  // the flush takes them too; a full planner keeps some from being read,
+  // and those are dealt with in a second round below.
+  bool unanswered = GetUnansweredLines() != 0;
+  if (unanswered)
+  {
+    int ret = SendRealtime("!");
+    if (ret != DEVICE_OK)
+      return ret;
+    WaitForResponses(1000);
+  }
+
+  unsigned long statusSeq;
+  bool moving;
+  {
+    MMThreadGuard guard(statusLock_);
+    statusSeq = statusSeq_;
+    moving = unanswered || motionPending_ || IsMotionState(machineState_);
+  }
+  int ret = SendRealtime("!%");
+  if (ret != DEVICE_OK)
+    return ret;
+
+  // a line already being written when the flush arrived may still start
+  if (streamer_ != 0)
+    streamer_->Stop();
+  if (jogger_ != 0)
+    jogger_->Stop();
+  if (homer_ != 0)
+    homer_->Stop();
+  if (program_ != 0)
+    program_->Stop();
+  ForgetSentTargets(TINYG_AXIS_X | TINYG_AXIS_Y | TINYG_AXIS_Z);
+  if (moving)
+    ret = FinishFlush(statusSeq);
+  // by now the rest of the receive buffer has been read; see whether it
+  // queued any motion
+  if (ret == DEVICE_OK && unanswered)
+  {
+    WaitForResponses(1000);
+    ret = GetStatus();
+  }
+  if (ret == DEVICE_OK && IsMachineMoving())
+  {
+    {
+      MMThreadGuard guard(statusLock_);
+      statusSeq = statusSeq_;
+    }
+    ret = SendRealtime("!%");
+    if (ret == DEVICE_OK)
+      ret = FinishFlush(statusSeq);
+  }
+  if (ret != DEVICE_OK)
+    return ret;
+  // the cached position is where the stop left the axes
+  return GetStatus();
+}
+
+int ShapeokoTinyGHub::Jog(double vx, double vy)
+{
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  if (vx == 0.0 && vy == 0.0)
+    return StopJog();
+  if (IsJogging())
+  {
+    jogger_->SetVelocity(vx, vy);
+    return DEVICE_OK;
+  }
+  if (IsStreaming() || IsHoming())
+    return ERR_STAGE_MOVING;
+
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG start jog");
+  // segments are absolute, so they must start from where the machine rests
+  if (IsMachineMoving())
+  {
+    int ret = HoldAndFlush();
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  TinyGMachineStatus status;
+  GetMachineStatus(status);
+  if (!status.valid)
+    return ERR_UNKNOWN_POSITION;
+  ForgetSentTargets(TINYG_AXIS_X | TINYG_AXIS_Y | TINYG_AXIS_Z);
+  // the jogger queues only into free planner buffers; as in
+  // ShapeokoTinyGStreamer::Start, the reader keeps the count current
+  // after this, but nothing may have reported it since connecting
+  int ret = SendCommand("{\"qr\":null}", kLaneStatus);
+  if (ret != DEVICE_OK)
+    return ret;
+  if (jogger_ == 0)
+    jogger_ = new ShapeokoTinyGJogger(this);
+  // with reports off, still keep the look-ahead short
+  long lookaheadMs = statusIntervalMs_ > 0 ? statusIntervalMs_ : 250;
+  return jogger_->Start(status.pos[0], status.pos[1], vx, vy, lookaheadMs);
+}
+
+int ShapeokoTinyGHub::StopJog()
+{
+  if (jogger_ == 0)
+    return DEVICE_OK;
+  bool jogging = jogger_->IsActive();
+  jogger_->Stop();
+  int ret = jogger_->GetResult();
+  if (!jogging && ret == DEVICE_OK)
+    return DEVICE_OK;
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG stop jog");
+  // the jog leaves the axes wherever it stops
+  ForgetSentTargets(TINYG_AXIS_X | TINYG_AXIS_Y | TINYG_AXIS_Z);
+  if (IsMachineMoving())
+  {
+    int hold = HoldAndFlush();
+    if (ret == DEVICE_OK)
+      ret = hold;
+  }
+  return ret;
+}
+
+bool ShapeokoTinyGHub::IsJogging()
+{
+  return jogger_ != 0 && jogger_->IsActive();
+}
+
+int ShapeokoTinyGHub::StartHoming(unsigned axes)
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG start homing " + AxisNames(axes));
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  if (IsStreaming() || IsHoming())
+    return ERR_STAGE_MOVING;
+  if (IsJogging())
+  {
+    int ret = StopJog();
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  // homing replaces any move still to come
+  if (coalescer_ != 0)
+    coalescer_->Discard();
+  if (IsMachineMoving())
+  {
+    int ret = HoldAndFlush();
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  ForgetSentTargets(TINYG_AXIS_X | TINYG_AXIS_Y | TINYG_AXIS_Z);
+  if (homer_ == 0)
+    homer_ = new ShapeokoTinyGHomer(this);
+  return homer_->Start(axes, g_HomingTimeoutMs);
+}
+
+bool ShapeokoTinyGHub::IsHoming()
+{
+  return homer_ != 0 && homer_->IsActive();
+}
+
+/*
+ * G28.3 sets the machine coordinates; the reported work position follows
+ * them exactly while no work offset is in effect, which is how the adapter
+ * runs the controller.  A status report that says otherwise still wins.
+ */
+int ShapeokoTinyGHub::SetOrigin(unsigned axes)
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG set origin " + AxisNames(axes));
+  if (IsStreaming() || IsMoving())
+    return ERR_STAGE_MOVING;
+  TinyGCommand command("G28.3");
+  static const char* const words[3] = {" X0", " Y0", " Z0"};
+  for (int i = 0; i < 3; ++i)
+    if (axes & (1u << i))
+      command.Append(words[i]);
+  int ret = SendCommand(command.c_str());
+  if (ret != DEVICE_OK)
+    return ret;
+
+  ForgetSentTargets(axes);
+  MMThreadGuard guard(statusLock_);
+  for (int i = 0; i < 3; ++i)
+    if (axes & (1u << i))
+      status_.pos[i] = 0.0;
+  statusCache_.Write(status_);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::GetQueueFree()
+{
+  MMThreadGuard guard(statusLock_);
+  return queueFree_;
+}
+
+int ShapeokoTinyGHub::GetPositionAt(const MM::MMTime& time, TinyGPositionSample& sample)
+{
+  if (!timeline_.PositionAt(time.getUsec(), sample))
+    return ERR_POSITION_UNKNOWN_AT_TIME;
+  return DEVICE_OK;
+}
+
+long ShapeokoTinyGHub::GetLineNumber()
+{
+  MMThreadGuard guard(statusLock_);
+  return lineNumber_;
+}
+
+long ShapeokoTinyGHub::ReserveStreamLines(long count)
+{
+  MMThreadGuard guard(statusLock_);
+  long first = TinyGFirstStreamLine(lineNumber_, streamLineEnd_, count);
+  streamLineEnd_ = first + count;
+  return first;
+}
+
+void ShapeokoTinyGHub::SetLineListener(TinyGLineListener* listener)
+{
+  MMThreadGuard guard(listenerLock_);
+  lineListener_ = listener;
+}
+
+void ShapeokoTinyGHub::AddPositionListener(TinyGPositionListener* listener)
+{
+  MMThreadGuard guard(positionLock_);
+  if (std::find(positionListeners_.begin(), positionListeners_.end(), listener) == positionListeners_.end())
+    positionListeners_.push_back(listener);
+}
+
+void ShapeokoTinyGHub::RemovePositionListener(TinyGPositionListener* listener)
+{
+  MMThreadGuard guard(positionLock_);
+  positionListeners_.erase(std::remove(positionListeners_.begin(), positionListeners_.end(), listener),
+      positionListeners_.end());
+}
+
+void ShapeokoTinyGHub::NotifyPositionListeners(unsigned axes, const double* pos_mm)
+{
+  MMThreadGuard guard(positionLock_);
+  for (size_t i = 0; i < positionListeners_.size(); ++i)
+    positionListeners_[i]->OnPositionChanged(axes, pos_mm);
+}
+
+MM::MMTime ShapeokoTinyGHub::GetLastReportTime()
+{
+  MMThreadGuard guard(statusLock_);
+  return lastReportTime_;
+}
+
+int ShapeokoTinyGHub::StreamCommands(const std::vector<std::string>& lines)
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG StreamCommands");
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  if (IsHoming() || IsProgramRunning())
+    return ERR_STAGE_MOVING;
+  // jog segments would mix with the stream's lines in the planner
+  if (IsJogging())
+  {
+    int ret = StopJog();
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  if (streamer_ == 0)
+    streamer_ = new ShapeokoTinyGStreamer(this);
+  // the stream moves the axes somewhere else
+  ForgetSentTargets(TINYG_AXIS_X | TINYG_AXIS_Y | TINYG_AXIS_Z);
+  return streamer_->Start(lines);
+}
+
+void ShapeokoTinyGHub::StopStreaming()
+{
+  if (streamer_ != 0)
+    streamer_->Stop();
+}
+
+bool ShapeokoTinyGHub::IsStreaming()
+{
+  return (streamer_ != 0 && streamer_->IsActive()) || IsProgramRunning();
+}
+
+int ShapeokoTinyGHub::StartProgram(const std::string& path)
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG start program " + path);
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  if (IsStreaming() || IsHoming())
+    return ERR_STAGE_MOVING;
+  if (IsJogging())
+  {
+    int ret = StopJog();
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  if (program_ == 0)
+    program_ = new ShapeokoTinyGProgram(this);
+  {
+    // line numbers in the program are its own
+    MMThreadGuard guard(statusLock_);
+    lineNumber_ = 0;
+  }
+  ForgetSentTargets(TINYG_AXIS_X | TINYG_AXIS_Y | TINYG_AXIS_Z);
+  // an error left over from an earlier program is not this one's
+  TakeUnansweredError();
+  return program_->Start(path);
+}
+
+// The planner keeps running what it holds unless the motion is held too
+int ShapeokoTinyGHub::PauseProgram()
+{
+  if (!IsProgramRunning() || program_->IsPaused())
+    return DEVICE_OK;
+  program_->Pause();
+  return SendRealtime("!");
+}
+
+// A program may have sent its last line while paused, so this also
+// releases the hold of one that has ended
+int ShapeokoTinyGHub::ResumeProgram()
+{
+  if (program_ == 0 || !program_->IsPaused())
+    return DEVICE_OK;
+  int ret = SendRealtime("~");
+  if (ret != DEVICE_OK)
+    return ret;
+  program_->Resume();
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::AbortProgram()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG abort program");
+  if (!IsProgramRunning())
+    return DEVICE_OK;
+  return StopMotion();
+}
+
+bool ShapeokoTinyGHub::IsProgramRunning()
+{
+  return program_ != 0 && program_->IsActive();
+}
+
+// TinyG machine states: 1 ready, 2 alarm, 3 stop, 4 end, 5 run, 6 hold,
+// 7 probe, 8 cycle, 9 homing.  A held move has not finished yet.
+bool ShapeokoTinyGHub::IsMotionState(int state)
+{
+  return state >= 5 && state <= 9;
+}
+
+int ShapeokoTinyGHub::SendCommandNoResponse(const char* command, TinyGLane lane)
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG SendCommandNoResponse");
+  TinyGRequest request(lane, kRequestNoResponse, command);
+  return Execute(request);
+}
+
+// Scheduler thread.  Notes each line of the command as owed a response;
+// the scheduler writes one request at a time, so no command waiting for
+// its own response can have been written in between.
+int ShapeokoTinyGHub::ExpectResponses(const char* command)
+{
+  MMThreadGuard guard(statusLock_);
+  const char* line = command;
+  while (true)
+  {
+    const char* end = strchr(line, '\r');
+    unsigned len = (unsigned) (end != 0 ? end - line : strlen(line)) + 1;
+    if (linesWritten_ - linesAnswered_ >= kMaxUnanswered)
+      return ERR_COMMUNICATION;
+    unansweredLen_[linesWritten_ % kMaxUnanswered] = len;
+    ++linesWritten_;
+    unansweredBytes_ += len;
+    if (end == 0)
+      return DEVICE_OK;
+    line = end + 1;
+  }
+}
+
+// Reader thread.  Returns true if the response was owed to a line written
+// without waiting and has been consumed.
+bool ShapeokoTinyGHub::TakeResponse(const TinyGReport& report)
+{
+  MMThreadGuard guard(statusLock_);
+  if (linesAnswered_ == linesWritten_)
+    return false;
+  unansweredBytes_ -= unansweredLen_[linesAnswered_ % kMaxUnanswered];
+  ++linesAnswered_;
+  if (report.Has(TinyGReport::kFooter) && report.footerStatus != TINYG_STAT_OK &&
+      report.footerStatus != TINYG_STAT_NOOP && unansweredError_ == DEVICE_OK)
+  {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "TinyG error status " +
+        std::string(CDeviceUtils::ConvertToString(report.footerStatus)) + " for a streamed line");
+    unansweredError_ = ERR_CONTROLLER_STATUS;
+  }
+  return true;
+}
+
+unsigned long ShapeokoTinyGHub::GetUnansweredLines()
+{
+  MMThreadGuard guard(statusLock_);
+  return linesWritten_ - linesAnswered_;
+}
+
+unsigned long ShapeokoTinyGHub::GetUnansweredBytes()
+{
+  MMThreadGuard guard(statusLock_);
+  return unansweredBytes_;
+}
+
+int ShapeokoTinyGHub::TakeUnansweredError()
+{
+  MMThreadGuard guard(statusLock_);
+  int ret = unansweredError_;
+  unansweredError_ = DEVICE_OK;
+  return ret;
+}
+
+// False if some are still unanswered after timeoutMs
+bool ShapeokoTinyGHub::WaitForResponses(long timeoutMs)
+{
+  MM::MMTime deadline = GetCurrentMMTime() + MM::MMTime(timeoutMs * 1000.0);
+  while (true)
+  {
+    unsigned long seen = GetReportEvents();
+    if (GetUnansweredLines() == 0)
+      return true;
+    MM::MMTime now = GetCurrentMMTime();
+    if (now > deadline)
+      return false;
+    WaitForReportEvent(seen, (long) (deadline - now).getMsec() + 1);
+  }
+}
+
+
+int ShapeokoTinyGHub::SendConfigCommand(const char* command, string& answer)
+{
+  TinyGRequest request(kLaneConfig, kRequestCommand, command, kLatencySendConfigCommand, 10000);
+  int ret = Execute(request);
+  if (ret != DEVICE_OK)
+    return ret;
+  answer.assign(request.answer.text, request.answer.len);
+  return DEVICE_OK;
+}
+
+// Writes a command and returns in seq the response-line mark to read from.
+// Nothing is purged: earlier lines have already been consumed by the reader.
+int ShapeokoTinyGHub::WriteCommand(const char* command, unsigned long& seq)
+{
+  if (reader_ == 0)
+    return ERR_COMMUNICATION;
+  seq = reader_->LastLineSeq();
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "Write command.");
+  // command and terminator go out in one write from the stack; only a
+  // line too long for the buffer takes the core's string path
+  TinyGCommand line(command);
+  line.Append('\r');
+  TINYG_TRACE_EVENT(kTraceWrite, (long) strlen(command), 0.0, command);
+  int ret;
+  if (!line.Overflowed())
+    ret = WriteToComPortH((const unsigned char*) line.c_str(), line.size());
+  else
+    ret = SetCommandComPortH(command, "\r");
+  if (ret != DEVICE_OK)
+  {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "command write fail");
+    return ret;
+  }
+  return DEVICE_OK;
+}
+
+// Scheduler thread.  Urgent requests are written while the answer is
+// awaited, so that a stop does not wait for the exchange in progress: the
+// scheduler interrupts the wait when one is submitted.
+int ShapeokoTinyGHub::ReadAnswer(unsigned long& seq, TinyGLine& answer, long timeoutMs)
+{
+  if (reader_ == 0)
+    return ERR_COMMUNICATION;
+  MM::MMTime deadline = GetCurrentMMTime() + MM::MMTime(timeoutMs * 1000.0);
+  while (true)
+  {
+    if (scheduler_ != 0)
+      scheduler_->ServiceUrgent();
+    MM::MMTime now = GetCurrentMMTime();
+    long remainingMs = now < deadline ? (long) (deadline - now).getMsec() + 1 : 0;
+    int ret = reader_->WaitForLine(seq, answer, remainingMs);
+    if (ret != ERR_ANSWER_TIMEOUT || GetCurrentMMTime() > deadline)
+      return ret;
+  }
+}
+
+void ShapeokoTinyGHub::InterruptAnswerWait()
+{
+  if (reader_ != 0)
+    reader_->Interrupt();
+}
+
+unsigned long ShapeokoTinyGHub::GetReportEvents()
+{
+  ShapeokoTinyGMonitor::Guard guard(reportEvent_);
+  return reportEvents_;
+}
+
+// Blocks until a line newer than the count in seen has been dispatched,
+// or for at most timeoutMs
+void ShapeokoTinyGHub::WaitForReportEvent(unsigned long seen, long timeoutMs)
+{
+  MM::MMTime deadline = GetCurrentMMTime() + MM::MMTime(timeoutMs * 1000.0);
+  ShapeokoTinyGMonitor::Guard guard(reportEvent_);
+  while (reportEvents_ == seen)
+  {
+    MM::MMTime now = GetCurrentMMTime();
+    if (!(now < deadline))
+      return;
+    reportEvent_.Wait((long) (deadline - now).getMsec() + 1);
+  }
+}
+
+// Reads lines until one carries a footer, i.e. is the response to the
+// command just written, and checks the status code in it.
+int ShapeokoTinyGHub::ReadResponse(unsigned long& seq, TinyGLine& answer, TinyGReport& report, long timeoutMs)
+{
+  while (true)
+  {
+    int ret = ReadAnswer(seq, answer, timeoutMs);
+    if (ret == ERR_ANSWER_TIMEOUT)
+    {
+      // the response may still come, ahead of the next command's; give up
+      // on it kLateResponseMs after the first such timeout
+      if (lateResponses_ == 0)
+        lateResponseDeadline_ = GetCurrentMMTime() + MM::MMTime(kLateResponseMs * 1000.0);
+      ++lateResponses_;
+      lateResponseSeq_ = seq;
+    }
+    if (ret != DEVICE_OK)
+    {
+      TINYG_TRACE(TINYG_TRACE_ERROR, std::string("answer get error!_"));
+      return ret;
+    }
+    ParseTinyGJson(answer.text, answer.len, report);
+    if (report.Has(TinyGReport::kFooter))
+    {
+      if (lateResponses_ == 0)
+        break;
+      --lateResponses_;
+      TINYG_TRACE(TINYG_TRACE_INFO, std::string("Dropping a late response: ") + answer.text);
+      continue;
+    }
+    // echo, startup banner or other text
+    TINYG_TRACE(TINYG_TRACE_VERBOSE, std::string("Skipping line: ") + answer.text);
+  }
+  TINYG_TRACE_EVENT(kTraceResponse, report.footerStatus, 0.0, 0);
+  if (report.footerStatus != TINYG_STAT_OK && report.footerStatus != TINYG_STAT_NOOP)
+  {
+    TINYG_TRACE(TINYG_TRACE_ERROR, "Command failed with status " +
+        std::string(CDeviceUtils::ConvertToString(report.footerStatus)) + ": " + answer.text);
+    return ERR_CONTROLLER_STATUS;
+  }
+  return DEVICE_OK;
+}
+
+// Waits for a status report newer than statusSeq that shows the given
+// machine state.  Fails if no status report at all arrives within
+// idleTimeoutMs, so long moves are fine as long as reports keep coming.
+int ShapeokoTinyGHub::WaitForMachineState(unsigned long statusSeq, int state, long idleTimeoutMs)
+{
+  const MM::MMTime idle(idleTimeoutMs * 1000.0);
+  MM::MMTime deadline = GetCurrentMMTime() + idle;
+  while (GetCurrentMMTime() < deadline)
+  {
+    unsigned long seen = GetReportEvents();
+    {
+      MMThreadGuard guard(statusLock_);
+      if (statusSeq_ != statusSeq)
+      {
+        statusSeq = statusSeq_;
+        if (machineState_ == state)
+          return DEVICE_OK;
+        deadline = GetCurrentMMTime() + idle;
+      }
+    }
+    MM::MMTime now = GetCurrentMMTime();
+    if (now < deadline)
+      WaitForReportEvent(seen, (long) (deadline - now).getMsec() + 1);
+  }
+  return ERR_ANSWER_TIMEOUT;
+}
+
+// Like WaitForMachineState, for a hold or any state without motion
+int ShapeokoTinyGHub::WaitForHold(unsigned long statusSeq, long idleTimeoutMs)
+{
+  const MM::MMTime idle(idleTimeoutMs * 1000.0);
+  MM::MMTime deadline = GetCurrentMMTime() + idle;
+  while (GetCurrentMMTime() < deadline)
+  {
+    unsigned long seen = GetReportEvents();
+    {
+      MMThreadGuard guard(statusLock_);
+      if (statusSeq_ != statusSeq)
+      {
+        statusSeq = statusSeq_;
+        if (machineState_ == 6 || !IsMotionState(machineState_))
+          return DEVICE_OK;
+        deadline = GetCurrentMMTime() + idle;
+      }
+    }
+    MM::MMTime now = GetCurrentMMTime();
+    if (now < deadline)
+      WaitForReportEvent(seen, (long) (deadline - now).getMsec() + 1);
+  }
+  return ERR_ANSWER_TIMEOUT;
+}
+
+// Waits until IsMoving() is false.  Fails if the machine is still reported
+// moving and no status report has arrived for idleTimeoutMs.
+int ShapeokoTinyGHub::WaitForIdle(long idleTimeoutMs)
+{
+  const MM::MMTime idle(idleTimeoutMs * 1000.0);
+  while (true)
+  {
+    unsigned long seen = GetReportEvents();
+    if (!IsMoving())
+      return DEVICE_OK;
+    if (coalescer_ == 0 || !coalescer_->IsPending())
+    {
+      MMThreadGuard guard(statusLock_);
+      if (GetCurrentMMTime() - lastReportTime_ > idle)
+        return ERR_ANSWER_TIMEOUT;
+    }
+    // the jogger and the coalescer finish without a report of their own
+    WaitForReportEvent(seen, kStateRecheckMs);
+  }
+}
+
+// Waits until the move written last is done, as IsMachineMoving() sees it,
+// without the jogger or the coalescer.  Fails like WaitForIdle.
+int ShapeokoTinyGHub::WaitForMotionEnd(long idleTimeoutMs)
+{
+  const MM::MMTime idle(idleTimeoutMs * 1000.0);
+  while (true)
+  {
+    unsigned long seen = GetReportEvents();
+    if (!IsMachineMoving())
+      return DEVICE_OK;
+    {
+      MMThreadGuard guard(statusLock_);
+      if (GetCurrentMMTime() - lastReportTime_ > idle)
+        return ERR_ANSWER_TIMEOUT;
+    }
+    // IsMachineMoving() also gives up on a move after a silent second
+    WaitForReportEvent(seen, kStateRecheckMs);
+  }
+}
+
+// True if the last report has the axes in motionTargetAxes_ at
+// motionTarget_; called with statusLock_ held
+bool ShapeokoTinyGHub::IsMotionTargetReached() const
+{
+  // status reports carry positions to the micrometre
+  for (int i = 0; i < 3; ++i)
+    if ((motionTargetAxes_ & (1u << i)) && fabs(status_.pos[i] - motionTarget_[i]) > 0.001)
+      return false;
+  return true;
+}
+
+bool ShapeokoTinyGHub::DispatchLine(const char* line, unsigned len)
+{
+  TinyGReport report;
+  if (!ParseTinyGJson(line, len, report))
+    return false; // text, e.g. an echo; let the waiting command see it
+
+  if (report.Has(TinyGReport::kStatus) || report.Has(TinyGReport::kQueue))
+    ApplyReport(report);
+
+  // responses go on to the waiting command, unless a line written without
+  // waiting is owed one first; bare status and queue reports (and
+  // exception reports) stop here
+  bool consumed = true;
+  if (report.Has(TinyGReport::kResponse) || report.Has(TinyGReport::kFooter))
+    consumed = TakeResponse(report);
+  else
+    TINYG_TRACE(TINYG_TRACE_VERBOSE, line);
+
+  // the WaitFor* helpers look again at what they wait for
+  ShapeokoTinyGMonitor::Guard guard(reportEvent_);
+  ++reportEvents_;
+  reportEvent_.NotifyAll();
+  return consumed;
+}
+
+void ShapeokoTinyGHub::ApplyReport(const TinyGReport& report)
+{
+  bool lineChanged = false;
+  long line = 0;
+  {
+    MMThreadGuard guard(statusLock_);
+    lineChanged = ApplyReportLocked(report);
+    line = lineNumber_;
+  }
+  // outside statusLock_, so the listener may use the hub's getters
+  if (lineChanged)
+  {
+    MMThreadGuard guard(listenerLock_);
+    if (lineListener_ != 0)
+      lineListener_->OnLineReached(line);
+  }
+}
+
+// Returns true if the report moved the line number on
+bool ShapeokoTinyGHub::ApplyReportLocked(const TinyGReport& report)
+{
+  if (report.Has(TinyGReport::kQueue))
+  {
+    queueFree_ = report.queueFree;
+    TINYG_TRACE_EVENT(kTraceQueue, report.queueFree, 0.0, 0);
+  }
+  if (!report.Has(TinyGReport::kStatus))
+    return false;
+  // filtered status reports carry only the fields that changed
+  if (report.Has(TinyGReport::kPosX))
+    status_.pos[0] = report.pos[0];
+  if (report.Has(TinyGReport::kPosY))
+    status_.pos[1] = report.pos[1];
+  if (report.Has(TinyGReport::kPosZ))
+    status_.pos[2] = report.pos[2];
+  if (report.Has(TinyGReport::kVel))
+    status_.vel = report.vel;
+  if (report.Has(TinyGReport::kStat))
+    status_.stat = machineState_ = report.stat;
+  status_.valid = true;
+  statusCache_.Write(status_);
+  TINYG_TRACE_EVENT(kTraceStatus, status_.stat, status_.pos[0], 0);
+  bool lineChanged = report.Has(TinyGReport::kLine) && report.line != lineNumber_;
+  if (report.Has(TinyGReport::kLine))
+    lineNumber_ = report.line;
+  if (motionPending_ && motionAccepted_ && !IsMotionState(machineState_) && IsMotionTargetReached())
+    motionPending_ = false;
+  lastReportTime_ = GetCurrentMMTime();
+  TinyGPositionSample sample;
+  sample.time_us = lastReportTime_.getUsec();
+  for (int i = 0; i < 3; ++i)
+    sample.pos[i] = status_.pos[i];
+  sample.stat = status_.stat;
+  timeline_.Append(sample);
+  ++statusSeq_;
+  return lineChanged;
+}
+
+// private and expects caller to:
+// 1. guard the port
+// 2. purge the port
+int ShapeokoTinyGHub::GetStatus()
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG GetStatus");
+  TinyGRequest request(kLaneStatus, kRequestCommand, "{\"sr\":null}", kLatencyGetStatus, 1000);
+  int ret = Execute(request);
+  if (ret != DEVICE_OK)
+    return ret;
+  // DispatchLine has already copied the report into the status fields
+  if (!request.report.Has(TinyGReport::kStatus))
+  {
+    TINYG_TRACE(TINYG_TRACE_ERROR, std::string("No status report in answer: ") + request.answer.text);
+    return ERR_COMMUNICATION;
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGHub::ReadFromComPortH(unsigned char* answer, unsigned maxLen, unsigned long& bytesRead, long waitMs)
+{
+  bytesRead = 0;
+  if (transport_ == 0)
+    return ERR_NO_PORT_SET;
+  return transport_->Read(answer, maxLen, bytesRead, waitMs);
+}
+
+bool ShapeokoTinyGHub::IsTransportLost()
+{
+  return transport_ != 0 && transport_->IsLost();
+}
+int ShapeokoTinyGHub::SetCommandComPortH(const char* command, const char* term)
+{
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG SetCommandComPortH");
+  std::string line = std::string(command) + term;
+  return WriteToComPortH((const unsigned char*) line.c_str(), (unsigned) line.size());
+}
+MM::MMTime ShapeokoTinyGHub::GetCurrentMMTimeH()
+{
+  return GetCurrentMMTime();
+}
+
+void ShapeokoTinyGHub::StopReader()
+{
+  if (reader_ != 0)
+  {
+    reader_->Stop();
+    delete reader_;
+    reader_ = 0;
+  }
+}
+
+int ShapeokoTinyGHub::StartReader()
+{
+  if (reader_ == 0)
+    reader_ = new ShapeokoTinyGReader(this);
+  int ret = reader_->Start();
+  if (ret != DEVICE_OK)
+    return ret;
+  if (scheduler_ == 0)
+    scheduler_ = new ShapeokoTinyGScheduler(this);
+  return scheduler_->Start();
+}
+
+// Reads up to term a byte at a time; only for use while the reader thread
+// is stopped
+int ShapeokoTinyGHub::GetSerialAnswerComPortH (std::string& ans,  const char* term)
+{
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG GetSerialAnswerComPortH");
+  ans = "";
+  std::string terminator(term);
+  MM::MMTime deadline = GetCurrentMMTime() + MM::MMTime(2000 * 1000.0);
+  while (GetCurrentMMTime() < deadline)
+  {
+    unsigned char c;
+    unsigned long bytesRead = 0;
+    int ret = ReadFromComPortH(&c, 1, bytesRead, 10);
+    if (ret != DEVICE_OK)
+      return ret;
+    if (bytesRead == 0)
+      continue;
+    ans += (char) c;
+    if (ans.size() >= terminator.size() &&
+        ans.compare(ans.size() - terminator.size(), terminator.size(), terminator) == 0)
+    {
+      ans.erase(ans.size() - terminator.size());
+      return DEVICE_OK;
+    }
+  }
+  return ERR_ANSWER_TIMEOUT;
+}
+
+int ShapeokoTinyGHub::PurgeComPortH()
+{
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG PurgeComPortH");
+  return transport_ != 0 ? transport_->Purge() : ERR_NO_PORT_SET;
+}
+
+int ShapeokoTinyGHub::WriteToComPortH(const unsigned char* command, unsigned len)
+{
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG WriteToComPortH");
+  return transport_ != 0 ? transport_->Write(command, len) : ERR_NO_PORT_SET;
+}
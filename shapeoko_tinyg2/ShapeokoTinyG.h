@@ -32,10 +32,45 @@
 
 #include "DeviceBase.h"
 #include "DeviceThreads.h"
+#include "StatusCache.h"
+#include "PositionTimeline.h"
+#include "Latency.h"
+#include "Trace.h"
+#include "Scheduler.h"
 #include <string>
 #include <map>
+#include <vector>
 #include <algorithm>
 
+class ShapeokoTinyGReader;
+class ShapeokoTinyGStreamer;
+class ShapeokoTinyGCoalescer;
+class ShapeokoTinyGJogger;
+class ShapeokoTinyGHomer;
+class ShapeokoTinyGProgram;
+class ShapeokoTinyGTransport;
+class ShapeokoTinyGPoller;
+
+// Receives every new line number (N word) the controller reports, on the
+// hub's reader thread.  Implementations must be quick and must not send
+// commands.
+class TinyGLineListener
+{
+ public:
+  virtual ~TinyGLineListener() {}
+  virtual void OnLineReached(long line) = 0;
+};
+
+// Receives the measured position (mm, indexed X, Y, Z) on the hub's
+// status poller thread whenever it changes, throttled; axes is the mask
+// (TINYG_AXIS_*) of those that moved.  Must not wait for the hub.
+class TinyGPositionListener
+{
+ public:
+  virtual ~TinyGPositionListener() {}
+  virtual void OnPositionChanged(unsigned axes, const double* pos_mm) = 0;
+};
+
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
 //
@@ -54,6 +89,18 @@
 #define ERR_COMMUNICATION 107
 #define ERR_NO_PORT_SET 108
 #define ERR_VERSION_MISMATCH 109
+#define ERR_ANSWER_TIMEOUT 111
+#define ERR_CONTROLLER_STATUS 112
+#define ERR_HOMING_ABORTED 113
+#define ERR_POSITION_UNKNOWN_AT_TIME 114
+#define ERR_PROGRAM_FILE 115
+#define ERR_PROGRAM_LINE 116
+#define ERR_PROGRAM_ABORTED 117
+
+// axis masks for coordinated moves
+#define TINYG_AXIS_X 0x1
+#define TINYG_AXIS_Y 0x2
+#define TINYG_AXIS_Z 0x4
 
 
 ////////////////////////
@@ -76,38 +123,288 @@ class ShapeokoTinyGHub : public HubBase<ShapeokoTinyGHub>
   // property handlers
   int OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct);
   int OnPort(MM::PropertyBase* pPropt, MM::ActionType eAct);
+  int OnTransport(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnTransportAddress(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnTransportBaud(MM::PropertyBase* pProp, MM::ActionType pAct);
   int OnCommand(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnStatusInterval(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnCoalescingWindow(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnLatencyReport(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnBenchmarkIterations(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnBenchmark(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnTraceLevel(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnTraceRing(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnTraceDump(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnPositionUpdateInterval(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnIdlePollInterval(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnPositionClock(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnPositionQueryTime(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnPositionAtQueryTime(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnProgramFile(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnProgram(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnProgramStatus(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnProgramProgress(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnProgramLines(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnHome(MM::PropertyBase* pProp, MM::ActionType pAct);
+  int OnHomingStatus(MM::PropertyBase* pProp, MM::ActionType pAct);
 
   // HUB api
   int DetectInstalledDevices();
 
-  int SendConfigCommand(std::string command, std::string& answer);
-  int SendMotionCommand(std::string command);
-  int SendCommand(std::string command, std::string &returnString);
-  int SendCommandNoResponse(std::string command);
+  // The send functions take the command without its terminator and run it
+  // through the scheduler (see Scheduler.h), blocking until it is done.
+  // Those without a string answer do no heap allocation.
+  int SendConfigCommand(const char* command, std::string& answer);
+  // The motion commands take the axes the move ends on (TINYG_AXIS_*) and
+  // their targets, if known, so a stale report cannot end it early.
+  int SendMotionCommand(const char* command, unsigned axes = 0, const double* target_mm = 0);
+  int StartMotionCommand(const char* command, unsigned axes = 0, const double* target_mm = 0);
+  // Moves the axes in the mask (TINYG_AXIS_*) together to target_mm,
+  // indexed X, Y, Z.  With a coalescing window set, the move is merged with
+  // targets for other axes arriving within the window and sent from the
+  // background, so it never waits; Busy() covers the window.
+  // A feed rate (mm/min) above 0 makes it a G1 at that feed instead of a G0.
+  //
+  // A target arriving while the machine moves replaces the running move:
+  // the background thread holds the move, flushes it and sends the newest
+  // target, so bursts of targets collapse into one.  A target equal to the
+  // one last commanded is dropped.
+  int MoveAxes(unsigned axes, const double* target_mm, bool wait, double feed = 0.0);
+  // Sends one move for the axes in the mask right away
+  int SendAxesMove(unsigned axes, const double* target_mm, bool wait, double feed);
+  // Targets of the moves sent so far, per axis; returns the mask of axes
+  // that have one.  A move held short of them still counts, so that the
+  // move replacing it can send the axes it leaves out there again.
+  unsigned GetSentTargets(double* target_mm);
+  // Moves the axes in the mask by delta_mm with an incremental (G91) G0,
+  // past the coalescer, for short steps in tight loops such as autofocus.
+  // The move counts as running until a report shows the machine stopped at
+  // its end position, so a report from before it started cannot end it.
+  int MoveRelative(unsigned axes, const double* delta_mm, bool wait);
+
+  // Reads or writes a single numeric setting, e.g. "xvm"
+  int GetConfigValue(const char* key, double& value);
+  int SetConfigValue(const char* key, double value);
+  bool IsMoving();
+  // IsMoving() without targets still waiting in the coalescer
+  bool IsMachineMoving();
+  // Feedhold, then flush the planner: stops a running move early so that
+  // a new one can start from where the machine came to rest
+  int HoldAndFlush();
+  // Stops all motion now: feedhold and queue flush are written straight to
+  // the port, ahead of any command in flight, and streaming, jogging and
+  // pending moves are cancelled.  The hold is global, so it stops every
+  // axis.  Returns once the machine is at rest and the status refreshed.
+  int StopMotion();
+  int GetQueueFree();
+
+  // Continuous XY motion at vx, vy (mm/s) until StopJog(); calling again
+  // while jogging changes the velocity.  See Jog.h.
+  int Jog(double vx, double vy);
+  // Holds and flushes the queued jog segments
+  int StopJog();
+  bool IsJogging();
+
+  // Homes the axes in the mask with G28.2 in the background and returns at
+  // once.  IsMoving() stays true, and moves are refused, until it ends.
+  int StartHoming(unsigned axes);
+  bool IsHoming();
+  // Makes the current position of the axes in the mask their origin (G28.3)
+  // and zeroes them in the cached status, so readers see the new frame
+  // without waiting for a report
+  int SetOrigin(unsigned axes);
+  // Latest measured position and state from the automatic status reports.
+  // Lock-free and does no serial I/O, so it is cheap enough to call often.
+  void GetMachineStatus(TinyGMachineStatus& status) { statusCache_.Read(status); }
+  // Where the stage was at the given time on the GetCurrentMMTime() clock,
+  // interpolated from the recent status reports; see PositionTimeline.h.
+  // Lock-free like GetMachineStatus.  ERR_POSITION_UNKNOWN_AT_TIME if the
+  // time is too old, or still ahead of the reports while the stage moves.
+  int GetPositionAt(const MM::MMTime& time, TinyGPositionSample& sample);
+  // line number (N word) of the block the controller reported last
+  long GetLineNumber();
+  // First of count line numbers for a stream, on from every line reported
+  // or handed out before, so that no earlier report can be taken for one
+  // of the stream's lines
+  long ReserveStreamLines(long count);
+  // one listener at a time; pass 0 to remove it
+  void SetLineListener(TinyGLineListener* listener);
+  // Position listeners, fed by the status poller, see StatusPoller.h
+  void AddPositionListener(TinyGPositionListener* listener);
+  void RemovePositionListener(TinyGPositionListener* listener);
+  void NotifyPositionListeners(unsigned axes, const double* pos_mm);
+  // when the last status report arrived
+  MM::MMTime GetLastReportTime();
+  // the interval of the controller's own reports while moving; 0 when off
+  long GetStatusIntervalMs() const { return statusIntervalMs_; }
+
+  // Planner-fed streaming of G-code lines, see Streamer.h
+  int StreamCommands(const std::vector<std::string>& lines);
+  void StopStreaming();
+  // true while lines are streamed or a program runs
+  bool IsStreaming();
+
+  // Streams a G-code program file in the background, see Program.h.
+  // Pausing holds the motion; aborting stops it like StopMotion().
+  int StartProgram(const std::string& path);
+  int PauseProgram();
+  int ResumeProgram();
+  int AbortProgram();
+  bool IsProgramRunning();
+  // Lines written without waiting for their response are matched to the
+  // responses in the order they were written.  These count those still
+  // unanswered and the bytes they fill in the controller's receive buffer.
+  unsigned long GetUnansweredLines();
+  unsigned long GetUnansweredBytes();
+  // the first error answered to such a line since the last call
+  int TakeUnansweredError();
+  int SendCommand(const char* command, std::string &returnString);
+  int SendCommand(const char* command, TinyGLane lane = kLaneConfig);
+  // command may hold several lines separated by '\r'
+  int SendCommandNoResponse(const char* command, TinyGLane lane = kLaneConfig);
+  // Writes single-character commands such as "!" ahead of everything else
+  int SendRealtime(const char* chars);
+  // Queues a request and returns; WaitForRequest blocks until it is done
+  int SubmitRequest(TinyGRequest& request);
+  int WaitForRequest(TinyGRequest& request);
+  // Called by the scheduler thread to run one request
+  int ExecuteRequest(TinyGRequest& request);
+  // Called by the scheduler when an urgent request is queued, to end the
+  // scheduler thread's wait for an answer early
+  void InterruptAnswerWait();
   int SetAnswerTimeoutMs(double timout);
   MM::DeviceDetectionStatus DetectDevice(void);
+  // The *ComPortH functions go through the transport chosen with the
+  // "Transport" property, see Transport.h.  Only the scheduler thread
+  // writes once the hub is initialized.
   int PurgeComPortH();
   int WriteToComPortH(const unsigned char* command, unsigned len);
-  int ReadFromComPortH(unsigned char* answer, unsigned maxLen, unsigned long& bytesRead);
+  // waits up to waitMs for input if the transport can
+  int ReadFromComPortH(unsigned char* answer, unsigned maxLen, unsigned long& bytesRead, long waitMs = 0);
+  // true once the other end has closed the connection
+  bool IsTransportLost();
   int SetCommandComPortH(const char* command, const char* term);
   int GetSerialAnswerComPortH (std::string& ans,  const char* term);
   int GetStatus(); 
   int GetControllerVersion(std::string& version);
+  MM::MMTime GetCurrentMMTimeH();
+
+  // Called by the reader thread for every line received.  Returns true if
+  // the line was an unsolicited status or queue report and has been consumed.
+  bool DispatchLine(const char* line, unsigned len);
 
  private:
+  int OpenTransport();
+  void CloseTransport();
+  int StartReader();
+  void StopReader();
+  int Execute(TinyGRequest& request);
+  int WriteCommand(const char* command, unsigned long& seq);
+  int ConfigureStatusReports();
+  int ReadAnswer(unsigned long& seq, TinyGLine& answer, long timeoutMs);
+  int ReadResponse(unsigned long& seq, TinyGLine& answer, TinyGReport& report, long timeoutMs);
+  void ApplyReport(const TinyGReport& report);
+  bool ApplyReportLocked(const TinyGReport& report);
+  int WaitForMachineState(unsigned long statusSeq, int state, long idleTimeoutMs);
+  static bool IsMotionState(int state);
+  int WaitForHold(unsigned long statusSeq, long idleTimeoutMs);
+  int WaitForIdle(long idleTimeoutMs);
+  int ExecuteMotion(TinyGRequest& request, unsigned axes, const double* target_mm);
+  int WaitForMotionEnd(long idleTimeoutMs);
+  unsigned long GetReportEvents();
+  void WaitForReportEvent(unsigned long seen, long timeoutMs);
+  bool IsMotionTargetReached() const;
+  int FinishFlush(unsigned long statusSeq);
+  int ExpectResponses(const char* command);
+  bool TakeResponse(const TinyGReport& report);
+  bool WaitForResponses(long timeoutMs);
+  bool IsNoOpMove(unsigned axes, const double* target_mm);
+  void SetSentTargets(unsigned axes, const double* target_mm);
+  void ForgetSentTargets(unsigned axes);
+  void RecordLatency(TinyGLatencyPath path, int ret, const MM::MMTime& start, const MM::MMTime& written);
+  int RunBenchmark(long iterations);
+  void DumpTrace();
   void GetPeripheralInventory();
+  static std::string AxisNames(unsigned axes);
   std::vector<std::string> peripherals_;
   bool initialized_;
   bool busy_;
   std::string version_;
   MMThreadLock lock_;
-  MMThreadLock executeLock_;
   std::string port_;
   bool portAvailable_;
+  ShapeokoTinyGTransport* transport_;
+  std::string transportType_;
+  std::string transportAddress_;   // device path or host:port
+  long transportBaud_;
   std::string commandResult_;
-  double MPos[3];
-  double WPos[3];
+  ShapeokoTinyGReader* reader_;
+  ShapeokoTinyGScheduler* scheduler_;
+  ShapeokoTinyGStreamer* streamer_;
+  ShapeokoTinyGCoalescer* coalescer_;
+  ShapeokoTinyGJogger* jogger_;
+  ShapeokoTinyGHomer* homer_;
+  ShapeokoTinyGProgram* program_;
+  std::string programPath_;
+  // last target sent per axis, for axes set in lastTargetAxes_; written by
+  // callers and by the coalescer thread
+  MMThreadLock targetLock_;
+  double lastTarget_[3];
+  unsigned lastTargetAxes_;
+  long coalescingWindowMs_;
+  // Scheduler thread only: responses owed to commands that timed out, and
+  // the response line they had read up to
+  unsigned lateResponses_;
+  unsigned long lateResponseSeq_;
+  MM::MMTime lateResponseDeadline_;
+  enum { kLateResponseMs = 5000 };
+  // counts the JSON lines dispatched, and is signalled with each, for the
+  // WaitFor* helpers to block on
+  ShapeokoTinyGMonitor reportEvent_;
+  unsigned long reportEvents_;
+  // state that changes without a report is looked at again this often
+  enum { kStateRecheckMs = 10 };
+  // guards the status fields below, which the reader thread updates
+  MMThreadLock statusLock_;
+  int machineState_;
+  unsigned long statusSeq_;
+  // lengths, terminator included, of the lines written without waiting
+  // for their response, indexed by count modulo kMaxUnanswered
+  enum { kMaxUnanswered = 256 };
+  unsigned unansweredLen_[kMaxUnanswered];
+  unsigned long linesWritten_;
+  unsigned long linesAnswered_;
+  unsigned long unansweredBytes_;
+  int unansweredError_;
+  int queueFree_;
+  long lineNumber_;
+  // one past the last line number handed out by ReserveStreamLines
+  long streamLineEnd_;
+  // held while the listener runs, so it cannot be removed mid-call
+  MMThreadLock listenerLock_;
+  TinyGLineListener* lineListener_;
+  // held while the position listeners run, like listenerLock_
+  MMThreadLock positionLock_;
+  std::vector<TinyGPositionListener*> positionListeners_;
+  ShapeokoTinyGPoller* poller_;
+  // set when a move is written, cleared by the first status report after
+  // the controller accepted it (motionAccepted_) that shows the machine
+  // stopped, and for the axes in motionTargetAxes_ at motionTarget_
+  bool motionPending_;
+  bool motionAccepted_;
+  unsigned motionTargetAxes_;
+  double motionTarget_[3];
+  MM::MMTime lastReportTime_;
+  // the reader thread's running copy of the status, merged from filtered
+  // reports and published through statusCache_
+  TinyGMachineStatus status_;
+  ShapeokoTinyGStatusCache statusCache_;
+  // every report's merged status, also written by the reader thread only
+  ShapeokoTinyGTimeline timeline_;
+  double positionQueryMs_;
+  long statusIntervalMs_;
+  ShapeokoTinyGLatency latency_;
+  long benchmarkIterations_;
 };
 
 
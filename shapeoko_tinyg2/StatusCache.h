@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StatusCache.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Seqlock-protected copy of the latest TinyG status report.
+//                The hub's reader thread is the only writer; any thread can
+//                read without taking a lock or touching the serial port.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_STATUSCACHE_H_
+#define _SHAPEOKO_TINYG_STATUSCACHE_H_
+
+#ifdef _MSC_VER
+// x86 and x64 keep stores and loads in order; only the compiler must not
+#include <intrin.h>
+#define TINYG_MEMORY_BARRIER() _ReadWriteBarrier()
+#else
+#define TINYG_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+struct TinyGMachineStatus
+{
+  bool valid;       // false until the first status report arrives
+  double pos[3];    // measured work position, mm
+  double vel;       // mm/min
+  int stat;         // machine state
+};
+
+class ShapeokoTinyGStatusCache
+{
+ public:
+  ShapeokoTinyGStatusCache() : seq_(0)
+  {
+    data_.valid = false;
+    data_.pos[0] = data_.pos[1] = data_.pos[2] = 0.0;
+    data_.vel = 0.0;
+    data_.stat = 0;
+  }
+
+  // Single writer only.  An odd sequence number marks a write in progress.
+  void Write(const TinyGMachineStatus& status)
+  {
+    seq_ = seq_ + 1;
+    TINYG_MEMORY_BARRIER();
+    data_ = status;
+    TINYG_MEMORY_BARRIER();
+    seq_ = seq_ + 1;
+  }
+
+  // Retries until it gets a copy no write overlapped.
+  void Read(TinyGMachineStatus& status) const
+  {
+    unsigned long before, after;
+    do
+    {
+      before = seq_;
+      TINYG_MEMORY_BARRIER();
+      status = data_;
+      TINYG_MEMORY_BARRIER();
+      after = seq_;
+    } while (before != after || (before & 1) != 0);
+  }
+
+ private:
+  volatile unsigned long seq_;
+  TinyGMachineStatus data_;
+};
+
+#endif // _SHAPEOKO_TINYG_STATUSCACHE_H_
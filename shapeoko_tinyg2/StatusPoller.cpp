@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StatusPoller.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Position service for the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ShapeokoTinyG.h"
+#include "StatusPoller.h"
+#include <math.h>
+
+namespace {
+
+// position changes smaller than this, in mm, are not worth a notification
+const double kPositionEpsilon = 1e-5;
+
+} // namespace
+
+ShapeokoTinyGPoller::ShapeokoTinyGPoller(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    running_(false),
+    stop_(false),
+    updateIntervalMs_(100),
+    idlePollMs_(2000),
+    notified_(false)
+{
+  notifiedPos_[0] = notifiedPos_[1] = notifiedPos_[2] = 0.0;
+}
+
+ShapeokoTinyGPoller::~ShapeokoTinyGPoller()
+{
+  Stop();
+}
+
+int ShapeokoTinyGPoller::Start()
+{
+  if (running_)
+    return DEVICE_OK;
+  stop_ = false;
+  notified_ = false;
+  lastPoll_ = hub_->GetCurrentMMTimeH();
+  lastNotify_ = lastPoll_;
+  running_ = true;
+  if (activate() != 0)
+  {
+    running_ = false;
+    return DEVICE_ERR;
+  }
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGPoller::Stop()
+{
+  if (!running_)
+    return;
+  stop_ = true;
+  wait();
+  running_ = false;
+}
+
+int ShapeokoTinyGPoller::svc()
+{
+  while (!stop_)
+  {
+    MM::MMTime now = hub_->GetCurrentMMTimeH();
+    bool moving = hub_->IsMachineMoving();
+    Poll(now, moving);
+    Notify(now, moving);
+    CDeviceUtils::SleepMs(kTickMs);
+  }
+  return 0;
+}
+
+// Asks for a report if neither the controller nor an earlier poll has
+// produced one recently enough.  While moving the controller pushes one
+// every status interval, so a poll then only stands in for missed ones.
+void ShapeokoTinyGPoller::Poll(const MM::MMTime& now, bool moving)
+{
+  long intervalMs = idlePollMs_;
+  if (moving)
+  {
+    long statusIntervalMs = hub_->GetStatusIntervalMs();
+    intervalMs = statusIntervalMs > 0 ? 2 * statusIntervalMs : updateIntervalMs_;
+  }
+  if (intervalMs <= 0)
+    return;
+  MM::MMTime last = hub_->GetLastReportTime();
+  if (lastPoll_ > last)
+    last = lastPoll_;
+  if (now - last < MM::MMTime(intervalMs * 1000.0))
+    return;
+  // a failed poll is retried after another interval, not on every tick
+  lastPoll_ = now;
+  hub_->GetStatus();
+}
+
+void ShapeokoTinyGPoller::Notify(const MM::MMTime& now, bool moving)
+{
+  if (updateIntervalMs_ <= 0)
+    return;
+  TinyGMachineStatus status;
+  hub_->GetMachineStatus(status);
+  if (!status.valid)
+    return;
+  unsigned changed = 0;
+  for (int i = 0; i < 3; ++i)
+    if (!notified_ || fabs(status.pos[i] - notifiedPos_[i]) > kPositionEpsilon)
+      changed |= 1u << i;
+  if (changed == 0)
+    return;
+  // the position the machine stops at is always passed on at once
+  if (moving && notified_ && now - lastNotify_ < MM::MMTime(updateIntervalMs_ * 1000.0))
+    return;
+  for (int i = 0; i < 3; ++i)
+    notifiedPos_[i] = status.pos[i];
+  notified_ = true;
+  lastNotify_ = now;
+  hub_->NotifyPositionListeners(changed, status.pos);
+}
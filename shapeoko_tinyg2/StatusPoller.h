@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StatusPoller.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Position service for the ShapeokoTinyG hub.  While the
+//                machine moves, the controller's automatic status reports
+//                keep the hub's status current; the poller asks for a
+//                report itself only when they stop coming, and rarely
+//                while the machine is idle.  It hands
+//                every position change, at most once per update interval
+//                and always once the machine stops, to the hub's position
+//                listeners, which the stages use for their position-changed
+//                notifications.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_STATUSPOLLER_H_
+#define _SHAPEOKO_TINYG_STATUSPOLLER_H_
+
+#include "MMDevice.h"
+#include "DeviceThreads.h"
+
+class ShapeokoTinyGHub;
+
+class ShapeokoTinyGPoller : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGPoller(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGPoller();
+
+  int Start();
+  void Stop();
+  bool IsRunning() const { return running_; }
+
+  // Shortest time between notifications; 0 stops them.  Also the longest
+  // time without a report while moving if the controller's automatic
+  // reports are off.
+  void SetUpdateIntervalMs(long ms) { updateIntervalMs_ = ms; }
+  long GetUpdateIntervalMs() const { return updateIntervalMs_; }
+  // Longest time without a report while idle; 0 never polls when idle
+  void SetIdlePollMs(long ms) { idlePollMs_ = ms; }
+  long GetIdlePollMs() const { return idlePollMs_; }
+
+  int svc();
+
+ private:
+  enum { kTickMs = 5 };
+
+  void Poll(const MM::MMTime& now, bool moving);
+  void Notify(const MM::MMTime& now, bool moving);
+
+  ShapeokoTinyGHub* hub_;
+  volatile bool running_;
+  volatile bool stop_;
+  volatile long updateIntervalMs_;
+  volatile long idlePollMs_;
+
+  // poller thread only
+  MM::MMTime lastPoll_;
+  MM::MMTime lastNotify_;
+  bool notified_;
+  double notifiedPos_[3];
+};
+
+#endif // _SHAPEOKO_TINYG_STATUSPOLLER_H_
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Streamer.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Planner-aware G-code streaming for the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ShapeokoTinyG.h"
+#include "Streamer.h"
+
+ShapeokoTinyGStreamer::ShapeokoTinyGStreamer(ShapeokoTinyGHub* hub) :
+    hub_(hub),
+    active_(false),
+    stop_(false),
+    joinable_(false),
+    sent_(0),
+    result_(DEVICE_OK)
+{
+}
+
+ShapeokoTinyGStreamer::~ShapeokoTinyGStreamer()
+{
+  Stop();
+}
+
+int ShapeokoTinyGStreamer::Start(const std::vector<std::string>& lines)
+{
+  if (active_)
+    return ERR_STAGE_MOVING;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  lines_ = lines;
+  sent_ = 0;
+  result_ = DEVICE_OK;
+  stop_ = false;
+
+  // the queue report tells us how much of the planner is free right now;
+  // after this the reader keeps it current from the {"qr":n} reports
+  int ret = hub_->SendCommand("{\"qr\":null}", kLaneStatus);
+  if (ret != DEVICE_OK)
+    return ret;
+
+  active_ = true;
+  if (activate() != 0)
+  {
+    active_ = false;
+    return DEVICE_ERR;
+  }
+  joinable_ = true;
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGStreamer::Stop()
+{
+  stop_ = true;
+  if (joinable_)
+  {
+    wait();
+    joinable_ = false;
+  }
+  active_ = false;
+}
+
+int ShapeokoTinyGStreamer::svc()
+{
+  for (std::vector<std::string>::const_iterator line = lines_.begin(); line != lines_.end(); ++line)
+  {
+    if (!WaitForQueueSpace())
+      break;
+    int ret = hub_->SendCommand(line->c_str(), kLaneMotion);
+    if (ret != DEVICE_OK)
+    {
+      result_ = ret;
+      break;
+    }
+    ++sent_;
+  }
+  active_ = false;
+  return 0;
+}
+
+// The planner refills as moves complete, which for a long move can take as
+// long as the move itself, so there is no timeout here; Stop() ends the wait.
+bool ShapeokoTinyGStreamer::WaitForQueueSpace()
+{
+  while (!stop_)
+  {
+    if (hub_->GetQueueFree() > kReservedBuffers)
+      return true;
+    CDeviceUtils::SleepMs(1);
+  }
+  return false;
+}
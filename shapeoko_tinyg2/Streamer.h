@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Streamer.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Feeds a list of G-code lines into TinyG's planner from a
+//                background thread.  Queue reports decide when the next line
+//                may go, so the planner neither runs dry nor overflows and
+//                consecutive moves blend on the controller.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_STREAMER_H_
+#define _SHAPEOKO_TINYG_STREAMER_H_
+
+#include "DeviceThreads.h"
+#include <string>
+#include <vector>
+
+class ShapeokoTinyGHub;
+
+class ShapeokoTinyGStreamer : public MMDeviceThreadBase
+{
+ public:
+  ShapeokoTinyGStreamer(ShapeokoTinyGHub* hub);
+  ~ShapeokoTinyGStreamer();
+
+  // Starts streaming a copy of lines.  Fails if a stream is still running.
+  int Start(const std::vector<std::string>& lines);
+  // Stops feeding the planner; moves already queued still run.
+  void Stop();
+  // Asks the thread to stop without waiting for it, for use where a
+  // blocked send must not delay the caller; Stop() still has to join it
+  void RequestStop() { stop_ = true; }
+  bool IsActive() const { return active_; }
+  unsigned long LinesSent() const { return sent_; }
+  unsigned long LinesTotal() const { return (unsigned long) lines_.size(); }
+  // DEVICE_OK, or the error that ended the last stream
+  int GetResult() const { return result_; }
+
+  int svc();
+
+ private:
+  // planner buffers left free so commands sent outside the stream still fit
+  enum { kReservedBuffers = 4 };
+
+  bool WaitForQueueSpace();
+
+  ShapeokoTinyGHub* hub_;
+  std::vector<std::string> lines_;
+  volatile bool active_;
+  volatile bool stop_;
+  bool joinable_;
+  volatile unsigned long sent_;
+  int result_;
+};
+
+#endif // _SHAPEOKO_TINYG_STREAMER_H_
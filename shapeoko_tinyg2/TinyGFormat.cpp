@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TinyGFormat.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Allocation-free command building for the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TinyGFormat.h"
+#include <cstdio>
+#include <cstring>
+#include <math.h>
+
+namespace {
+
+const unsigned long kPow10[] = {
+  1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL,
+  1000000UL, 10000000UL, 100000000UL, 1000000000UL
+};
+
+// Writes the decimal digits of value and returns the count
+unsigned FormatUnsigned(char* buff, unsigned long value)
+{
+  char digits[12];
+  unsigned n = 0;
+  do
+  {
+    digits[n++] = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  for (unsigned i = 0; i < n; ++i)
+    buff[i] = digits[n - 1 - i];
+  return n;
+}
+
+} // namespace
+
+unsigned TinyGFormatFixed(char* buff, double value, int decimals)
+{
+  if (decimals < 0)
+    decimals = 0;
+  if (decimals > 9)
+    decimals = 9;
+  if (!(fabs(value) < 1e9))
+    return (unsigned) sprintf(buff, "%.*e", decimals, value);
+
+  bool negative = value < 0.0;
+  double v = negative ? -value : value;
+  // both parts fit in 32 bits: the integer part is below 1e9 and the
+  // fraction is scaled by at most 1e9
+  unsigned long whole = (unsigned long) v;
+  unsigned long scale = kPow10[decimals];
+  unsigned long frac = (unsigned long) ((v - whole) * scale + 0.5);
+  if (frac >= scale)
+  {
+    ++whole;
+    frac -= scale;
+  }
+  if (whole == 0 && frac == 0)
+    negative = false;
+
+  char* p = buff;
+  if (negative)
+    *p++ = '-';
+  p += FormatUnsigned(p, whole);
+  if (decimals > 0)
+  {
+    *p++ = '.';
+    for (int i = decimals - 1; i >= 0; --i)
+    {
+      p[i] = (char) ('0' + frac % 10);
+      frac /= 10;
+    }
+    p += decimals;
+  }
+  *p = '\0';
+  return (unsigned) (p - buff);
+}
+
+TinyGCommand& TinyGCommand::Append(const char* text)
+{
+  return Append(text, (unsigned) strlen(text));
+}
+
+TinyGCommand& TinyGCommand::Append(const char* text, unsigned len)
+{
+  if (overflow_ || len_ + len >= kCapacity)
+  {
+    overflow_ = true;
+    return *this;
+  }
+  memcpy(text_ + len_, text, len);
+  len_ += len;
+  text_[len_] = '\0';
+  return *this;
+}
+
+TinyGCommand& TinyGCommand::Append(char c)
+{
+  return Append(&c, 1);
+}
+
+TinyGCommand& TinyGCommand::AppendLong(long value)
+{
+  char buff[kTinyGNumberChars];
+  unsigned len = 0;
+  unsigned long magnitude = (unsigned long) value;
+  if (value < 0)
+  {
+    buff[len++] = '-';
+    magnitude = 0UL - magnitude;
+  }
+  len += FormatUnsigned(buff + len, magnitude);
+  return Append(buff, len);
+}
+
+TinyGCommand& TinyGCommand::AppendFixed(double value, int decimals)
+{
+  char buff[kTinyGNumberChars];
+  unsigned len = TinyGFormatFixed(buff, value, decimals);
+  return Append(buff, len);
+}
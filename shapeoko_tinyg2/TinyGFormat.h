@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TinyGFormat.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Allocation-free command building for the ShapeokoTinyG hub.
+//                Commands are assembled in a fixed buffer on the caller's
+//                stack and numbers are formatted without sprintf, so a move
+//                and its response cost no heap allocations.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_FORMAT_H_
+#define _SHAPEOKO_TINYG_FORMAT_H_
+
+// room needed by TinyGFormatFixed, terminator included
+enum { kTinyGNumberChars = 32 };
+
+// Writes value with a fixed number of decimals (0 to 9) into buff and
+// returns the length.  For |value| < 1e9 this matches "%.*f" except within
+// a rounding error of a half-way point, and prints no "-0"; larger values
+// and NaN are written in exponent form.
+unsigned TinyGFormatFixed(char* buff, double value, int decimals);
+
+// Fixed-capacity command line.  An append that does not fit is dropped,
+// along with any after it, and Overflowed() says so.
+class TinyGCommand
+{
+ public:
+  enum { kCapacity = 256 };
+
+  TinyGCommand() { Clear(); }
+  explicit TinyGCommand(const char* text) { Clear(); Append(text); }
+
+  void Clear() { len_ = 0; overflow_ = false; text_[0] = '\0'; }
+  TinyGCommand& Append(const char* text);
+  TinyGCommand& Append(const char* text, unsigned len);
+  TinyGCommand& Append(char c);
+  TinyGCommand& AppendLong(long value);
+  TinyGCommand& AppendFixed(double value, int decimals);
+
+  const char* c_str() const { return text_; }
+  unsigned size() const { return len_; }
+  bool Overflowed() const { return overflow_; }
+
+ private:
+  char text_[kCapacity];
+  unsigned len_;
+  bool overflow_;
+};
+
+#endif // _SHAPEOKO_TINYG_FORMAT_H_
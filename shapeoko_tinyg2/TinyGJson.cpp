@@ -0,0 +1,289 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TinyGJson.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Parser for TinyG JSON mode lines.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TinyGJson.h"
+#include <cstdlib>
+#include <cstring>
+
+void TinyGReport::Clear()
+{
+  parts = 0;
+  footerStatus = TINYG_STAT_OK;
+  footerRxCount = 0;
+  queueFree = 0;
+  firmwareVersion = 0.0;
+  value = 0.0;
+  pos[0] = pos[1] = pos[2] = 0.0;
+  vel = 0.0;
+  stat = 0;
+  line = 0;
+}
+
+namespace {
+
+// where in the document a value sits; decides what its keys mean
+enum Scope { kTop, kResponse, kStatusReport, kFooter, kIgnored };
+
+// TinyG keys are short; longer ones are truncated, which is harmless since
+// they never match anything we look for
+const unsigned kMaxKey = 8;
+
+// Lines nested deeper than this are rejected rather than recursed into
+const int kMaxDepth = 8;
+
+class Parser
+{
+ public:
+  Parser(const char* line, unsigned len, TinyGReport& report) :
+      p_(line), end_(line + len), report_(report)
+  {}
+
+  bool Parse()
+  {
+    SkipSpace();
+    if (p_ >= end_ || *p_ != '{')
+      return false;
+    return ParseObject(kTop, 0);
+  }
+
+ private:
+  void SkipSpace()
+  {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t'))
+      ++p_;
+  }
+
+  bool Expect(char c)
+  {
+    SkipSpace();
+    if (p_ >= end_ || *p_ != c)
+      return false;
+    ++p_;
+    return true;
+  }
+
+  // copies at most kMaxKey characters of a string; p_ is left past the quote
+  bool ParseString(char* key, unsigned& keyLen)
+  {
+    if (!Expect('"'))
+      return false;
+    keyLen = 0;
+    while (p_ < end_ && *p_ != '"')
+    {
+      if (*p_ == '\\' && p_ + 1 < end_)
+        ++p_;
+      if (key != 0 && keyLen < kMaxKey)
+        key[keyLen++] = *p_;
+      ++p_;
+    }
+    if (p_ >= end_)
+      return false;
+    ++p_;
+    return true;
+  }
+
+  bool ParseNumber(double& value)
+  {
+    SkipSpace();
+    char* stop;
+    value = strtod(p_, &stop);
+    if (stop == p_ || stop > end_)
+      return false;
+    p_ = stop;
+    return true;
+  }
+
+  // true, false and null carry nothing we use
+  bool SkipLiteral()
+  {
+    if (*p_ != 't' && *p_ != 'f' && *p_ != 'n')
+      return false;
+    while (p_ < end_ && *p_ >= 'a' && *p_ <= 'z')
+      ++p_;
+    return true;
+  }
+
+  static bool KeyIs(const char* key, unsigned keyLen, const char* name)
+  {
+    return strlen(name) == keyLen && strncmp(key, name, keyLen) == 0;
+  }
+
+  bool ParseObject(Scope scope, int depth)
+  {
+    if (!Expect('{'))
+      return false;
+    SkipSpace();
+    if (p_ < end_ && *p_ == '}')
+    {
+      ++p_;
+      return true;
+    }
+    while (true)
+    {
+      char key[kMaxKey];
+      unsigned keyLen;
+      if (!ParseString(key, keyLen) || !Expect(':'))
+        return false;
+      if (!ParseMember(scope, key, keyLen, depth))
+        return false;
+      SkipSpace();
+      if (p_ < end_ && *p_ == ',')
+      {
+        ++p_;
+        continue;
+      }
+      return Expect('}');
+    }
+  }
+
+  bool ParseMember(Scope scope, const char* key, unsigned keyLen, int depth)
+  {
+    SkipSpace();
+    if (p_ >= end_)
+      return false;
+    if (*p_ == '{')
+    {
+      Scope inner = kIgnored;
+      if (scope == kTop && KeyIs(key, keyLen, "r"))
+      {
+        report_.parts |= TinyGReport::kResponse;
+        inner = kResponse;
+      }
+      else if ((scope == kTop || scope == kResponse) && KeyIs(key, keyLen, "sr"))
+      {
+        report_.parts |= TinyGReport::kStatus;
+        inner = kStatusReport;
+      }
+      if (depth >= kMaxDepth)
+        return false;
+      return ParseObject(inner, depth + 1);
+    }
+    if (*p_ == '[')
+    {
+      Scope inner = (scope == kTop && KeyIs(key, keyLen, "f")) ? kFooter : kIgnored;
+      return ParseArray(inner, depth + 1);
+    }
+    if (*p_ == '"')
+      return ParseString(0, keyLen);
+    if (SkipLiteral())
+      return true;
+
+    double value;
+    if (!ParseNumber(value))
+      return false;
+    if (scope == kStatusReport)
+    {
+      if (KeyIs(key, keyLen, "posx"))      { report_.pos[0] = value; report_.parts |= TinyGReport::kPosX; }
+      else if (KeyIs(key, keyLen, "posy")) { report_.pos[1] = value; report_.parts |= TinyGReport::kPosY; }
+      else if (KeyIs(key, keyLen, "posz")) { report_.pos[2] = value; report_.parts |= TinyGReport::kPosZ; }
+      else if (KeyIs(key, keyLen, "vel"))  { report_.vel = value; report_.parts |= TinyGReport::kVel; }
+      else if (KeyIs(key, keyLen, "stat")) { report_.stat = (int) value; report_.parts |= TinyGReport::kStat; }
+      else if (KeyIs(key, keyLen, "line")) { report_.line = (long) value; report_.parts |= TinyGReport::kLine; }
+    }
+    else if ((scope == kTop || scope == kResponse) && KeyIs(key, keyLen, "qr"))
+    {
+      report_.queueFree = (int) value;
+      report_.parts |= TinyGReport::kQueue;
+    }
+    else if (scope == kResponse && KeyIs(key, keyLen, "fv"))
+    {
+      report_.firmwareVersion = value;
+      report_.parts |= TinyGReport::kVersion;
+    }
+    else if (scope == kResponse && !report_.Has(TinyGReport::kValue))
+    {
+      report_.value = value;
+      report_.parts |= TinyGReport::kValue;
+    }
+    return true;
+  }
+
+  bool ParseArray(Scope scope, int depth)
+  {
+    if (!Expect('['))
+      return false;
+    SkipSpace();
+    if (p_ < end_ && *p_ == ']')
+    {
+      ++p_;
+      return true;
+    }
+    if (depth > kMaxDepth)
+      return false;
+    for (int index = 0; ; ++index)
+    {
+      SkipSpace();
+      if (p_ >= end_)
+        return false;
+      if (*p_ == '{')
+      {
+        if (!ParseObject(kIgnored, depth + 1))
+          return false;
+      }
+      else if (*p_ == '[')
+      {
+        if (!ParseArray(kIgnored, depth + 1))
+          return false;
+      }
+      else if (*p_ == '"')
+      {
+        unsigned len;
+        if (!ParseString(0, len))
+          return false;
+      }
+      else if (!SkipLiteral())
+      {
+        double value;
+        if (!ParseNumber(value))
+          return false;
+        // footer: [protocol revision, status code, rx count, checksum]
+        if (scope == kFooter)
+        {
+          if (index == 1)
+            report_.footerStatus = (int) value;
+          else if (index == 2)
+            report_.footerRxCount = (int) value;
+        }
+      }
+      SkipSpace();
+      if (p_ < end_ && *p_ == ',')
+      {
+        ++p_;
+        continue;
+      }
+      if (!Expect(']'))
+        return false;
+      if (scope == kFooter)
+        report_.parts |= TinyGReport::kFooter;
+      return true;
+    }
+  }
+
+  const char* p_;
+  const char* end_;
+  TinyGReport& report_;
+};
+
+} // namespace
+
+bool ParseTinyGJson(const char* line, unsigned len, TinyGReport& report)
+{
+  report.Clear();
+  Parser parser(line, len, report);
+  return parser.Parse();
+}
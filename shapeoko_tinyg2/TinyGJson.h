@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TinyGJson.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Parser for the lines TinyG sends in JSON mode: responses
+//                {"r":{...},"f":[...]}, status reports {"sr":{...}} and
+//                queue reports {"qr":n}.  Works in a single pass over the
+//                line and writes straight into a TinyGReport; it never
+//                allocates.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_JSON_H_
+#define _SHAPEOKO_TINYG_JSON_H_
+
+// TinyG status codes found in the second element of a footer
+#define TINYG_STAT_OK     0
+#define TINYG_STAT_NOOP   3
+
+struct TinyGReport
+{
+  // parts of the line that were present
+  enum {
+    kResponse = 0x0001,   // "r" object
+    kFooter   = 0x0002,   // "f" array
+    kStatus   = 0x0004,   // "sr" object, bare or inside "r"
+    kQueue    = 0x0008,   // "qr" value, bare or inside "r"
+    kVersion  = 0x0010,   // "fv" inside "r"
+    kValue    = 0x0020,   // first other number inside "r", e.g. {"xvm":...}
+    kPosX     = 0x0100,   // status report fields
+    kPosY     = 0x0200,
+    kPosZ     = 0x0400,
+    kVel      = 0x0800,
+    kStat     = 0x1000,
+    kLine     = 0x2000
+  };
+
+  void Clear();
+  bool Has(unsigned part) const { return (parts & part) != 0; }
+
+  unsigned parts;
+  int footerStatus;       // f[1]
+  int footerRxCount;      // f[2]
+  int queueFree;          // free planner buffers
+  double firmwareVersion;
+  double value;           // see kValue
+  double pos[3];          // work position, mm
+  double vel;             // mm/min
+  int stat;               // machine state
+  long line;              // last executed line number
+};
+
+// Parses one NUL terminated line.  Returns false if the line is not a JSON
+// object; fields found before a syntax error are kept.
+bool ParseTinyGJson(const char* line, unsigned len, TinyGReport& report);
+
+#endif // _SHAPEOKO_TINYG_JSON_H_
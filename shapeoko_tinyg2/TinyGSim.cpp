@@ -0,0 +1,928 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TinyGSim.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Simulated TinyG controller behind a Linux pseudo-terminal,
+//                for exercising the ShapeokoTinyG adapter without hardware.
+//                Point the Micro-Manager serial port (or anything else) at
+//                the slave device it prints on startup.  With -t it
+//                serves one TCP client at a time on localhost instead, as a
+//                stand-in for a networked serial server.
+//
+//                Understands text mode ($ee, $tv, $fv, $sr, $$, $ej) and
+//                JSON mode ({"ej":..}, {"sr":..}, {"qr":..}, {"fv":..} and
+//                the other single-key settings), G0/G1/G4/G90/G91 with N
+//                line numbers, and the single character commands ! % ~.
+//                Moves run through a 28 entry planner with a trapezoidal
+//                velocity profile; output is paced at the configured baud
+//                rate and input is not read while the planner is full,
+//                as on the real board.
+//
+//                Usage: tinyg_sim [-b baud] [-r rapid mm/min]
+//                                 [-a accel mm/s^2] [-l symlink] [-t port]
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+const int kPlannerBuffers = 28;
+const double kFirmwareVersion = 0.970;
+
+// TinyG machine states
+enum { STAT_READY = 1, STAT_STOP = 3, STAT_RUN = 5, STAT_HOLD = 6 };
+
+// TinyG status codes
+enum { SC_OK = 0, SC_UNRECOGNIZED_COMMAND = 40, SC_INPUT_VALUE_RANGE = 102 };
+
+volatile bool g_quit = false;
+
+void OnSignal(int)
+{
+  g_quit = true;
+}
+
+double Now()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Block
+{
+  double target[3];  // mm
+  double feed;       // mm/min
+  double dwell;      // s, for G4
+  long line;
+};
+
+// One block in execution: a rest-to-rest trapezoid, or a dwell
+struct Segment
+{
+  bool active;
+  double start[3];
+  double unit[3];
+  double length;     // mm
+  double vmax;       // mm/s actually reached
+  double accel;      // mm/s^2
+  double tAccel;     // s
+  double tTotal;     // s
+  double t0;         // start time
+  long line;
+};
+
+class Simulator
+{
+ public:
+  Simulator(int fd, long baud, double rapid, double accel) :
+      fd_(fd), baud_(baud), rapid_(rapid), accel_(accel),
+      json_(false), jsonFlag_(0), echo_(1), textVerbosity_(1), jsonVerbosity_(3),
+      statusVerbosity_(1), statusInterval_(250), queueVerbosity_(0),
+      absolute_(true), state_(STAT_READY), line_(0), nextLine_(0),
+      lastMotion_(0), feed_(0.0),
+      lastStatus_(0.0), lastOutput_(Now()), sentQueue_(-1)
+  {
+    pos_[0] = pos_[1] = pos_[2] = 0.0;
+    velocity_ = 0.0;
+    seg_.active = false;
+  }
+
+  void Run()
+  {
+    Emit("#### TinyG version 0.97 (build 440.20) \"Simulated\"\ntype h for help\n");
+    while (!g_quit)
+    {
+      // the real board stops reading its serial port while the planner is
+      // full, which is what makes host flow control necessary
+      bool canRead = (int) planner_.size() < kPlannerBuffers;
+      fd_set readSet;
+      FD_ZERO(&readSet);
+      if (canRead)
+        FD_SET(fd_, &readSet);
+      timeval tv;
+      tv.tv_sec = 0;
+      tv.tv_usec = 2000;
+      int n = select(fd_ + 1, &readSet, 0, 0, &tv);
+      if (n < 0 && errno != EINTR)
+        break;
+      if (n > 0 && FD_ISSET(fd_, &readSet))
+      {
+        char buf[256];
+        ssize_t len = read(fd_, buf, sizeof(buf));
+        if (len > 0)
+          Receive(buf, (size_t) len);
+        else if (len == 0)
+          break;  // a TCP client hung up
+      }
+      Step(Now());
+      Flush();
+    }
+  }
+
+ private:
+  //////////////////////////////////////////////////////////////////////////
+  // Input
+
+  void Receive(const char* data, size_t len)
+  {
+    for (size_t i = 0; i < len; ++i)
+    {
+      char c = data[i];
+      // single character commands act immediately, ahead of queued lines
+      if (c == '!' || c == '%' || c == '~')
+      {
+        RealTime(c);
+        continue;
+      }
+      if (echo_)
+        Emit(std::string(1, c));
+      if (c == '\r' || c == '\n')
+      {
+        if (!input_.empty())
+          Line(input_);
+        input_.clear();
+      }
+      else
+      {
+        input_ += c;
+      }
+    }
+  }
+
+  void RealTime(char c)
+  {
+    if (c == '!' && seg_.active)
+    {
+      // feedhold: stop where we are and keep the rest of the block
+      double now = Now();
+      Position(now, pos_);
+      Block rest;
+      for (int i = 0; i < 3; ++i)
+        rest.target[i] = seg_.start[i] + seg_.unit[i] * seg_.length;
+      rest.feed = seg_.vmax * 60.0;
+      rest.dwell = 0.0;
+      rest.line = seg_.line;
+      planner_.push_front(rest);
+      seg_.active = false;
+      velocity_ = 0.0;
+      SetState(STAT_HOLD);
+    }
+    else if (c == '%' && state_ == STAT_HOLD)
+    {
+      planner_.clear();
+      SetState(STAT_STOP);
+      QueueReport();
+    }
+    else if (c == '~' && state_ == STAT_HOLD)
+    {
+      SetState(planner_.empty() ? STAT_STOP : STAT_RUN);
+    }
+  }
+
+  void Line(std::string line)
+  {
+    while (!line.empty() && (line[0] == ' ' || line[0] == '\t'))
+      line.erase(0, 1);
+    if (line.empty())
+      return;
+    if (line[0] == '{')
+    {
+      json_ = true;
+      JsonCommand(line);
+    }
+    else if (line[0] == '$' || line[0] == '?')
+    {
+      TextCommand(line);
+    }
+    else
+    {
+      int status = GCode(line);
+      Respond("", status, line.size());
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Text mode
+
+  void TextCommand(const std::string& line)
+  {
+    std::string cmd = line.substr(1);
+    std::string value;
+    std::string::size_type eq = cmd.find('=');
+    if (eq != std::string::npos)
+    {
+      value = cmd.substr(eq + 1);
+      cmd = cmd.substr(0, eq);
+    }
+    if (line == "?" || cmd == "sr")
+    {
+      TextStatus();
+      return;
+    }
+    char buf[160];
+    if (cmd == "$")
+    {
+      Settings();
+      return;
+    }
+    if (cmd == "fv")
+    {
+      sprintf(buf, "[fv]  firmware version%16.2f\n", kFirmwareVersion);
+      Emit(buf);
+      return;
+    }
+    long* setting = Setting(cmd);
+    if (setting == 0)
+    {
+      Emit("tinyg [mm] err: Unrecognized command: " + line + "\n");
+      return;
+    }
+    if (!value.empty())
+      Apply(cmd, atol(value.c_str()));
+    sprintf(buf, "[%s] %s %ld\n", cmd.c_str(), SettingName(cmd), *setting);
+    Emit(buf);
+  }
+
+  void TextStatus()
+  {
+    char buf[160];
+    const char* axis = "XYZ";
+    sprintf(buf, "Line number:%18ld\n", line_);
+    Emit(buf);
+    for (int i = 0; i < 3; ++i)
+    {
+      sprintf(buf, "%c position:%17.3f mm\n", axis[i], pos_[i]);
+      Emit(buf);
+    }
+    sprintf(buf, "Velocity:%21.3f mm/min\n", velocity_ * 60.0);
+    Emit(buf);
+    Emit("Units:               G21 - millimeter mode\n");
+    Emit("Coordinate system:   G54 - coordinate system 1\n");
+    Emit(absolute_ ? "Distance mode:       G90 - absolute distance mode\n"
+                   : "Distance mode:       G91 - incremental distance mode\n");
+    sprintf(buf, "Machine state:       %s\n", StateName());
+    Emit(buf);
+  }
+
+  void Settings()
+  {
+    const char* keys[] = {"ee", "tv", "ej", "jv", "sv", "si", "qv"};
+    char buf[160];
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
+    {
+      sprintf(buf, "[%s] %s %ld\n", keys[i], SettingName(keys[i]), *Setting(keys[i]));
+      Emit(buf);
+    }
+    sprintf(buf, "[xvm] x velocity maximum%15.0f mm/min\n", rapid_);
+    Emit(buf);
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // JSON mode
+
+  // Handles the single-key objects the adapter sends, e.g. {"si":250},
+  // {"sr":null} or {"sr":{"posx":true,...}}
+  void JsonCommand(const std::string& line)
+  {
+    std::string::size_type k0 = line.find('"');
+    std::string::size_type k1 = line.find('"', k0 + 1);
+    std::string::size_type colon = line.find(':', k1);
+    if (k0 == std::string::npos || k1 == std::string::npos || colon == std::string::npos)
+    {
+      Respond("", SC_UNRECOGNIZED_COMMAND, line.size());
+      return;
+    }
+    std::string key = line.substr(k0 + 1, k1 - k0 - 1);
+    std::string value = line.substr(colon + 1);
+    while (!value.empty() && (value[value.size() - 1] == '}' || value[value.size() - 1] == ' '))
+      value.erase(value.size() - 1);
+    bool query = value == "null" || value == "\"\"" || value.empty() || value[0] == '{';
+
+    char body[256];
+    if (key == "sr")
+    {
+      Respond("\"sr\":" + StatusBody(), SC_OK, line.size());
+      return;
+    }
+    if (key == "qr")
+    {
+      sprintf(body, "\"qr\":%d", QueueFree());
+      Respond(body, SC_OK, line.size());
+      return;
+    }
+    if (key == "fv")
+    {
+      sprintf(body, "\"fv\":%.3f", kFirmwareVersion);
+      Respond(body, SC_OK, line.size());
+      return;
+    }
+    if (key == "gc")
+    {
+      // {"gc":"G0 X1"}
+      std::string code = value;
+      if (!code.empty() && code[0] == '"')
+        code = code.substr(1, code.find('"', 1) - 1);
+      Respond("", GCode(code), line.size());
+      return;
+    }
+    if (key.size() == 3 && strchr("xyz", key[0]) != 0 &&
+        (key.substr(1) == "vm" || key.substr(1) == "fr" || key.substr(1) == "jm"))
+    {
+      // axis limits; accepted and reported back, but the move model keeps
+      // its own rapid rate and acceleration
+      if (axisSettings_.find(key) == axisSettings_.end())
+        axisSettings_[key] = key[1] == 'j' ? 5000.0 : rapid_;
+      if (!query)
+        axisSettings_[key] = atof(value.c_str());
+      sprintf(body, "\"%s\":%.3f", key.c_str(), axisSettings_[key]);
+      Respond(body, SC_OK, line.size());
+      return;
+    }
+    long* setting = Setting(key);
+    if (setting == 0)
+    {
+      Respond("", SC_UNRECOGNIZED_COMMAND, line.size());
+      return;
+    }
+    if (!query)
+      Apply(key, atol(value.c_str()));
+    sprintf(body, "\"%s\":%ld", key.c_str(), *setting);
+    Respond(body, SC_OK, line.size());
+  }
+
+  // {"r":{body},"f":[1,status,rx]} in JSON mode; errors only in text mode
+  void Respond(const std::string& body, int status, size_t rxBytes)
+  {
+    char buf[64];
+    if (json_)
+    {
+      if (jsonVerbosity_ == 0)
+        return;
+      sprintf(buf, "},\"f\":[1,%d,%lu]}\n", status, (unsigned long) rxBytes + 1);
+      Emit("{\"r\":{" + body + buf);
+    }
+    else if (status != SC_OK)
+    {
+      sprintf(buf, "tinyg [mm] err: status %d\n", status);
+      Emit(buf);
+    }
+    else if (textVerbosity_ > 0)
+    {
+      Emit("tinyg [mm] ok>\n");
+    }
+  }
+
+  std::string StatusBody()
+  {
+    char buf[256];
+    sprintf(buf, "{\"line\":%ld,\"posx\":%.3f,\"posy\":%.3f,\"posz\":%.3f,\"vel\":%.2f,\"stat\":%d}",
+        line_, pos_[0], pos_[1], pos_[2], velocity_ * 60.0, state_);
+    return buf;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Settings shared by both modes
+
+  long* Setting(const std::string& key)
+  {
+    if (key == "ee") return &echo_;
+    if (key == "tv") return &textVerbosity_;
+    if (key == "ej") return &jsonFlag_;
+    if (key == "jv") return &jsonVerbosity_;
+    if (key == "sv") return &statusVerbosity_;
+    if (key == "si") return &statusInterval_;
+    if (key == "qv") return &queueVerbosity_;
+    return 0;
+  }
+
+  static const char* SettingName(const std::string& key)
+  {
+    if (key == "ee") return "enable echo";
+    if (key == "tv") return "text verbosity";
+    if (key == "ej") return "enable json mode";
+    if (key == "jv") return "json verbosity";
+    if (key == "sv") return "status report verbosity";
+    if (key == "si") return "status interval";
+    if (key == "qv") return "queue report verbosity";
+    return "";
+  }
+
+  void Apply(const std::string& key, long value)
+  {
+    *Setting(key) = value;
+    if (key == "ej")
+      json_ = value != 0;
+    if (key == "si" && statusInterval_ < 50)
+      statusInterval_ = 50;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // G-code
+
+  int GCode(const std::string& line)
+  {
+    int motion = -1;   // 0, 1 or 4
+    bool axisGiven[3] = {false, false, false};
+    double axis[3] = {0.0, 0.0, 0.0};
+    double feed = -1.0;
+    double dwell = 0.0;
+    long number = -1;
+
+    const char* p = line.c_str();
+    while (*p)
+    {
+      char letter = (char) toupper(*p);
+      if (letter == ' ' || letter == '\t')
+      {
+        ++p;
+        continue;
+      }
+      if (letter == '(' || letter == ';')
+        break;
+      char* end;
+      double value = strtod(p + 1, &end);
+      if (end == p + 1)
+        return SC_UNRECOGNIZED_COMMAND;
+      p = end;
+      switch (letter)
+      {
+        case 'G':
+          if (value == 0.0 || value == 1.0 || value == 4.0)
+            motion = (int) value;
+          else if (value == 90.0)
+            absolute_ = true;
+          else if (value == 91.0)
+            absolute_ = false;
+          else if (value != 21.0 && value != 54.0 && value != 17.0 && value != 94.0)
+            return SC_UNRECOGNIZED_COMMAND;
+          break;
+        case 'X': axis[0] = value; axisGiven[0] = true; break;
+        case 'Y': axis[1] = value; axisGiven[1] = true; break;
+        case 'Z': axis[2] = value; axisGiven[2] = true; break;
+        case 'F': feed = value; break;
+        case 'P': dwell = value; break;
+        case 'N': number = (long) value; break;
+        case 'M': break;
+        default:
+          return SC_UNRECOGNIZED_COMMAND;
+      }
+    }
+    if (feed > 0.0)
+      feed_ = feed;
+    if (number >= 0)
+      nextLine_ = number;
+    if (motion == 4)
+    {
+      Block b;
+      b.target[0] = b.target[1] = b.target[2] = 0.0;
+      b.feed = 0.0;
+      b.dwell = dwell;
+      b.line = nextLine_;
+      Queue(b);
+      return SC_OK;
+    }
+    if (motion < 0 && (axisGiven[0] || axisGiven[1] || axisGiven[2]))
+      motion = lastMotion_;
+    if (motion == 0 || motion == 1)
+    {
+      lastMotion_ = motion;
+      if (motion == 1 && feed_ <= 0.0)
+        return SC_INPUT_VALUE_RANGE;
+      Block b;
+      for (int i = 0; i < 3; ++i)
+      {
+        double from = PlannedEnd(i);
+        b.target[i] = !axisGiven[i] ? from : (absolute_ ? axis[i] : from + axis[i]);
+      }
+      b.feed = motion == 0 ? rapid_ : (feed_ < rapid_ ? feed_ : rapid_);
+      b.dwell = -1.0;
+      b.line = nextLine_;
+      Queue(b);
+    }
+    return SC_OK;
+  }
+
+  double PlannedEnd(int axis) const
+  {
+    for (std::deque<Block>::const_reverse_iterator b = planner_.rbegin(); b != planner_.rend(); ++b)
+      if (b->dwell < 0.0)
+        return b->target[axis];
+    if (seg_.active && seg_.length > 0.0)
+      return seg_.start[axis] + seg_.unit[axis] * seg_.length;
+    return pos_[axis];
+  }
+
+  void Queue(const Block& b)
+  {
+    planner_.push_back(b);
+    QueueReport();
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Motion
+
+  void Step(double now)
+  {
+    if (state_ == STAT_HOLD)
+    {
+      Report(now);
+      return;
+    }
+    if (seg_.active)
+    {
+      double t = now - seg_.t0;
+      if (t >= seg_.tTotal)
+      {
+        for (int i = 0; i < 3; ++i)
+          pos_[i] = seg_.start[i] + seg_.unit[i] * seg_.length;
+        seg_.active = false;
+        velocity_ = 0.0;
+      }
+      else
+      {
+        Position(now, pos_);
+      }
+    }
+    if (!seg_.active && !planner_.empty())
+    {
+      Start(planner_.front(), now);
+      planner_.pop_front();
+      QueueReport();
+    }
+    if (!seg_.active && planner_.empty() && state_ == STAT_RUN)
+    {
+      SetState(STAT_STOP);
+      return;
+    }
+    Report(now);
+  }
+
+  void Start(const Block& b, double now)
+  {
+    seg_.active = true;
+    seg_.t0 = now;
+    seg_.line = b.line;
+    line_ = b.line;
+    for (int i = 0; i < 3; ++i)
+      seg_.start[i] = pos_[i];
+    if (b.dwell >= 0.0)
+    {
+      seg_.length = 0.0;
+      seg_.unit[0] = seg_.unit[1] = seg_.unit[2] = 0.0;
+      seg_.vmax = seg_.accel = seg_.tAccel = 0.0;
+      seg_.tTotal = b.dwell;
+    }
+    else
+    {
+      double d[3];
+      double length = 0.0;
+      for (int i = 0; i < 3; ++i)
+      {
+        d[i] = b.target[i] - pos_[i];
+        length += d[i] * d[i];
+      }
+      length = sqrt(length);
+      seg_.length = length;
+      for (int i = 0; i < 3; ++i)
+        seg_.unit[i] = length > 0.0 ? d[i] / length : 0.0;
+      // trapezoid, or a triangle if the move is too short to reach vmax
+      double v = b.feed / 60.0;
+      double a = accel_;
+      if (length < v * v / a)
+        v = sqrt(length * a);
+      seg_.vmax = v;
+      seg_.accel = a;
+      seg_.tAccel = v > 0.0 ? v / a : 0.0;
+      double cruise = v > 0.0 ? (length - v * v / a) / v : 0.0;
+      seg_.tTotal = 2.0 * seg_.tAccel + cruise;
+    }
+    SetState(STAT_RUN);
+  }
+
+  void Position(double now, double* pos)
+  {
+    double t = now - seg_.t0;
+    double s;
+    double v = seg_.vmax;
+    double a = seg_.accel;
+    if (seg_.length <= 0.0)
+    {
+      s = 0.0;
+      v = 0.0;
+    }
+    else if (t < seg_.tAccel)
+    {
+      s = 0.5 * a * t * t;
+      v = a * t;
+    }
+    else if (t < seg_.tTotal - seg_.tAccel)
+    {
+      s = 0.5 * a * seg_.tAccel * seg_.tAccel + v * (t - seg_.tAccel);
+    }
+    else
+    {
+      double r = seg_.tTotal - t;
+      if (r < 0.0)
+        r = 0.0;
+      s = seg_.length - 0.5 * a * r * r;
+      v = a * r;
+    }
+    velocity_ = v;
+    for (int i = 0; i < 3; ++i)
+      pos[i] = seg_.start[i] + seg_.unit[i] * s;
+  }
+
+  void SetState(int state)
+  {
+    if (state == state_)
+      return;
+    state_ = state;
+    // state changes are reported at once, like the real firmware
+    if (statusVerbosity_ > 0)
+      StatusReport();
+  }
+
+  void Report(double now)
+  {
+    if (statusVerbosity_ == 0 || state_ != STAT_RUN)
+      return;
+    if ((now - lastStatus_) * 1000.0 >= statusInterval_)
+      StatusReport();
+  }
+
+  void StatusReport()
+  {
+    lastStatus_ = Now();
+    if (json_)
+    {
+      Emit("{\"sr\":" + StatusBody() + "}\n");
+      return;
+    }
+    char buf[256];
+    sprintf(buf, "line:%ld,posx:%.3f,posy:%.3f,posz:%.3f,vel:%.2f,stat:%d\n",
+        line_, pos_[0], pos_[1], pos_[2], velocity_ * 60.0, state_);
+    Emit(buf);
+  }
+
+  int QueueFree() const
+  {
+    return kPlannerBuffers - (int) planner_.size();
+  }
+
+  void QueueReport()
+  {
+    if (queueVerbosity_ == 0 || QueueFree() == sentQueue_)
+      return;
+    sentQueue_ = QueueFree();
+    char buf[32];
+    sprintf(buf, json_ ? "{\"qr\":%d}\n" : "qr:%d\n", sentQueue_);
+    Emit(buf);
+  }
+
+  const char* StateName() const
+  {
+    switch (state_)
+    {
+      case STAT_READY: return "Ready";
+      case STAT_STOP: return "Stop";
+      case STAT_RUN: return "Run";
+      case STAT_HOLD: return "Hold";
+    }
+    return "Unknown";
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // Output, paced at 10 bit times per byte
+
+  void Emit(const std::string& text)
+  {
+    output_ += text;
+    Flush();
+  }
+
+  void Flush()
+  {
+    if (output_.empty())
+    {
+      lastOutput_ = Now();
+      return;
+    }
+    size_t budget = output_.size();
+    if (baud_ > 0)
+    {
+      double now = Now();
+      budget = (size_t) ((now - lastOutput_) * baud_ / 10.0);
+      if (budget == 0)
+        return;
+      if (budget > output_.size())
+        budget = output_.size();
+    }
+    ssize_t n = write(fd_, output_.data(), budget);
+    if (n > 0)
+    {
+      output_.erase(0, (size_t) n);
+      lastOutput_ = Now();
+    }
+  }
+
+  int fd_;
+  long baud_;
+  double rapid_;
+  double accel_;
+
+  bool json_;
+  long jsonFlag_;
+  long echo_;
+  long textVerbosity_;
+  long jsonVerbosity_;
+  long statusVerbosity_;
+  long statusInterval_;
+  long queueVerbosity_;
+
+  bool absolute_;
+  int state_;
+  long line_;
+  long nextLine_;
+  int lastMotion_;
+  double feed_;
+  double pos_[3];
+  double velocity_;
+  std::deque<Block> planner_;
+  std::map<std::string, double> axisSettings_;
+  Segment seg_;
+
+  std::string input_;
+  std::string output_;
+  double lastStatus_;
+  double lastOutput_;
+  int sentQueue_;
+};
+
+void Usage()
+{
+  fprintf(stderr, "usage: tinyg_sim [-b baud] [-r rapid mm/min] [-a accel mm/s^2] [-l symlink] [-t port]\n"
+      "  -b  output pacing in baud, 0 for unpaced (default 115200)\n"
+      "  -r  G0 velocity (default 16000)\n"
+      "  -a  acceleration (default 500)\n"
+      "  -l  also make the slave device available under this path\n"
+      "  -t  listen on this TCP port on localhost instead of a pseudo-terminal\n");
+}
+
+// Runs a fresh controller for each client that connects, one at a time
+int ServeTcp(int port, long baud, double rapid, double accel)
+{
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0)
+  {
+    perror("tinyg_sim: socket");
+    return 1;
+  }
+  int on = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short) port);
+  if (bind(listener, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(listener, 1) != 0)
+  {
+    perror("tinyg_sim: bind");
+    close(listener);
+    return 1;
+  }
+  printf("localhost:%d\n", port);
+  fflush(stdout);
+
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  // a client that hangs up mid-write must not kill the simulator
+  signal(SIGPIPE, SIG_IGN);
+  while (!g_quit)
+  {
+    // accept() would be restarted after a signal; select() is not
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(listener, &readSet);
+    timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 200000;
+    if (select(listener + 1, &readSet, 0, 0, &tv) <= 0)
+      continue;
+    int client = accept(listener, 0, 0);
+    if (client < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("tinyg_sim: accept");
+      break;
+    }
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    Simulator sim(client, baud, rapid, accel);
+    sim.Run();
+    close(client);
+  }
+  close(listener);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  long baud = 115200;
+  double rapid = 16000.0;
+  double accel = 500.0;
+  const char* link = 0;
+  int tcpPort = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:r:a:l:t:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'b': baud = atol(optarg); break;
+      case 'r': rapid = atof(optarg); break;
+      case 'a': accel = atof(optarg); break;
+      case 'l': link = optarg; break;
+      case 't': tcpPort = atoi(optarg); break;
+      default: Usage(); return 1;
+    }
+  }
+  if (rapid <= 0.0 || accel <= 0.0)
+  {
+    Usage();
+    return 1;
+  }
+
+  if (tcpPort > 0)
+    return ServeTcp(tcpPort, baud, rapid, accel);
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+    perror("tinyg_sim: posix_openpt");
+    return 1;
+  }
+  const char* slave = ptsname(master);
+
+  // Raw mode on the slave, and keep it open ourselves so the master does
+  // not see a hangup between client connections.
+  int slaveFd = open(slave, O_RDWR | O_NOCTTY);
+  if (slaveFd < 0)
+  {
+    perror("tinyg_sim: open slave");
+    return 1;
+  }
+  termios tio;
+  tcgetattr(slaveFd, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slaveFd, TCSANOW, &tio);
+
+  if (link != 0)
+  {
+    unlink(link);
+    if (symlink(slave, link) != 0)
+      perror("tinyg_sim: symlink");
+  }
+  printf("%s\n", slave);
+  fflush(stdout);
+
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+
+  Simulator sim(master, baud, rapid, accel);
+  sim.Run();
+
+  if (link != 0)
+    unlink(link);
+  close(slaveFd);
+  close(master);
+  return 0;
+}
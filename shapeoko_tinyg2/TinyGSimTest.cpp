@@ -0,0 +1,585 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TinyGSimTest.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Checks the adapter's controller protocols against the
+//                simulated TinyG in TinyGSim.cpp, over its TCP port.  Each
+//                check connects afresh, which gives it a new controller, and
+//                plays the lines the adapter writes:
+//
+//                - sweeps, scans and Z sequences streamed with their own
+//                  line numbers, counted with the adapter's line counting,
+//                  with a report left over from an earlier stream in the
+//                  way;
+//                - the queue report a jog needs before it can queue
+//                  anything, and the {"qr":null} that primes it;
+//                - a stop arriving behind a coalescer flush, which must
+//                  leave the machine at rest.
+//
+//                The hub and the stages need Micro-Manager to run, so the
+//                command sequences are the ones they send rather than the
+//                devices themselves.  Linux only, like the simulator.
+//
+//                Usage: tinyg_sim -b 0 -t 5757 & tinyg_sim_test 5757
+//                or "make check".
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "LineNumbers.h"
+#include "ScanPath.h"
+#include "TinyGJson.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+// as in TinyGSim.cpp
+const int kPlannerBuffers = 28;
+// ShapeokoTinyGJogger::kReservedBuffers
+const int kJogReservedBuffers = 4;
+
+enum { STAT_STOP = 3, STAT_RUN = 5, STAT_HOLD = 6 };
+
+int g_failures = 0;
+
+#define CHECK(cond) Check((cond), #cond, __LINE__)
+
+void Check(bool ok, const char* what, int line)
+{
+  if (ok)
+    return;
+  ++g_failures;
+  fprintf(stderr, "TinyGSimTest.cpp:%d: check failed: %s\n", line, what);
+}
+
+double Now()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// One connection to the simulator, which is one freshly reset controller
+class Controller
+{
+ public:
+  Controller() : state_(0), line_(0), queueFree_(-1), answers_(0), fd_(-1)
+  {
+    pos_[0] = pos_[1] = pos_[2] = 0.0;
+  }
+
+  ~Controller()
+  {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  // Retries for a while, so the simulator may still be starting
+  bool Connect(int port)
+  {
+    double deadline = Now() + 3.0;
+    while (Now() < deadline)
+    {
+      fd_ = socket(AF_INET, SOCK_STREAM, 0);
+      if (fd_ < 0)
+        return false;
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons((unsigned short) port);
+      if (connect(fd_, (sockaddr*) &addr, sizeof(addr)) == 0)
+      {
+        int on = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return true;
+      }
+      close(fd_);
+      fd_ = -1;
+      usleep(50000);
+    }
+    return false;
+  }
+
+  // The settings ShapeokoTinyGHub::Initialize and SetStatusReports write
+  bool Setup()
+  {
+    const char* setup[] = {
+      "{\"ej\":1}", "{\"ee\":0}", "{\"jv\":3}", "{\"qv\":1}",
+      "{\"sr\":{\"posx\":true,\"posy\":true,\"posz\":true,\"vel\":true,\"stat\":true,\"line\":true}}",
+      "{\"sv\":1}", "{\"si\":50}"
+    };
+    for (size_t i = 0; i < sizeof(setup) / sizeof(setup[0]); ++i)
+      if (!Command(setup[i]))
+        return false;
+    return true;
+  }
+
+  void Send(const std::string& line)
+  {
+    Write(line + "\n");
+  }
+
+  void SendRealtime(const char* chars)
+  {
+    Write(chars);
+  }
+
+  // Next JSON line within timeoutMs.  Status and queue reports, bare or
+  // in a response, are applied to the state kept here first.
+  bool Read(TinyGReport& report, long timeoutMs)
+  {
+    double deadline = Now() + timeoutMs / 1000.0;
+    for (;;)
+    {
+      std::string::size_type eol = input_.find('\n');
+      if (eol != std::string::npos)
+      {
+        std::string line = input_.substr(0, eol);
+        input_.erase(0, eol + 1);
+        if (!ParseTinyGJson(line.c_str(), (unsigned) line.size(), report))
+          continue;
+        Apply(report);
+        return true;
+      }
+      double left = deadline - Now();
+      if (left <= 0.0)
+        return false;
+      fd_set readSet;
+      FD_ZERO(&readSet);
+      FD_SET(fd_, &readSet);
+      timeval tv;
+      tv.tv_sec = (long) left;
+      tv.tv_usec = (long) ((left - tv.tv_sec) * 1e6);
+      int n = select(fd_ + 1, &readSet, 0, 0, &tv);
+      if (n < 0 && errno != EINTR)
+        return false;
+      if (n <= 0)
+        continue;
+      char buf[512];
+      ssize_t len = read(fd_, buf, sizeof(buf));
+      if (len <= 0)
+        return false;
+      input_.append(buf, (size_t) len);
+    }
+  }
+
+  // Sends a line and waits for its response
+  bool Command(const std::string& line, TinyGReport* answer = 0)
+  {
+    unsigned long seen = answers_;
+    Send(line);
+    TinyGReport report;
+    while (Read(report, 2000))
+    {
+      if (answers_ == seen)
+        continue;
+      if (answer != 0)
+        *answer = report;
+      return report.footerStatus == TINYG_STAT_OK;
+    }
+    return false;
+  }
+
+  // Reads until the machine state is one of those in the mask
+  bool WaitForState(unsigned stateMask, long timeoutMs)
+  {
+    double deadline = Now() + timeoutMs / 1000.0;
+    TinyGReport report;
+    while (!(stateMask & (1u << state_)))
+    {
+      long left = (long) ((deadline - Now()) * 1000.0);
+      if (left <= 0 || !Read(report, left))
+        return false;
+    }
+    return true;
+  }
+
+  // Reads for timeoutMs; true if the machine went into motion meanwhile
+  bool SawMotion(long timeoutMs)
+  {
+    bool moved = state_ == STAT_RUN;
+    double deadline = Now() + timeoutMs / 1000.0;
+    TinyGReport report;
+    long left;
+    while ((left = (long) ((deadline - Now()) * 1000.0)) > 0)
+      if (Read(report, left) && state_ == STAT_RUN)
+        moved = true;
+    return moved;
+  }
+
+  int state_;
+  long line_;
+  double pos_[3];
+  int queueFree_;
+  unsigned long answers_;   // responses read so far
+
+ private:
+  void Write(const std::string& data)
+  {
+    size_t done = 0;
+    while (done < data.size())
+    {
+      ssize_t n = write(fd_, data.data() + done, data.size() - done);
+      if (n <= 0 && errno != EINTR)
+        return;
+      if (n > 0)
+        done += (size_t) n;
+    }
+  }
+
+  void Apply(const TinyGReport& report)
+  {
+    if (report.Has(TinyGReport::kFooter))
+      ++answers_;
+    if (report.Has(TinyGReport::kQueue))
+      queueFree_ = report.queueFree;
+    if (report.Has(TinyGReport::kStat))
+      state_ = report.stat;
+    if (report.Has(TinyGReport::kLine))
+      line_ = report.line;
+    for (int i = 0; i < 3; ++i)
+      if (report.Has(TinyGReport::kPosX << i))
+        pos_[i] = report.pos[i];
+  }
+
+  int fd_;
+  std::string input_;
+};
+
+// Streams the lines and follows the reports to the end, counting items the
+// way the stages do.  Every report is counted, including one left over from
+// before the stream, which must not count.  Returns the items reached, or
+// -2 if the stream did not finish.
+long StreamAndCount(Controller& tinyg, const std::vector<std::string>& lines,
+    long firstLine, long items, long linesPerItem, bool* regressed)
+{
+  unsigned long answers = tinyg.answers_ + lines.size();
+  for (size_t i = 0; i < lines.size(); ++i)
+    tinyg.Send(lines[i]);
+  long reached = 0;
+  *regressed = false;
+  bool started = false;
+  double deadline = Now() + 20.0;
+  TinyGReport report;
+  while (Now() < deadline)
+  {
+    if (!tinyg.Read(report, 500))
+      continue;
+    if (report.Has(TinyGReport::kLine))
+    {
+      long r = TinyGItemsReached(report.line, firstLine, items, linesPerItem);
+      if (r >= 0 && r < reached)
+        *regressed = true;
+      if (r > reached)
+        reached = r;
+    }
+    if (tinyg.state_ == STAT_RUN)
+      started = true;
+    if (started && tinyg.answers_ >= answers && tinyg.state_ == STAT_STOP)
+      return reached;
+  }
+  return -2;
+}
+
+// A stream cut short by a stop, so its reports and reserved range are what
+// the next stream starts behind.  Returns the line the controller reports.
+long AbortedStream(Controller& tinyg, long& reservedEnd)
+{
+  long count = 20;
+  long first = TinyGFirstStreamLine(tinyg.line_, reservedEnd, count);
+  reservedEnd = first + count;
+  char buff[64];
+  for (long i = 0; i < count; ++i)
+  {
+    sprintf(buff, "N%ld G0 X%.3f", first + i, (i % 2) ? 0.0 : 2.0);
+    tinyg.Send(buff);
+  }
+  TinyGReport report;
+  while (tinyg.line_ < first + 2 && tinyg.Read(report, 2000))
+    ;
+  tinyg.SendRealtime("!%");
+  tinyg.WaitForState(1u << STAT_STOP, 2000);
+  // the unanswered lines are read in and flushed as well
+  while (tinyg.Read(report, 300))
+    ;
+  if (tinyg.state_ != STAT_STOP)
+  {
+    tinyg.SendRealtime("!%");
+    tinyg.WaitForState(1u << STAT_STOP, 2000);
+  }
+  return tinyg.line_;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Line-number trigger counting
+
+// CShapeokoTinyGXYStage::StartSweep: one numbered pulse line per trigger
+void CheckSweepCounting(int port)
+{
+  Controller tinyg;
+  CHECK(tinyg.Connect(port) && tinyg.Setup());
+  long reservedEnd = 1;
+  long stale = AbortedStream(tinyg, reservedEnd);
+  CHECK(stale > 0);
+
+  TinyGSweepLine line = {0.0, 0.0, 4000.0, 0.0, 500.0};
+  std::vector<TinyGScanTile> triggers;
+  CHECK(BuildSweepTriggers(line, triggers));
+  long count = (long) triggers.size();
+  long first = TinyGFirstStreamLine(stale, reservedEnd, count);
+  reservedEnd = first + count;
+  CHECK(first > stale);
+
+  // a report from the aborted stream, as a poll still in flight returns
+  TinyGReport report;
+  CHECK(tinyg.Command("{\"sr\":null}", &report));
+  CHECK(report.Has(TinyGReport::kLine) && report.line == stale);
+  CHECK(TinyGItemsReached(report.line, first, count, 1) == -1);
+
+  std::vector<std::string> commands;
+  char buff[100];
+  double pulse_mm = 0.1;
+  commands.push_back("G0 X-0.5 Y0");
+  commands.push_back("G1 F600 X0 Y0");
+  for (long i = 0; i < count; ++i)
+  {
+    double x = triggers[i].x_um / 1000.;
+    commands.push_back("M8");
+    sprintf(buff, "N%ld G1 X%.4f Y0", first + i, x + pulse_mm);
+    commands.push_back(buff);
+    commands.push_back("M9");
+    sprintf(buff, "G1 X%.4f Y0", i + 1 < count ? triggers[i + 1].x_um / 1000. : x + 0.5);
+    commands.push_back(buff);
+  }
+  bool regressed;
+  long reached = StreamAndCount(tinyg, commands, first, count, 1, &regressed);
+  CHECK(reached == count);
+  CHECK(!regressed);
+}
+
+// CShapeokoTinyGXYStage::StartScan: a move and a dwell per tile
+void CheckScanCounting(int port)
+{
+  Controller tinyg;
+  CHECK(tinyg.Connect(port) && tinyg.Setup());
+  long reservedEnd = 1;
+  long stale = AbortedStream(tinyg, reservedEnd);
+
+  TinyGScanRegion region = {0.0, 0.0, 1500.0, 1000.0, 500.0, 500.0, 0.0};
+  std::vector<TinyGScanTile> tiles;
+  CHECK(BuildSerpentineScan(region, tiles));
+  long count = (long) tiles.size();
+  CHECK(count == 6);
+  long first = TinyGFirstStreamLine(stale, reservedEnd, 2 * count);
+  reservedEnd = first + 2 * count;
+
+  TinyGReport report;
+  CHECK(tinyg.Command("{\"sr\":null}", &report));
+  CHECK(TinyGItemsReached(report.line, first, count, 2) == -1);
+
+  std::vector<std::string> commands;
+  char buff[100];
+  for (long i = 0; i < count; ++i)
+  {
+    sprintf(buff, "N%ld G0 X%f Y%f", first + 2 * i, tiles[i].x_um/1000., tiles[i].y_um/1000.);
+    commands.push_back(buff);
+    sprintf(buff, "N%ld G4 P%.3f", first + 2 * i + 1, 0.08);
+    commands.push_back(buff);
+  }
+  bool regressed;
+  long reached = StreamAndCount(tinyg, commands, first, count, 2, &regressed);
+  CHECK(reached == count);
+  CHECK(!regressed);
+}
+
+// CShapeokoTinyGZStage::StartStageSequence: a move and a dwell per slice,
+// including a zero dwell
+void CheckZSequenceCounting(int port)
+{
+  Controller tinyg;
+  CHECK(tinyg.Connect(port) && tinyg.Setup());
+  long reservedEnd = 1;
+  long stale = AbortedStream(tinyg, reservedEnd);
+
+  double z_um[] = {0.0, 200.0, 400.0, 600.0, 800.0};
+  long count = sizeof(z_um) / sizeof(z_um[0]);
+  long first = TinyGFirstStreamLine(stale, reservedEnd, 2 * count);
+  reservedEnd = first + 2 * count;
+  std::vector<std::string> commands;
+  char buff[100];
+  for (long i = 0; i < count; ++i)
+  {
+    sprintf(buff, "N%ld G0 Z%f", first + 2 * i, z_um[i]/1000.);
+    commands.push_back(buff);
+    sprintf(buff, "N%ld G4 P%.3f", first + 2 * i + 1, i == 2 ? 0.0 : 0.06);
+    commands.push_back(buff);
+  }
+  CHECK(TinyGItemsReached(stale, first, count, 2) == -1);
+  bool regressed;
+  long reached = StreamAndCount(tinyg, commands, first, count, 2, &regressed);
+  CHECK(reached == count);
+  CHECK(!regressed);
+  // OnSequenceSlice reads the last line reported once the stack is done
+  TinyGReport report;
+  CHECK(tinyg.Command("{\"sr\":null}", &report));
+  CHECK(TinyGItemsReached(report.line, first, count, 2) == count);
+}
+
+// Ranges follow on from each other and start again before N overflows
+void CheckLineRanges()
+{
+  CHECK(TinyGFirstStreamLine(0, 1, 10) == 1);
+  CHECK(TinyGFirstStreamLine(5, 11, 10) == 11);
+  CHECK(TinyGFirstStreamLine(30, 11, 10) == 31);
+  CHECK(TinyGFirstStreamLine(TINYG_MAX_LINE_NUMBER - 5, 1, 10) == 1);
+  CHECK(TinyGItemsReached(10, 11, 4, 2) == -1);
+  CHECK(TinyGItemsReached(11, 11, 4, 2) == 0);
+  CHECK(TinyGItemsReached(12, 11, 4, 2) == 1);
+  CHECK(TinyGItemsReached(18, 11, 4, 2) == 4);
+  CHECK(TinyGItemsReached(19, 11, 4, 2) == -1);
+  CHECK(TinyGItemsReached(11, 11, 4, 1) == 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Jog queue priming
+
+// The jogger queues only while more than its reserve of planner buffers is
+// free, going by the last queue report.  TinyG reports the queue only when
+// it changes, so a fresh connection hears nothing until asked.
+void CheckJogPriming(int port)
+{
+  Controller tinyg;
+  CHECK(tinyg.Connect(port) && tinyg.Setup());
+  TinyGReport report;
+  while (tinyg.Read(report, 300))
+    ;
+  CHECK(tinyg.queueFree_ == -1);
+
+  // ShapeokoTinyGHub::Jog asks before starting the jogger
+  CHECK(tinyg.Command("{\"qr\":null}", &report));
+  CHECK(report.Has(TinyGReport::kQueue));
+  CHECK(tinyg.queueFree_ == kPlannerBuffers);
+  CHECK(tinyg.queueFree_ > kJogReservedBuffers);
+
+  // from here on the reports keep the count current as segments queue
+  char buff[64];
+  for (int i = 1; i <= 6; ++i)
+  {
+    sprintf(buff, "G1 F600 X%.3f Y0", i * 0.5);
+    tinyg.Send(buff);
+  }
+  int lowest = tinyg.queueFree_;
+  double deadline = Now() + 1.0;
+  while (Now() < deadline && tinyg.Read(report, 200))
+    if (report.Has(TinyGReport::kQueue) && report.queueFree < lowest)
+      lowest = report.queueFree;
+  CHECK(lowest < kPlannerBuffers);
+  tinyg.SendRealtime("!%");
+  CHECK(tinyg.WaitForState(1u << STAT_STOP, 2000));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Stop during a coalescer flush
+
+// A coalescer flush holds and flushes the move under way, then sends the
+// merged move.  ShapeokoTinyGCoalescer::Discard makes StopMotion wait for
+// that send, so its "!%" comes after the merged move and takes it.
+void CheckStopAfterFlush(int port)
+{
+  Controller tinyg;
+  CHECK(tinyg.Connect(port) && tinyg.Setup());
+  CHECK(tinyg.Command("G0 X20 Y0"));
+  CHECK(tinyg.WaitForState(1u << STAT_RUN, 1000));
+
+  // ShapeokoTinyGHub::HoldAndFlush, then the merged move
+  tinyg.SendRealtime("!");
+  CHECK(tinyg.WaitForState(1u << STAT_HOLD, 2000));
+  tinyg.SendRealtime("%");
+  CHECK(tinyg.WaitForState(1u << STAT_STOP, 500));
+  CHECK(tinyg.Command("G0 X2 Y8"));
+  CHECK(tinyg.WaitForState(1u << STAT_RUN, 1000));
+
+  // StopMotion
+  tinyg.SendRealtime("!%");
+  CHECK(tinyg.WaitForState(1u << STAT_STOP, 1500));
+  CHECK(!tinyg.SawMotion(400));
+  TinyGReport report;
+  CHECK(tinyg.Command("{\"sr\":null}", &report));
+  double x = tinyg.pos_[0], y = tinyg.pos_[1];
+  CHECK(y < 8.0);
+  CHECK(!tinyg.SawMotion(200));
+  CHECK(tinyg.Command("{\"sr\":null}", &report));
+  CHECK(tinyg.pos_[0] == x && tinyg.pos_[1] == y);
+}
+
+// The order Discard rules out: the merged move written after the stop
+// runs, so the check above would see a flush that slipped past the stop
+void CheckFlushAfterStopMoves(int port)
+{
+  Controller tinyg;
+  CHECK(tinyg.Connect(port) && tinyg.Setup());
+  CHECK(tinyg.Command("G0 X20 Y0"));
+  CHECK(tinyg.WaitForState(1u << STAT_RUN, 1000));
+  tinyg.SendRealtime("!");
+  CHECK(tinyg.WaitForState(1u << STAT_HOLD, 2000));
+  tinyg.SendRealtime("!%");
+  CHECK(tinyg.WaitForState(1u << STAT_STOP, 1500));
+  CHECK(tinyg.Command("G0 X2 Y8"));
+  CHECK(tinyg.SawMotion(400));
+  tinyg.SendRealtime("!%");
+  CHECK(tinyg.WaitForState(1u << STAT_STOP, 1500));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc != 2 || atoi(argv[1]) <= 0)
+  {
+    fprintf(stderr, "usage: tinyg_sim_test port\n"
+        "  checks against tinyg_sim -t port, best run with -b 0\n");
+    return 2;
+  }
+  int port = atoi(argv[1]);
+  signal(SIGPIPE, SIG_IGN);
+
+  CheckLineRanges();
+  CheckSweepCounting(port);
+  CheckScanCounting(port);
+  CheckZSequenceCounting(port);
+  CheckJogPriming(port);
+  CheckStopAfterFlush(port);
+  CheckFlushAfterStopMoves(port);
+
+  if (g_failures != 0)
+  {
+    fprintf(stderr, "tinyg_sim_test: %d checks failed\n", g_failures);
+    return 1;
+  }
+  printf("tinyg_sim_test: all checks passed\n");
+  return 0;
+}
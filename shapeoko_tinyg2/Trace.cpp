@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Trace.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Trace level and binary trace ring for the ShapeokoTinyG
+//                devices.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "Trace.h"
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TINYG_ATOMIC_FETCH_ADD(p) (_InterlockedIncrement(p) - 1)
+#else
+#define TINYG_ATOMIC_FETCH_ADD(p) __sync_fetch_and_add(p, 1)
+#endif
+
+volatile int g_TinyGTraceLevel =
+    TINYG_TRACE_INFO <= TINYG_TRACE_MAX_LEVEL ? TINYG_TRACE_INFO : TINYG_TRACE_MAX_LEVEL;
+TinyGTraceRing g_TinyGTraceRing;
+
+void TinyGTraceRing::Record(double timeUs, int event, long arg, double value, const char* text)
+{
+  long slot = TINYG_ATOMIC_FETCH_ADD(&next_);
+  TinyGTraceRecord& r = records_[(unsigned long) slot % kSize];
+  r.timeUs = timeUs;
+  r.event = event;
+  r.arg = arg;
+  r.value = value;
+  if (text != 0)
+  {
+    strncpy(r.text, text, sizeof(r.text) - 1);
+    r.text[sizeof(r.text) - 1] = 0;
+  }
+  else
+  {
+    r.text[0] = 0;
+  }
+}
+
+void TinyGTraceRing::Snapshot(std::vector<TinyGTraceRecord>& records) const
+{
+  unsigned long next = (unsigned long) next_;
+  unsigned long count = next < (unsigned long) kSize ? next : (unsigned long) kSize;
+  records.clear();
+  records.reserve(count);
+  for (unsigned long i = next - count; i != next; ++i)
+    records.push_back(records_[i % kSize]);
+}
+
+const char* TinyGTraceRing::EventName(int event)
+{
+  switch (event)
+  {
+    case kTraceWrite: return "write";
+    case kTraceResponse: return "response";
+    case kTraceStatus: return "status";
+    case kTraceQueue: return "queue";
+    case kTraceError: return "error";
+    default: return "?";
+  }
+}
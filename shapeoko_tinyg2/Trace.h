@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Trace.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Leveled logging and an in-memory binary trace for the
+//                ShapeokoTinyG devices.
+//
+//                TINYG_TRACE(level, msg) logs through the device's
+//                LogMessage only if level is compiled in (at most
+//                TINYG_TRACE_MAX_LEVEL) and enabled at run time (at most
+//                g_TinyGTraceLevel, the hub's "Trace Level" property).  msg
+//                is not evaluated otherwise, so a disabled trace costs one
+//                compare and builds no string.
+//
+//                TINYG_TRACE_EVENT(event, arg, value, text) stores a fixed
+//                size record in a ring buffer when "Trace Ring" is on; the
+//                hub's "Trace Dump" property writes the ring to the log.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_TRACE_H_
+#define _SHAPEOKO_TINYG_TRACE_H_
+
+#include <vector>
+
+#define TINYG_TRACE_OFF      0
+#define TINYG_TRACE_ERROR    1   // failures
+#define TINYG_TRACE_INFO     2   // initialization and user actions
+#define TINYG_TRACE_DEBUG    3   // every command and answer
+#define TINYG_TRACE_VERBOSE  4   // polls, port calls and every received line
+
+// Levels above this are compiled out entirely
+#ifndef TINYG_TRACE_MAX_LEVEL
+#define TINYG_TRACE_MAX_LEVEL TINYG_TRACE_VERBOSE
+#endif
+
+extern volatile int g_TinyGTraceLevel;
+
+// For use inside device member functions.  Debug and verbose messages are
+// logged as debug-only, like LogMessage(msg, true).
+#define TINYG_TRACE(level, msg) \
+  do { \
+    if ((level) <= TINYG_TRACE_MAX_LEVEL && (level) <= g_TinyGTraceLevel) \
+      LogMessage(msg, (level) >= TINYG_TRACE_DEBUG); \
+  } while (0)
+
+enum TinyGTraceEvent
+{
+  kTraceWrite,      // command written; text is the start of it
+  kTraceResponse,   // response footer; arg is the status code
+  kTraceStatus,     // status report; arg is the machine state, value posx
+  kTraceQueue,      // queue report; arg is the free planner buffers
+  kTraceError       // arg is the error code
+};
+
+struct TinyGTraceRecord
+{
+  double timeUs;
+  int event;
+  long arg;
+  double value;
+  char text[24];
+};
+
+// Fixed-size, overwrite-oldest ring of trace records.  Writers from any
+// thread claim a slot with an atomic increment and never block; a dump
+// taken while writers are busy may show a record half written.
+class TinyGTraceRing
+{
+ public:
+  enum { kSize = 4096 };
+
+  TinyGTraceRing() : next_(0), enabled_(false) {}
+
+  void Enable(bool enable) { enabled_ = enable; }
+  bool IsEnabled() const { return enabled_; }
+  void Record(double timeUs, int event, long arg, double value, const char* text);
+  // copies out the records, oldest first
+  void Snapshot(std::vector<TinyGTraceRecord>& records) const;
+  static const char* EventName(int event);
+
+ private:
+  volatile long next_;
+  volatile bool enabled_;
+  TinyGTraceRecord records_[kSize];
+};
+
+extern TinyGTraceRing g_TinyGTraceRing;
+
+// For use inside device member functions
+#define TINYG_TRACE_EVENT(event, arg, value, text) \
+  do { \
+    if (g_TinyGTraceRing.IsEnabled()) \
+      g_TinyGTraceRing.Record(GetCurrentMMTime().getUsec(), event, arg, value, text); \
+  } while (0)
+
+#endif // _SHAPEOKO_TINYG_TRACE_H_
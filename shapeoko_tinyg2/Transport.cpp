@@ -0,0 +1,447 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Transport.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Byte transports beneath the ShapeokoTinyG hub.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+// winsock2.h must come before anything that pulls in windows.h
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+#endif
+
+#include "ShapeokoTinyG.h"
+#include "Transport.h"
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////////
+// Micro-Manager serial port
+
+ShapeokoTinyGMMSerialTransport::ShapeokoTinyGMMSerialTransport(const MM::Device* caller, MM::Core* core, const std::string& port) :
+    caller_(caller),
+    core_(core),
+    port_(port)
+{
+}
+
+int ShapeokoTinyGMMSerialTransport::Open()
+{
+  if (core_ == 0 || port_.empty() || port_ == "Undefined")
+    return ERR_NO_PORT_SET;
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGMMSerialTransport::Write(const unsigned char* data, unsigned len)
+{
+  return core_->WriteToSerial(caller_, port_.c_str(), data, len);
+}
+
+int ShapeokoTinyGMMSerialTransport::Read(unsigned char* buf, unsigned maxLen, unsigned long& bytesRead, long waitMs)
+{
+  bytesRead = 0;
+  int ret = core_->ReadFromSerial(caller_, port_.c_str(), buf, maxLen, bytesRead);
+  if (ret != DEVICE_OK)
+    return ret;
+  // a TinyG line takes several ms at 115200 baud
+  if (bytesRead == 0 && waitMs > 0)
+    CDeviceUtils::SleepMs(1);
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGMMSerialTransport::Purge()
+{
+  return core_->PurgeSerial(caller_, port_.c_str());
+}
+
+#ifndef WIN32
+///////////////////////////////////////////////////////////////////////////////
+// Direct serial device
+
+namespace {
+
+bool BaudToSpeed(long baud, speed_t& speed)
+{
+  switch (baud)
+  {
+    case 9600: speed = B9600; return true;
+    case 19200: speed = B19200; return true;
+    case 38400: speed = B38400; return true;
+    case 57600: speed = B57600; return true;
+    case 115200: speed = B115200; return true;
+#ifdef B230400
+    case 230400: speed = B230400; return true;
+#endif
+    default: return false;
+  }
+}
+
+} // namespace
+
+ShapeokoTinyGTermiosTransport::ShapeokoTinyGTermiosTransport(const std::string& path, long baud) :
+    path_(path),
+    baud_(baud),
+    fd_(-1)
+{
+}
+
+ShapeokoTinyGTermiosTransport::~ShapeokoTinyGTermiosTransport()
+{
+  Close();
+}
+
+int ShapeokoTinyGTermiosTransport::Open()
+{
+  if (fd_ >= 0)
+    return DEVICE_OK;
+  speed_t speed;
+  if (path_.empty() || !BaudToSpeed(baud_, speed))
+    return ERR_NO_PORT_SET;
+  fd_ = open(path_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd_ < 0)
+    return ERR_PORT_OPEN_FAILED;
+
+  // raw 8N1 without flow control; reads return at once with what is there
+  termios tio;
+  if (tcgetattr(fd_, &tio) != 0)
+  {
+    Close();
+    return ERR_PORT_OPEN_FAILED;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+#ifdef CRTSCTS
+  tio.c_cflag &= ~CRTSCTS;
+#endif
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd_, TCSANOW, &tio) != 0)
+  {
+    Close();
+    return ERR_PORT_OPEN_FAILED;
+  }
+#ifdef __linux__
+  // USB serial adapters otherwise hold input back for up to 16 ms; not
+  // every driver supports it, and it is only a latency improvement
+  serial_struct serial;
+  if (ioctl(fd_, TIOCGSERIAL, &serial) == 0)
+  {
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd_, TIOCSSERIAL, &serial);
+  }
+#endif
+  tcflush(fd_, TCIOFLUSH);
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGTermiosTransport::Close()
+{
+  if (fd_ >= 0)
+  {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+int ShapeokoTinyGTermiosTransport::Write(const unsigned char* data, unsigned len)
+{
+  if (fd_ < 0)
+    return ERR_NO_PORT_SET;
+  while (len > 0)
+  {
+    ssize_t n = write(fd_, data, len);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN)
+        return ERR_WRITE_FAILED;
+      // output buffer full; wait for the UART to drain some of it
+      pollfd p;
+      p.fd = fd_;
+      p.events = POLLOUT;
+      p.revents = 0;
+      if (poll(&p, 1, 1000) <= 0)
+        return ERR_WRITE_FAILED;
+      continue;
+    }
+    data += n;
+    len -= (unsigned) n;
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGTermiosTransport::Read(unsigned char* buf, unsigned maxLen, unsigned long& bytesRead, long waitMs)
+{
+  bytesRead = 0;
+  if (fd_ < 0)
+    return ERR_NO_PORT_SET;
+  pollfd p;
+  p.fd = fd_;
+  p.events = POLLIN;
+  p.revents = 0;
+  int ready = poll(&p, 1, (int) waitMs);
+  if (ready < 0)
+    return errno == EINTR ? DEVICE_OK : ERR_COMMUNICATION;
+  if (ready == 0)
+    return DEVICE_OK;
+  if (p.revents & (POLLERR | POLLHUP | POLLNVAL))
+    return ERR_COMMUNICATION;
+  ssize_t n = read(fd_, buf, maxLen);
+  if (n < 0)
+    return (errno == EAGAIN || errno == EINTR) ? DEVICE_OK : ERR_COMMUNICATION;
+  bytesRead = (unsigned long) n;
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGTermiosTransport::Purge()
+{
+  if (fd_ < 0)
+    return ERR_NO_PORT_SET;
+  return tcflush(fd_, TCIFLUSH) == 0 ? DEVICE_OK : ERR_COMMUNICATION;
+}
+#endif // WIN32
+
+///////////////////////////////////////////////////////////////////////////////
+// TCP
+
+namespace {
+
+#ifdef WIN32
+typedef SOCKET TinyGSocket;
+#define TINYG_CLOSE_SOCKET closesocket
+#else
+typedef int TinyGSocket;
+#define TINYG_CLOSE_SOCKET close
+#define INVALID_SOCKET (-1)
+#endif
+
+#ifdef MSG_NOSIGNAL
+const int kSendFlags = MSG_NOSIGNAL;   // a dropped connection must not raise SIGPIPE
+#else
+const int kSendFlags = 0;
+#endif
+
+const size_t kNoSocket = (size_t) -1;
+
+// longest a connection attempt to one address may take
+const long kConnectTimeoutMs = 3000;
+
+// Waits up to waitMs for the socket to become readable
+int WaitReadable(TinyGSocket s, long waitMs)
+{
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  FD_SET(s, &readSet);
+  timeval tv;
+  tv.tv_sec = waitMs / 1000;
+  tv.tv_usec = (waitMs % 1000) * 1000;
+  return select((int) s + 1, &readSet, 0, 0, &tv);
+}
+
+// connect() with a timeout: a host that does not answer would otherwise
+// hold up Initialize for the system's own timeout, minutes on some
+bool ConnectWithTimeout(TinyGSocket s, const sockaddr* addr, int addrLen, long timeoutMs)
+{
+#ifdef WIN32
+  u_long nonBlocking = 1;
+  if (ioctlsocket(s, FIONBIO, &nonBlocking) != 0)
+    return false;
+  if (connect(s, addr, addrLen) != 0 && WSAGetLastError() != WSAEWOULDBLOCK)
+    return false;
+#else
+  int flags = fcntl(s, F_GETFL, 0);
+  if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0)
+    return false;
+  if (connect(s, addr, (socklen_t) addrLen) != 0 && errno != EINPROGRESS)
+    return false;
+#endif
+  // writable once connected; Windows flags a refused connection as an exception
+  fd_set writeSet, errorSet;
+  FD_ZERO(&writeSet);
+  FD_SET(s, &writeSet);
+  FD_ZERO(&errorSet);
+  FD_SET(s, &errorSet);
+  timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  if (select((int) s + 1, 0, &writeSet, &errorSet, &tv) <= 0 || !FD_ISSET(s, &writeSet))
+    return false;
+  int error = 0;
+  socklen_t errorLen = sizeof(error);
+  if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char*) &error, &errorLen) != 0 || error != 0)
+    return false;
+#ifdef WIN32
+  nonBlocking = 0;
+  return ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+#else
+  return fcntl(s, F_SETFL, flags) == 0;
+#endif
+}
+
+} // namespace
+
+ShapeokoTinyGTcpTransport::ShapeokoTinyGTcpTransport(const std::string& address) :
+    address_(address),
+    socket_(kNoSocket),
+    winsock_(false),
+    lost_(false)
+{
+}
+
+ShapeokoTinyGTcpTransport::~ShapeokoTinyGTcpTransport()
+{
+  Close();
+}
+
+int ShapeokoTinyGTcpTransport::Open()
+{
+  if (socket_ != kNoSocket)
+    return DEVICE_OK;
+  std::string::size_type colon = address_.rfind(':');
+  if (colon == std::string::npos || colon == 0 || colon + 1 == address_.size())
+    return ERR_NO_PORT_SET;
+  std::string host = address_.substr(0, colon);
+  std::string port = address_.substr(colon + 1);
+
+#ifdef WIN32
+  WSADATA wsa;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+    return ERR_PORT_OPEN_FAILED;
+  winsock_ = true;
+#endif
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = 0;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+  {
+    Close();
+    return ERR_PORT_OPEN_FAILED;
+  }
+  TinyGSocket s = INVALID_SOCKET;
+  for (addrinfo* ai = result; ai != 0; ai = ai->ai_next)
+  {
+    s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (s == INVALID_SOCKET)
+      continue;
+    if (ConnectWithTimeout(s, ai->ai_addr, (int) ai->ai_addrlen, kConnectTimeoutMs))
+      break;
+    TINYG_CLOSE_SOCKET(s);
+    s = INVALID_SOCKET;
+  }
+  freeaddrinfo(result);
+  if (s == INVALID_SOCKET)
+  {
+    Close();
+    return ERR_PORT_OPEN_FAILED;
+  }
+  // commands are short and latency bound; never wait to coalesce them
+  int noDelay = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*) &noDelay, sizeof(noDelay));
+  socket_ = (size_t) s;
+  lost_ = false;
+  return DEVICE_OK;
+}
+
+void ShapeokoTinyGTcpTransport::Close()
+{
+  if (socket_ != kNoSocket)
+  {
+    TINYG_CLOSE_SOCKET((TinyGSocket) socket_);
+    socket_ = kNoSocket;
+  }
+#ifdef WIN32
+  if (winsock_)
+    WSACleanup();
+#endif
+  winsock_ = false;
+}
+
+int ShapeokoTinyGTcpTransport::Write(const unsigned char* data, unsigned len)
+{
+  if (socket_ == kNoSocket)
+    return ERR_NO_PORT_SET;
+  if (lost_)
+    return ERR_COMMUNICATION;
+  TinyGSocket s = (TinyGSocket) socket_;
+  while (len > 0)
+  {
+    int n = (int) send(s, (const char*) data, (int) len, kSendFlags);
+    if (n <= 0)
+      return ERR_WRITE_FAILED;
+    data += n;
+    len -= (unsigned) n;
+  }
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGTcpTransport::Read(unsigned char* buf, unsigned maxLen, unsigned long& bytesRead, long waitMs)
+{
+  bytesRead = 0;
+  if (socket_ == kNoSocket)
+    return ERR_NO_PORT_SET;
+  if (lost_)
+    return ERR_COMMUNICATION;
+  TinyGSocket s = (TinyGSocket) socket_;
+  int ready = WaitReadable(s, waitMs);
+  if (ready < 0)
+    return ERR_COMMUNICATION;
+  if (ready == 0)
+    return DEVICE_OK;
+  int n = (int) recv(s, (char*) buf, (int) maxLen, 0);
+  // readable with nothing to read means the server closed the connection
+  if (n <= 0)
+  {
+    lost_ = true;
+    return ERR_COMMUNICATION;
+  }
+  bytesRead = (unsigned long) n;
+  return DEVICE_OK;
+}
+
+int ShapeokoTinyGTcpTransport::Purge()
+{
+  if (socket_ == kNoSocket)
+    return ERR_NO_PORT_SET;
+  TinyGSocket s = (TinyGSocket) socket_;
+  char scratch[256];
+  while (WaitReadable(s, 0) > 0)
+  {
+    if (recv(s, scratch, sizeof(scratch), 0) <= 0)
+      return ERR_COMMUNICATION;
+  }
+  return DEVICE_OK;
+}
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Transport.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Byte transports beneath the ShapeokoTinyG hub.  The hub
+//                talks to the controller through one of these:
+//                 - a Micro-Manager serial port device, as it always has;
+//                 - a serial device opened directly with termios, in raw,
+//                   low-latency mode, so reads wake on the first byte and
+//                   bypass the core (not on Windows);
+//                 - a TCP connection to a serial server such as ser2net,
+//                   or to tinyg_sim -t.
+//                The reader thread is the only caller of Read; writes may
+//                come from any thread, one at a time per caller.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _SHAPEOKO_TINYG_TRANSPORT_H_
+#define _SHAPEOKO_TINYG_TRANSPORT_H_
+
+#include "MMDevice.h"
+#include <string>
+#include <cstddef>
+
+class ShapeokoTinyGTransport
+{
+ public:
+  virtual ~ShapeokoTinyGTransport() {}
+
+  virtual int Open() = 0;
+  virtual void Close() = 0;
+  // Writes all len bytes
+  virtual int Write(const unsigned char* data, unsigned len) = 0;
+  // Reads whatever has arrived, up to maxLen bytes, waiting at most waitMs
+  // for the first of them.  Sets bytesRead to 0 if nothing came.
+  virtual int Read(unsigned char* buf, unsigned maxLen, unsigned long& bytesRead, long waitMs) = 0;
+  // Discards input not read yet
+  virtual int Purge() = 0;
+  // True once the other end has closed the connection; every read and
+  // write fails at once from then on, until it is opened again
+  virtual bool IsLost() const { return false; }
+};
+
+// A port device managed by Micro-Manager.  Every call goes through the core.
+class ShapeokoTinyGMMSerialTransport : public ShapeokoTinyGTransport
+{
+ public:
+  ShapeokoTinyGMMSerialTransport(const MM::Device* caller, MM::Core* core, const std::string& port);
+
+  int Open();
+  void Close() {}
+  int Write(const unsigned char* data, unsigned len);
+  // the core cannot wait for input, so an empty read sleeps instead
+  int Read(unsigned char* buf, unsigned maxLen, unsigned long& bytesRead, long waitMs);
+  int Purge();
+
+ private:
+  const MM::Device* caller_;
+  MM::Core* core_;
+  std::string port_;
+};
+
+#ifndef WIN32
+// A serial device such as /dev/ttyUSB0, opened by the adapter itself
+class ShapeokoTinyGTermiosTransport : public ShapeokoTinyGTransport
+{
+ public:
+  ShapeokoTinyGTermiosTransport(const std::string& path, long baud);
+  ~ShapeokoTinyGTermiosTransport();
+
+  int Open();
+  void Close();
+  int Write(const unsigned char* data, unsigned len);
+  int Read(unsigned char* buf, unsigned maxLen, unsigned long& bytesRead, long waitMs);
+  int Purge();
+
+ private:
+  std::string path_;
+  long baud_;
+  int fd_;
+};
+#endif
+
+// A TCP connection to "host:port"
+class ShapeokoTinyGTcpTransport : public ShapeokoTinyGTransport
+{
+ public:
+  ShapeokoTinyGTcpTransport(const std::string& address);
+  ~ShapeokoTinyGTcpTransport();
+
+  int Open();
+  void Close();
+  int Write(const unsigned char* data, unsigned len);
+  int Read(unsigned char* buf, unsigned maxLen, unsigned long& bytesRead, long waitMs);
+  int Purge();
+  bool IsLost() const { return lost_; }
+
+ private:
+  std::string address_;
+  // a SOCKET on Windows, a descriptor elsewhere; (size_t) -1 when closed
+  size_t socket_;
+  bool winsock_;
+  volatile bool lost_;
+};
+
+#endif // _SHAPEOKO_TINYG_TRANSPORT_H_
@@ -1,8 +1,44 @@
 #include "ShapeokoTinyG.h"
 #include "XYStage.h"
+#include "TinyGFormat.h"
+#include "LineNumbers.h"
+#include <cstdio>
+#include <cstdlib>
 const char* g_StepSizeProp = "Step Size";
 const char* g_MaxVelocityProp = "Maximum Velocity";
 const char* g_AccelProp = "Acceleration";
+const char* g_AsyncMovesProp = "Asynchronous Moves";
+const char* g_SequenceDwellProp = "Sequence Dwell (ms)";
+const char* g_MoveProfileProp = "Move Profile";
+const char* g_LongHaulFeedProp = "Long-haul Feed (mm/min)";
+const char* g_ShortStepFeedProp = "Short-step Feed (mm/min)";
+const char* g_ShortStepThresholdProp = "Short-step Threshold (um)";
+const char* g_ScanRegionProps[] = {"Scan X Min (um)", "Scan Y Min (um)",
+    "Scan X Max (um)", "Scan Y Max (um)", "Scan Tile Width (um)",
+    "Scan Tile Height (um)", "Scan Overlap (%)"};
+const char* g_ScanDwellProp = "Scan Dwell (ms)";
+const char* g_ScanProp = "Scan";
+const char* g_ScanTilesProp = "Scan Tiles";
+const char* g_ScanTileProp = "Scan Tile";
+const char* g_SweepProps[] = {"Sweep Start X (um)", "Sweep Start Y (um)",
+    "Sweep End X (um)", "Sweep End Y (um)", "Sweep Trigger Interval (um)",
+    "Sweep Pulse Length (um)", "Sweep Velocity (mm/s)"};
+const char* g_SweepOutputProp = "Sweep Trigger Output";
+const char* g_SweepFileProp = "Sweep Trigger File";
+const char* g_SweepProp = "Sweep";
+const char* g_SweepTriggersProp = "Sweep Triggers";
+const char* g_SweepTriggerProp = "Sweep Trigger";
+const char* g_PositionOrderFileProp = "Position Order File";
+const char* g_PositionOrderUsesZProp = "Position Order Uses Z";
+const char* g_PositionOrderTimeLimitProp = "Position Order Time Limit (ms)";
+const char* g_PositionOrderResultProp = "Position Order Result";
+
+// the sequence lives on the host and is streamed, so the planner size
+// does not limit it
+const long g_MaxSequenceLength = 10000;
+// run-up and run-out of a sweep, relative to the distance needed to reach
+// its velocity, so the first and last triggers are clear of the S-curve
+const double g_SweepRunupMargin = 1.2;
 
 ///////////////////////////////////////////////////////////////////////////////
 // CShapeokoTinyGXYStage implementation
@@ -11,16 +47,39 @@ const char* g_AccelProp = "Acceleration";
 CShapeokoTinyGXYStage::CShapeokoTinyGXYStage() :
     CXYStageBase<CShapeokoTinyGXYStage>(),
     stepSize_um_(0.025),
-    max_velocity_(1000),
-    acceleration_(100),
+    max_velocity_(16000),
+    acceleration_(1000),
     posX_um_(0.0),
     posY_um_(0.0),
     busy_(false),
-    timeOutTimer_(0),
+    asyncMoves_(true),
     initialized_(false),
     lowerLimit_(0.0),
-    upperLimit_(20000.0)
+    upperLimit_(20000.0),
+    sequenceDwellMs_(0),
+    moveProfile_("Rapid"),
+    longHaulFeed_(10000.0),
+    shortStepFeed_(1000.0),
+    shortStepThreshold_um_(500.0),
+    scanDwellMs_(0),
+    scanActive_(false),
+    scanTilesReached_(0),
+    scanFirstLine_(1),
+    sweepOutput_("Flood (M8)"),
+    sweepActive_(false),
+    sweepTriggersReached_(0),
+    sweepFirstLine_(1),
+    sweepOutputArmed_(false),
+    orderUsesZ_(false),
+    orderTimeLimitMs_(500)
 {
+  const double region[] = {0.0, 0.0, 10000.0, 10000.0, 1000.0, 1000.0, 10.0};
+  for (int i = 0; i < 7; ++i)
+    scanRegion_[i] = region[i];
+  const double sweep[] = {0.0, 0.0, 10000.0, 0.0, 500.0, 20.0, 10.0};
+  for (int i = 0; i < 7; ++i)
+    sweep_[i] = sweep[i];
+
   InitializeDefaultErrorMessages();
 
   // parent ID display
@@ -44,7 +103,7 @@ void CShapeokoTinyGXYStage::GetName(char* Name) const
 
 int CShapeokoTinyGXYStage::Initialize()
 {
-  LogMessage("XYStage: initialize");
+  TINYG_TRACE(TINYG_TRACE_INFO, "XYStage: initialize");
   ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
   if (pHub)
   {
@@ -53,7 +112,7 @@ int CShapeokoTinyGXYStage::Initialize()
     SetParentID(hubLabel); // for backward comp.
   }
   else
-    LogMessage(NoHubError);
+    TINYG_TRACE(TINYG_TRACE_ERROR, NoHubError);
 
   if (initialized_)
     return DEVICE_OK;
@@ -74,16 +133,104 @@ int CShapeokoTinyGXYStage::Initialize()
   CPropertyAction* pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnStepSize);
   CreateProperty(g_StepSizeProp, CDeviceUtils::ConvertToString(stepSize_um_), MM::Float, false, pAct);
 
-  // Max Speed
+  // Start from what the board is configured with; from here on the two
+  // properties below write through to it
+  if (pHub)
+    ReadMotionSettings(pHub);
+
+  // Max Speed, mm/min
   pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnMaxVelocity);
   CreateProperty(g_MaxVelocityProp, CDeviceUtils::ConvertToString(max_velocity_), MM::Float, false, pAct);
-  SetPropertyLimits(g_MaxVelocityProp, 0.0, 1000.0);
+  SetPropertyLimits(g_MaxVelocityProp, 1.0, 50000.0);
 
-  // Acceleration
+  // Acceleration, mm/s^2
   pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnAcceleration);
   CreateProperty(g_AccelProp, CDeviceUtils::ConvertToString(acceleration_), MM::Float, false, pAct);
-  SetPropertyLimits("Acceleration", 0.0, 1000);
+  SetPropertyLimits("Acceleration", 1.0, 10000);
+
+  // Move profiles: Rapid uses G0 at the board's rapid rate, the others G1
+  // at their feed; Auto picks Short-step for moves below the threshold
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnMoveProfile);
+  CreateProperty(g_MoveProfileProp, moveProfile_.c_str(), MM::String, false, pAct);
+  AddAllowedValue(g_MoveProfileProp, "Rapid");
+  AddAllowedValue(g_MoveProfileProp, "Long-haul");
+  AddAllowedValue(g_MoveProfileProp, "Short-step");
+  AddAllowedValue(g_MoveProfileProp, "Auto");
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnLongHaulFeed);
+  CreateProperty(g_LongHaulFeedProp, CDeviceUtils::ConvertToString(longHaulFeed_), MM::Float, false, pAct);
+  SetPropertyLimits(g_LongHaulFeedProp, 1.0, 50000.0);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnShortStepFeed);
+  CreateProperty(g_ShortStepFeedProp, CDeviceUtils::ConvertToString(shortStepFeed_), MM::Float, false, pAct);
+  SetPropertyLimits(g_ShortStepFeedProp, 1.0, 50000.0);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnShortStepThreshold);
+  CreateProperty(g_ShortStepThresholdProp, CDeviceUtils::ConvertToString(shortStepThreshold_um_), MM::Float, false, pAct);
+  SetPropertyLimits(g_ShortStepThresholdProp, 0.0, 100000.0);
+
+  // Asynchronous moves return as soon as the move is sent; Busy() then
+  // follows the machine state reported by the controller
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnAsyncMoves);
+  CreateProperty(g_AsyncMovesProp, asyncMoves_ ? "Yes" : "No", MM::String, false, pAct);
+  AddAllowedValue(g_AsyncMovesProp, "Yes");
+  AddAllowedValue(g_AsyncMovesProp, "No");
+
+  // Dwell at each sequence position; 0 lets consecutive moves blend
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnSequenceDwell);
+  CreateProperty(g_SequenceDwellProp, "0", MM::Integer, false, pAct);
+  SetPropertyLimits(g_SequenceDwellProp, 0, 60000);
+
+  // Tiled scan
+  for (long i = 0; i < 7; ++i)
+  {
+    CPropertyActionEx* pActEx = new CPropertyActionEx (this, &CShapeokoTinyGXYStage::OnScanRegion, i);
+    CreateProperty(g_ScanRegionProps[i], CDeviceUtils::ConvertToString(scanRegion_[i]), MM::Float, false, pActEx);
+  }
+  SetPropertyLimits(g_ScanRegionProps[6], 0.0, 90.0);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnScanDwell);
+  CreateProperty(g_ScanDwellProp, "0", MM::Integer, false, pAct);
+  SetPropertyLimits(g_ScanDwellProp, 0, 60000);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnScan);
+  CreateProperty(g_ScanProp, "Idle", MM::String, false, pAct);
+  AddAllowedValue(g_ScanProp, "Idle");
+  AddAllowedValue(g_ScanProp, "Running");
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnScanTiles);
+  CreateProperty(g_ScanTilesProp, "0", MM::Integer, true, pAct);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnScanTile);
+  CreateProperty(g_ScanTileProp, "0", MM::Integer, true, pAct);
+
+  // On-the-fly sweep
+  for (long i = 0; i < 7; ++i)
+  {
+    CPropertyActionEx* pActEx = new CPropertyActionEx (this, &CShapeokoTinyGXYStage::OnSweepLine, i);
+    CreateProperty(g_SweepProps[i], CDeviceUtils::ConvertToString(sweep_[i]), MM::Float, false, pActEx);
+  }
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnSweepOutput);
+  CreateProperty(g_SweepOutputProp, sweepOutput_.c_str(), MM::String, false, pAct);
+  AddAllowedValue(g_SweepOutputProp, "Flood (M8)");
+  AddAllowedValue(g_SweepOutputProp, "Mist (M7)");
+  // optional; the expected trigger positions are written here at each start
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnSweepFile);
+  CreateProperty(g_SweepFileProp, "", MM::String, false, pAct);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnSweep);
+  CreateProperty(g_SweepProp, "Idle", MM::String, false, pAct);
+  AddAllowedValue(g_SweepProp, "Idle");
+  AddAllowedValue(g_SweepProp, "Running");
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnSweepTriggers);
+  CreateProperty(g_SweepTriggersProp, "0", MM::Integer, true, pAct);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnSweepTrigger);
+  CreateProperty(g_SweepTriggerProp, "0", MM::Integer, true, pAct);
 
+  // Travel-optimized order for a file of positions; setting the file runs it
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnPositionOrderFile);
+  CreateProperty(g_PositionOrderFileProp, "", MM::String, false, pAct);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnPositionOrderUsesZ);
+  CreateProperty(g_PositionOrderUsesZProp, "No", MM::String, false, pAct);
+  AddAllowedValue(g_PositionOrderUsesZProp, "Yes");
+  AddAllowedValue(g_PositionOrderUsesZProp, "No");
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnPositionOrderTimeLimit);
+  CreateProperty(g_PositionOrderTimeLimitProp, CDeviceUtils::ConvertToString(orderTimeLimitMs_), MM::Integer, false, pAct);
+  SetPropertyLimits(g_PositionOrderTimeLimitProp, 10, 60000);
+  pAct = new CPropertyAction (this, &CShapeokoTinyGXYStage::OnPositionOrderResult);
+  CreateProperty(g_PositionOrderResultProp, "", MM::String, true, pAct);
 
 
 
@@ -91,6 +238,8 @@ int CShapeokoTinyGXYStage::Initialize()
   if (ret != DEVICE_OK)
     return ret;
 
+  if (pHub)
+    pHub->AddPositionListener(this);
   initialized_ = true;
 
   return DEVICE_OK;
@@ -100,6 +249,14 @@ int CShapeokoTinyGXYStage::Shutdown()
 {
   if (initialized_)
   {
+    ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+    if (pHub != 0)
+    {
+      pHub->SetLineListener(0);
+      pHub->RemovePositionListener(this);
+    }
+    scanActive_ = false;
+    sweepActive_ = false;
     initialized_ = false;
   }
   return DEVICE_OK;
@@ -107,107 +264,620 @@ int CShapeokoTinyGXYStage::Shutdown()
 
 bool CShapeokoTinyGXYStage::Busy()
 {
-  LogMessage("XYStage: Busy called");
-  if (timeOutTimer_ == 0)
-    return false;
-  if (timeOutTimer_->expired(GetCurrentMMTime()))
-  {
-    // delete(timeOutTimer_);
-    LogMessage("XYStage: Busy return false");
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "XYStage: Busy called");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  if (pHub == 0)
     return false;
-  }
-  LogMessage("XYStage: Busy return true");
-  return true;
+  return pHub->IsMoving() || pHub->IsStreaming();
 }
 
 double CShapeokoTinyGXYStage::GetStepSize() {return stepSize_um_;}
 
 int CShapeokoTinyGXYStage::SetPositionSteps(long x, long y)
 {
-  LogMessage("XYStage: SetPositionSteps");
-  if (timeOutTimer_ != 0)
-  {
-    if (!timeOutTimer_->expired(GetCurrentMMTime()))
-      return ERR_STAGE_MOVING;
-    delete (timeOutTimer_);
-  }
-  double newPosX = x * stepSize_um_;
-  double newPosY = y * stepSize_um_;
-  double difX = newPosX - posX_um_;
-  double difY = newPosY - posY_um_;
-  double distance = sqrt( (difX * difX) + (difY * difY) );
-  // long timeOut = (long) (distance / velocity_);
-  long timeOut = 1000;
-  timeOutTimer_ = new MM::TimeoutMs(GetCurrentMMTime(),  timeOut);
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "XYStage: SetPositionSteps");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  // a move that is still running is retargeted by the hub; only a scan
+  // or sequence holding the planner refuses new positions
+  if (pHub->IsStreaming())
+    return ERR_STAGE_MOVING;
+  double distance_um = sqrt((x * stepSize_um_ - posX_um_) * (x * stepSize_um_ - posX_um_) +
+      (y * stepSize_um_ - posY_um_) * (y * stepSize_um_ - posY_um_));
   posX_um_ = x * stepSize_um_;
   posY_um_ = y * stepSize_um_;
 
-  // TODO(dek): if no position change, don't send new position.
-  char buff[100];
-  sprintf(buff, "G0 X%f Y%f", posX_um_/1000., posY_um_/1000.);
-  std::string buffAsStdStr = buff;
-  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
-  int ret = pHub->SendMotionCommand(buffAsStdStr);
-  if (ret != DEVICE_OK)
-    return ret;
-
-  ret = OnXYStagePositionChanged(posX_um_, posY_um_);
+  // the hub drops the move if nothing changes
+  double target[3] = {posX_um_/1000., posY_um_/1000., 0.0};
+  int ret = pHub->MoveAxes(TINYG_AXIS_X | TINYG_AXIS_Y, target, !asyncMoves_, MoveFeed(distance_um));
   if (ret != DEVICE_OK)
     return ret;
 
+  // the core hears about the move from the hub's status poller as the
+  // stage actually travels
   return DEVICE_OK;
 }
 
+/*
+ * Reports the position measured by the controller, as cached by the hub
+ * from its status reports, so no serial I/O happens here.  Until the first
+ * report arrives the last commanded position is used.
+ */
 int CShapeokoTinyGXYStage::GetPositionSteps(long& x, long& y)
 {
-  LogMessage("XYStage: GetPositionSteps");
-  x = (long)(posX_um_ / stepSize_um_);
-  y = (long)(posY_um_ / stepSize_um_);
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  TinyGMachineStatus status;
+  pHub->GetMachineStatus(status);
+  if (!status.valid)
+  {
+    x = (long)(posX_um_ / stepSize_um_);
+    y = (long)(posY_um_ / stepSize_um_);
+    return DEVICE_OK;
+  }
+  x = (long) floor(status.pos[0] * 1000. / stepSize_um_ + 0.5);
+  y = (long) floor(status.pos[1] * 1000. / stepSize_um_ + 0.5);
   return DEVICE_OK;
 }
 
 int CShapeokoTinyGXYStage::SetRelativePositionSteps(long x, long y)
 {
-  LogMessage("XYStage: SetRelativePositioNSteps");
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "XYStage: SetRelativePositioNSteps");
   long xSteps, ySteps;
   GetPositionSteps(xSteps, ySteps);
 
   return this->SetPositionSteps(xSteps+x, ySteps+y);
 }
 
-int CShapeokoTinyGXYStage::Home() {   LogMessage("TinyG XYStage home.");
-return DEVICE_OK; }
-int CShapeokoTinyGXYStage::Stop() { LogMessage("TinyG XYStage stop.");
-return DEVICE_OK; }
+/*
+ * Starts homing X and Y and returns; Busy() stays true until the cycle
+ * ends.  The hub's "Homing Status" property tells how it went.
+ */
+int CShapeokoTinyGXYStage::Home()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage home.");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  return pHub->StartHoming(TINYG_AXIS_X | TINYG_AXIS_Y);
+}
+int CShapeokoTinyGXYStage::Stop()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage stop.");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  scanActive_ = false;
+  sweepActive_ = false;
+  // the feedhold stops Z as well
+  int ret = pHub->StopMotion();
+  if (ret != DEVICE_OK)
+    return ret;
+  // a flushed pulse, or the flushed M9 after the last one, may have left
+  // the trigger output on
+  if (sweepOutputArmed_)
+  {
+    ret = pHub->SendCommand("M9", kLaneMotion);
+    if (ret != DEVICE_OK)
+      return ret;
+    sweepOutputArmed_ = false;
+  }
+  TinyGMachineStatus status;
+  pHub->GetMachineStatus(status);
+  if (status.valid)
+  {
+    posX_um_ = status.pos[0] * 1000.;
+    posY_um_ = status.pos[1] * 1000.;
+  }
+  return DEVICE_OK;
+}
 
-int CShapeokoTinyGXYStage::SetOrigin() { LogMessage("TinyG XYStage set origin."); return DEVICE_OK; }
+int CShapeokoTinyGXYStage::SetOrigin()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage set origin.");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  int ret = pHub->SetOrigin(TINYG_AXIS_X | TINYG_AXIS_Y);
+  if (ret != DEVICE_OK)
+    return ret;
+  posX_um_ = 0.0;
+  posY_um_ = 0.0;
+  return OnXYStagePositionChanged(0.0, 0.0);
+}
 
 int CShapeokoTinyGXYStage::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax)
 {
-  LogMessage("TinyG XYStage get limits um");
+  TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage get limits um");
   xMin = lowerLimit_; xMax = upperLimit_;
   yMin = lowerLimit_; yMax = upperLimit_;
   return DEVICE_OK;
 }
 
 int CShapeokoTinyGXYStage::GetStepLimits(long& /*xMin*/, long& /*xMax*/, long& /*yMin*/, long& /*yMax*/)
-{   LogMessage("TinyG XYStage get limits um");
+{   TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage get limits um");
 return DEVICE_UNSUPPORTED_COMMAND; }
 
-double CShapeokoTinyGXYStage::GetStepSizeXUm() {   LogMessage("TinyG XYStage get step size x um");
+double CShapeokoTinyGXYStage::GetStepSizeXUm() {   TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage get step size x um");
 return stepSize_um_; }
-double CShapeokoTinyGXYStage::GetStepSizeYUm() {   LogMessage("TinyG XYStage get step size y um");
+double CShapeokoTinyGXYStage::GetStepSizeYUm() {   TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage get step size y um");
 return stepSize_um_; }
-int CShapeokoTinyGXYStage::Move(double /*vx*/, double /*vy*/) {LogMessage("TinyG XYStage move"); return DEVICE_OK;}
+/*
+ * Velocity mode, vx and vy in mm/s; (0, 0) stops.  The speed is capped at
+ * "Maximum Velocity".  A joystick may call this as often as it likes: while
+ * jogging, only the velocity of the segments still to be queued changes.
+ */
+int CShapeokoTinyGXYStage::Move(double vx, double vy)
+{
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG XYStage move");
+  double speed = sqrt(vx * vx + vy * vy);
+  double maxSpeed = max_velocity_ / 60.;
+  if (speed > maxSpeed)
+  {
+    vx *= maxSpeed / speed;
+    vy *= maxSpeed / speed;
+  }
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  return pHub->Jog(vx, vy);
+}
+
+int CShapeokoTinyGXYStage::IsXYStageSequenceable(bool& isSequenceable) const {isSequenceable = true; return DEVICE_OK;}
+int CShapeokoTinyGXYStage::GetXYStageSequenceMaxLength(long& nrEvents) const {nrEvents = g_MaxSequenceLength; return DEVICE_OK;}
+
+int CShapeokoTinyGXYStage::ClearXYStageSequence()
+{
+  sequenceX_um_.clear();
+  sequenceY_um_.clear();
+  sequenceCommands_.clear();
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::AddToXYStageSequence(double positionX, double positionY)
+{
+  if ((long) sequenceX_um_.size() >= g_MaxSequenceLength)
+    return DEVICE_SEQUENCE_TOO_LARGE;
+  sequenceX_um_.push_back(positionX);
+  sequenceY_um_.push_back(positionY);
+  return DEVICE_OK;
+}
+
+// Turns the positions into the G-code that StartXYStageSequence streams
+int CShapeokoTinyGXYStage::SendXYStageSequence()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage send sequence");
+  sequenceCommands_.clear();
+  char buff[100];
+  for (size_t i = 0; i < sequenceX_um_.size(); ++i)
+  {
+    sprintf(buff, "G0 X%f Y%f", sequenceX_um_[i]/1000., sequenceY_um_[i]/1000.);
+    sequenceCommands_.push_back(buff);
+    if (sequenceDwellMs_ > 0)
+    {
+      sprintf(buff, "G4 P%.3f", sequenceDwellMs_/1000.);
+      sequenceCommands_.push_back(buff);
+    }
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::StartXYStageSequence()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage start sequence");
+  if (sequenceCommands_.empty())
+    return DEVICE_OK;
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  int ret = pHub->StreamCommands(sequenceCommands_);
+  if (ret != DEVICE_OK)
+    return ret;
+  posX_um_ = sequenceX_um_.back();
+  posY_um_ = sequenceY_um_.back();
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::StopXYStageSequence()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage stop sequence");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  pHub->StopStreaming();
+  return DEVICE_OK;
+}
+
+/*
+ * Every tile is one numbered move, N(first+2k), and a dwell, N(first+2k+1),
+ * like the Z stage's sequences.  The dwell is sent even when zero: it stops
+ * the stage on the tile, and its line number tells us the tile was reached.
+ */
+int CShapeokoTinyGXYStage::StartScan()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage start scan");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  if (pHub->IsStreaming())
+    return ERR_STAGE_MOVING;
+
+  TinyGScanRegion region;
+  region.xMin_um = scanRegion_[0];
+  region.yMin_um = scanRegion_[1];
+  region.xMax_um = scanRegion_[2];
+  region.yMax_um = scanRegion_[3];
+  region.tileWidth_um = scanRegion_[4];
+  region.tileHeight_um = scanRegion_[5];
+  region.overlap = scanRegion_[6] / 100.0;
+  scanTiles_.clear();
+  if (!BuildSerpentineScan(region, scanTiles_) || (long) scanTiles_.size() > g_MaxSequenceLength)
+    return DEVICE_INVALID_PROPERTY_VALUE;
+
+  long firstLine = pHub->ReserveStreamLines(2 * (long) scanTiles_.size());
+  std::vector<std::string> commands;
+  commands.reserve(2 * scanTiles_.size());
+  char buff[100];
+  for (size_t i = 0; i < scanTiles_.size(); ++i)
+  {
+    sprintf(buff, "N%ld G0 X%f Y%f", firstLine + (long) (2 * i), scanTiles_[i].x_um/1000., scanTiles_[i].y_um/1000.);
+    commands.push_back(buff);
+    sprintf(buff, "N%ld G4 P%.3f", firstLine + (long) (2 * i + 1), scanDwellMs_/1000.);
+    commands.push_back(buff);
+  }
+  if (g_TinyGTraceLevel >= TINYG_TRACE_INFO)
+  {
+    sprintf(buff, "TinyG XYStage scan of %ld tiles, %.1f mm of travel",
+        (long) scanTiles_.size(), ScanPathLength(scanTiles_) / 1000.);
+    TINYG_TRACE(TINYG_TRACE_INFO, buff);
+  }
+
+  scanTilesReached_ = 0;
+  scanFirstLine_ = firstLine;
+  sweepActive_ = false;
+  scanActive_ = true;
+  pHub->SetLineListener(this);
+  int ret = pHub->StreamCommands(commands);
+  if (ret != DEVICE_OK)
+  {
+    scanActive_ = false;
+    return ret;
+  }
+  posX_um_ = scanTiles_.back().x_um;
+  posY_um_ = scanTiles_.back().y_um;
+  return OnPropertyChanged(g_ScanTileProp, "0");
+}
 
-int CShapeokoTinyGXYStage::IsXYStageSequenceable(bool& isSequenceable) const {isSequenceable = false; return DEVICE_OK;}
+// Stops feeding the planner; tiles already queued are still visited
+int CShapeokoTinyGXYStage::StopScan()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage stop scan");
+  scanActive_ = false;
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  pHub->StopStreaming();
+  return DEVICE_OK;
+}
+
+/*
+ * TinyG limits jerk rather than acceleration.  Its S-curve reaches a peak
+ * acceleration of a = sqrt(j * v) on the way to velocity v, so the
+ * "Acceleration" property maps to j = a^2 / v.  Jerk settings are in units
+ * of 10^6 mm/min^3.
+ */
+static double JerkSetting(double velocity_mm_min, double accel_mm_s2)
+{
+  double accel_mm_min2 = accel_mm_s2 * 3600.;
+  return accel_mm_min2 * accel_mm_min2 / velocity_mm_min / 1e6;
+}
+
+/*
+ * The line is led in and out by the distance the stage needs to reach full
+ * speed, so every trigger is passed at constant velocity.  Pulse k is
+ *   M8, N(first+k) G1 to trigger + pulse length, M9, G1 to the next trigger
+ * with M7 instead of M8 if chosen; TinyG runs queued M-codes in order
+ * with the moves around them.  The first line number is reserved from the
+ * hub, so that a report from before the sweep cannot count as a pulse.
+ */
+int CShapeokoTinyGXYStage::StartSweep()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage start sweep");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  if (pHub->IsStreaming())
+    return ERR_STAGE_MOVING;
+
+  TinyGSweepLine line;
+  line.startX_um = sweep_[0];
+  line.startY_um = sweep_[1];
+  line.endX_um = sweep_[2];
+  line.endY_um = sweep_[3];
+  line.interval_um = sweep_[4];
+  double pulse_mm = sweep_[5] / 1000.;
+  double velocity = sweep_[6];
+  sweepTriggers_.clear();
+  if (velocity <= 0.0 || velocity > max_velocity_ / 60. ||
+      sweep_[5] <= 0.0 || sweep_[5] >= line.interval_um ||
+      !BuildSweepTriggers(line, sweepTriggers_) ||
+      (long) sweepTriggers_.size() > g_MaxSequenceLength)
+    return DEVICE_INVALID_PROPERTY_VALUE;
+
+  double dx = line.endX_um - line.startX_um;
+  double dy = line.endY_um - line.startY_um;
+  double length = sqrt(dx * dx + dy * dy);
+  double ux = dx / length;
+  double uy = dy / length;
+  // With jerk j and no constant-acceleration phase, TinyG reaches v in
+  // 2 sqrt(v / j) at an average of v / 2, covering v sqrt(v / j).  The
+  // jerk is the one written to the controller, which for a sweep below the
+  // maximum velocity gives a longer run-up than v^2 / a would suggest.
+  double jerk_mm_s3 = JerkSetting(max_velocity_, acceleration_) * 1e6 / (60. * 60. * 60.);
+  double runup_mm = g_SweepRunupMargin * velocity * sqrt(velocity / jerk_mm_s3);
+  const char* on = sweepOutput_ == "Mist (M7)" ? "M7" : "M8";
+
+  long firstLine = pHub->ReserveStreamLines((long) sweepTriggers_.size());
+  std::vector<std::string> commands;
+  commands.reserve(4 * sweepTriggers_.size() + 2);
+  TinyGCommand command("G0 X");
+  command.AppendFixed(sweepTriggers_[0].x_um / 1000. - ux * runup_mm, 4)
+      .Append(" Y").AppendFixed(sweepTriggers_[0].y_um / 1000. - uy * runup_mm, 4);
+  commands.push_back(command.c_str());
+  command.Clear();
+  command.Append("G1 F").AppendFixed(velocity * 60., 1)
+      .Append(" X").AppendFixed(sweepTriggers_[0].x_um / 1000., 4)
+      .Append(" Y").AppendFixed(sweepTriggers_[0].y_um / 1000., 4);
+  commands.push_back(command.c_str());
+  double endX = 0.0, endY = 0.0;
+  for (size_t i = 0; i < sweepTriggers_.size(); ++i)
+  {
+    double x = sweepTriggers_[i].x_um / 1000.;
+    double y = sweepTriggers_[i].y_um / 1000.;
+    commands.push_back(on);
+    command.Clear();
+    command.Append('N').AppendLong(firstLine + (long) i)
+        .Append(" G1 X").AppendFixed(x + ux * pulse_mm, 4)
+        .Append(" Y").AppendFixed(y + uy * pulse_mm, 4);
+    commands.push_back(command.c_str());
+    commands.push_back("M9");
+    if (i + 1 < sweepTriggers_.size())
+    {
+      endX = sweepTriggers_[i + 1].x_um / 1000.;
+      endY = sweepTriggers_[i + 1].y_um / 1000.;
+    }
+    else
+    {
+      endX = x + ux * (pulse_mm + runup_mm);
+      endY = y + uy * (pulse_mm + runup_mm);
+    }
+    command.Clear();
+    command.Append("G1 X").AppendFixed(endX, 4).Append(" Y").AppendFixed(endY, 4);
+    commands.push_back(command.c_str());
+  }
+
+  if (!sweepFile_.empty())
+  {
+    FILE* out = fopen(sweepFile_.c_str(), "w");
+    if (out == 0)
+      return DEVICE_INVALID_PROPERTY_VALUE;
+    for (size_t i = 0; i < sweepTriggers_.size(); ++i)
+      fprintf(out, "%ld,%.3f,%.3f\n", (long) i, sweepTriggers_[i].x_um, sweepTriggers_[i].y_um);
+    if (fclose(out) != 0)
+      return DEVICE_ERR;
+  }
+  if (g_TinyGTraceLevel >= TINYG_TRACE_INFO)
+  {
+    char buff[100];
+    sprintf(buff, "TinyG XYStage sweep of %ld triggers at %.1f mm/s",
+        (long) sweepTriggers_.size(), velocity);
+    TINYG_TRACE(TINYG_TRACE_INFO, buff);
+  }
+
+  sweepTriggersReached_ = 0;
+  sweepFirstLine_ = firstLine;
+  scanActive_ = false;
+  sweepActive_ = true;
+  sweepOutputArmed_ = true;
+  pHub->SetLineListener(this);
+  int ret = pHub->StreamCommands(commands);
+  if (ret != DEVICE_OK)
+  {
+    sweepActive_ = false;
+    return ret;
+  }
+  posX_um_ = endX * 1000.;
+  posY_um_ = endY * 1000.;
+  return OnPropertyChanged(g_SweepTriggerProp, "0");
+}
+
+// Stops feeding the planner and queues an M9 behind whatever was sent,
+// so the output cannot be left on by a pulse cut in half
+int CShapeokoTinyGXYStage::StopSweep()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage stop sweep");
+  sweepActive_ = false;
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  pHub->StopStreaming();
+  int ret = pHub->SendCommand("M9", kLaneMotion);
+  if (ret != DEVICE_OK)
+    return ret;
+  sweepOutputArmed_ = false;
+  return DEVICE_OK;
+}
+
+// Reader thread.  Reports skip lines when tiles go by faster than the
+// status interval, so every tile up to the reported one counts as reached.
+// A sweep numbers its pulses directly.  Lines outside the running stream's
+// range are left over from before it and ignored.
+void CShapeokoTinyGXYStage::OnLineReached(long line)
+{
+  if (sweepActive_)
+  {
+    long triggers = (long) sweepTriggers_.size();
+    long reached = TinyGItemsReached(line, sweepFirstLine_, triggers, 1);
+    if (reached <= sweepTriggersReached_)
+      return;
+    sweepTriggersReached_ = reached;
+    if (reached == triggers)
+      sweepActive_ = false;
+    OnPropertyChanged(g_SweepTriggerProp, CDeviceUtils::ConvertToString(reached));
+    return;
+  }
+  if (!scanActive_)
+    return;
+  long tiles = (long) scanTiles_.size();
+  long reached = TinyGItemsReached(line, scanFirstLine_, tiles, 2);
+  if (reached <= scanTilesReached_)
+    return;
+  scanTilesReached_ = reached;
+  if (reached == tiles)
+    scanActive_ = false;
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "TinyG XYStage scan tile " + std::string(CDeviceUtils::ConvertToString(reached)));
+  OnPropertyChanged(g_ScanTileProp, CDeviceUtils::ConvertToString(reached));
+}
+
+// Status poller thread
+void CShapeokoTinyGXYStage::OnPositionChanged(unsigned axes, const double* pos_mm)
+{
+  if (axes & (TINYG_AXIS_X | TINYG_AXIS_Y))
+    OnXYStagePositionChanged(pos_mm[0] * 1000., pos_mm[1] * 1000.);
+}
+
+// XY limits for path costs; Z starts out the same and is off
+TinyGPathOptions CShapeokoTinyGXYStage::PathOptions() const
+{
+  TinyGPathOptions options;
+  // mm/min and mm/s^2 to um/s and um/s^2
+  options.x.velocity = max_velocity_ * 1000. / 60.;
+  options.x.accel = acceleration_ * 1000.;
+  options.y = options.x;
+  options.z = options.x;
+  options.useZ = false;
+  options.start = 0;
+  options.timeLimitMs = (double) orderTimeLimitMs_;
+  return options;
+}
+
+int CShapeokoTinyGXYStage::OrderPositions(const std::vector<TinyGPathPoint>& points, bool useZ, std::vector<long>& order)
+{
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  TinyGPathOptions options = PathOptions();
+  options.useZ = useZ;
+  if (useZ)
+  {
+    double velocity, jerk;
+    if (pHub->GetConfigValue("zvm", velocity) != DEVICE_OK || velocity <= 0.0 ||
+        pHub->GetConfigValue("zjm", jerk) != DEVICE_OK || jerk <= 0.0)
+      return ERR_COMMUNICATION;
+    options.z.velocity = velocity * 1000. / 60.;
+    options.z.accel = sqrt(jerk * 1e6 * velocity) / 3600. * 1000.;
+  }
+
+  TinyGMachineStatus status;
+  pHub->GetMachineStatus(status);
+  TinyGPathPoint here;
+  here.x_um = status.valid ? status.pos[0] * 1000. : posX_um_;
+  here.y_um = status.valid ? status.pos[1] * 1000. : posY_um_;
+  here.z_um = status.valid ? status.pos[2] * 1000. : 0.0;
+  options.start = 0;
+  double nearest = 0.0;
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    double t = TinyGMoveTime(here, points[i], options);
+    if (i == 0 || t < nearest)
+    {
+      nearest = t;
+      options.start = (long) i;
+    }
+  }
+  TinyGOrderPath(points, options, order);
+  return DEVICE_OK;
+}
+
+// Reads up to three numbers separated by commas, semicolons or blanks
+static int ParseNumbers(const char* line, double* values)
+{
+  int count = 0;
+  const char* p = line;
+  while (count < 3)
+  {
+    while (*p == ' ' || *p == '\t' || *p == ',' || *p == ';')
+      ++p;
+    char* end;
+    double value = strtod(p, &end);
+    if (end == p)
+      break;
+    values[count++] = value;
+    p = end;
+  }
+  return count;
+}
+
+// Lines that do not start with two numbers, e.g. a header, are skipped
+int CShapeokoTinyGXYStage::OrderPositionFile(const std::string& path)
+{
+  FILE* in = fopen(path.c_str(), "r");
+  if (in == 0)
+  {
+    orderResult_ = "Cannot open " + path;
+    return DEVICE_INVALID_PROPERTY_VALUE;
+  }
+  std::vector<TinyGPathPoint> points;
+  bool hasZ = true;
+  char line[256];
+  while (fgets(line, sizeof(line), in) != 0)
+  {
+    double values[3];
+    int count = ParseNumbers(line, values);
+    if (count < 2)
+      continue;
+    TinyGPathPoint point;
+    point.x_um = values[0];
+    point.y_um = values[1];
+    point.z_um = count > 2 ? values[2] : 0.0;
+    hasZ = hasZ && count > 2;
+    points.push_back(point);
+  }
+  fclose(in);
+  if (points.empty())
+  {
+    orderResult_ = "No positions in " + path;
+    return DEVICE_INVALID_PROPERTY_VALUE;
+  }
+
+  bool useZ = orderUsesZ_ && hasZ;
+  MM::MMTime start = GetCurrentMMTime();
+  std::vector<long> order;
+  int ret = OrderPositions(points, useZ, order);
+  if (ret != DEVICE_OK)
+  {
+    orderResult_ = "Cannot read the Z axis settings";
+    return ret;
+  }
+  double elapsedMs = (GetCurrentMMTime() - start).getMsec();
+
+  std::string outPath = path + ".ordered";
+  FILE* out = fopen(outPath.c_str(), "w");
+  if (out == 0)
+  {
+    orderResult_ = "Cannot write " + outPath;
+    return DEVICE_ERR;
+  }
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    const TinyGPathPoint& p = points[order[i]];
+    if (hasZ)
+      fprintf(out, "%ld,%.3f,%.3f,%.3f\n", order[i], p.x_um, p.y_um, p.z_um);
+    else
+      fprintf(out, "%ld,%.3f,%.3f\n", order[i], p.x_um, p.y_um);
+  }
+  if (fclose(out) != 0)
+  {
+    orderResult_ = "Cannot write " + outPath;
+    return DEVICE_ERR;
+  }
+
+  // travel in the given order against the new one, by the same cost
+  std::vector<long> given(points.size());
+  for (size_t i = 0; i < given.size(); ++i)
+    given[i] = (long) i;
+  TinyGPathOptions options = PathOptions();
+  char buff[200];
+  sprintf(buff, "%ld positions, %.1f s of XY travel instead of %.1f s, ordered in %.0f ms",
+      (long) points.size(), TinyGPathTime(points, order, options),
+      TinyGPathTime(points, given, options), elapsedMs);
+  orderResult_ = buff;
+  TINYG_TRACE(TINYG_TRACE_INFO, "TinyG XYStage position order: " + orderResult_);
+  return DEVICE_OK;
+}
 
 int CShapeokoTinyGXYStage::OnStepSize(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-LogMessage("TinyG XYStage OnStepSize");
+TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage OnStepSize");
   if (eAct == MM::BeforeGet)
   {
-        LogMessage("TinyG XYStage OnStepSizex");
+        TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage OnStepSizex");
 
     pProp->Set(stepSize_um_);
   }
@@ -223,15 +893,63 @@ LogMessage("TinyG XYStage OnStepSize");
   }
 
    
-  LogMessage("Set step size");
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "Set step size");
 
   return DEVICE_OK;
 }
 
-// TODO(dek): these should send actual commands to update the device
+// Feed rate (mm/min) of the current move profile for a move of this
+// length; 0 means a G0 at the board's rapid rate
+double CShapeokoTinyGXYStage::MoveFeed(double distance_um) const
+{
+  if (moveProfile_ == "Long-haul")
+    return longHaulFeed_;
+  if (moveProfile_ == "Short-step")
+    return shortStepFeed_;
+  if (moveProfile_ == "Auto")
+    return distance_um < shortStepThreshold_um_ ? shortStepFeed_ : longHaulFeed_;
+  return 0.0;
+}
+
+void CShapeokoTinyGXYStage::ReadMotionSettings(ShapeokoTinyGHub* pHub)
+{
+  double velocity, jerk;
+  if (pHub->GetConfigValue("xvm", velocity) != DEVICE_OK || velocity <= 0.0)
+    return;
+  max_velocity_ = velocity;
+  if (pHub->GetConfigValue("xjm", jerk) != DEVICE_OK || jerk <= 0.0)
+    return;
+  acceleration_ = sqrt(jerk * 1e6 * velocity) / 3600.;
+}
+
+// Velocity goes to both the rapid (G0) and the feed (G1) limit of X and Y
+int CShapeokoTinyGXYStage::WriteVelocity()
+{
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  const char* keys[] = {"xvm", "yvm", "xfr", "yfr"};
+  for (int i = 0; i < 4; ++i)
+  {
+    int ret = pHub->SetConfigValue(keys[i], max_velocity_);
+    if (ret != DEVICE_OK)
+      return ret;
+  }
+  // the jerk that gives the requested acceleration depends on velocity
+  return WriteJerk();
+}
+
+int CShapeokoTinyGXYStage::WriteJerk()
+{
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  double jerk = JerkSetting(max_velocity_, acceleration_);
+  int ret = pHub->SetConfigValue("xjm", jerk);
+  if (ret != DEVICE_OK)
+    return ret;
+  return pHub->SetConfigValue("yjm", jerk);
+}
+
 int CShapeokoTinyGXYStage::OnMaxVelocity(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-LogMessage("TinyG XYStage OnmaxVelocity");
+TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage OnmaxVelocity");
   if (eAct == MM::BeforeGet)
   {
         
@@ -245,12 +963,15 @@ LogMessage("TinyG XYStage OnmaxVelocity");
       double max_velocity;
       pProp->Get(max_velocity);
       max_velocity_ = max_velocity;
+      int ret = WriteVelocity();
+      if (ret != DEVICE_OK)
+        return ret;
     }
 
   }
 
    
-  LogMessage("Set velocity");
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "Set velocity");
 
   return DEVICE_OK;
 }
@@ -258,7 +979,7 @@ LogMessage("TinyG XYStage OnmaxVelocity");
 
 int CShapeokoTinyGXYStage::OnAcceleration(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-LogMessage("TinyG XYStage OnAcceleration");
+TINYG_TRACE(TINYG_TRACE_VERBOSE, "TinyG XYStage OnAcceleration");
   if (eAct == MM::BeforeGet)
   {
         
@@ -272,16 +993,293 @@ LogMessage("TinyG XYStage OnAcceleration");
       double acceleration;
       pProp->Get(acceleration);
       acceleration_ = acceleration;
+      int ret = WriteJerk();
+      if (ret != DEVICE_OK)
+        return ret;
     }
 
   }
 
    
-  LogMessage("Set acceleration");
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "Set acceleration");
+
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnMoveProfile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(moveProfile_.c_str());
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(moveProfile_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnLongHaulFeed(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(longHaulFeed_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(longHaulFeed_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnShortStepFeed(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(shortStepFeed_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(shortStepFeed_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnShortStepThreshold(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(shortStepThreshold_um_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(shortStepThreshold_um_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnAsyncMoves(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(asyncMoves_ ? "Yes" : "No");
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    asyncMoves_ = (value == "Yes");
+  }
+  return DEVICE_OK;
+}
+int CShapeokoTinyGXYStage::OnSequenceDwell(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sequenceDwellMs_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(sequenceDwellMs_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnScanRegion(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(scanRegion_[index]);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(scanRegion_[index]);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnScanDwell(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(scanDwellMs_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(scanDwellMs_);
+  }
+  return DEVICE_OK;
+}
+
+// "Running" while tiles remain to be reached; setting it starts a scan and
+// setting "Idle" stops one
+int CShapeokoTinyGXYStage::OnScan(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(scanActive_ ? "Running" : "Idle");
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    if (value == "Running" && !scanActive_)
+      return StartScan();
+    if (value == "Idle" && scanActive_)
+      return StopScan();
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnScanTiles(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set((long) scanTiles_.size());
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnScanTile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(scanTilesReached_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnSweepLine(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sweep_[index]);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(sweep_[index]);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnSweepOutput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sweepOutput_.c_str());
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(sweepOutput_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnSweepFile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sweepFile_.c_str());
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(sweepFile_);
+  }
+  return DEVICE_OK;
+}
+
+// "Running" while pulses remain to be reached; setting it starts a sweep
+// and setting "Idle" stops one
+int CShapeokoTinyGXYStage::OnSweep(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sweepActive_ ? "Running" : "Idle");
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    if (value == "Running" && !sweepActive_)
+      return StartSweep();
+    if (value == "Idle" && sweepActive_)
+      return StopSweep();
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnSweepTriggers(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set((long) sweepTriggers_.size());
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnSweepTrigger(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sweepTriggersReached_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnPositionOrderFile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(orderFile_.c_str());
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(orderFile_);
+    if (orderFile_.empty())
+      return DEVICE_OK;
+    int ret = OrderPositionFile(orderFile_);
+    OnPropertyChanged(g_PositionOrderResultProp, orderResult_.c_str());
+    return ret;
+  }
+  return DEVICE_OK;
+}
 
+int CShapeokoTinyGXYStage::OnPositionOrderUsesZ(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(orderUsesZ_ ? "Yes" : "No");
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    orderUsesZ_ = value == "Yes";
+  }
   return DEVICE_OK;
 }
 
+int CShapeokoTinyGXYStage::OnPositionOrderTimeLimit(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(orderTimeLimitMs_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(orderTimeLimitMs_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGXYStage::OnPositionOrderResult(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(orderResult_.c_str());
+  }
+  return DEVICE_OK;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 // Action handlers
@@ -3,8 +3,14 @@
 
 #include "DeviceBase.h"
 #include "DeviceThreads.h"
-
-class CShapeokoTinyGXYStage : public CXYStageBase<CShapeokoTinyGXYStage>
+#include "ShapeokoTinyG.h"
+#include "ScanPath.h"
+#include "PathOrder.h"
+#include <string>
+#include <vector>
+
+class CShapeokoTinyGXYStage : public CXYStageBase<CShapeokoTinyGXYStage>, public TinyGLineListener,
+    public TinyGPositionListener
 {
  public:
   CShapeokoTinyGXYStage();
@@ -47,8 +53,41 @@ class CShapeokoTinyGXYStage : public CXYStageBase<CShapeokoTinyGXYStage>
   double GetStepSizeYUm();
   int Move(double /*vx*/, double /*vy*/);
 
+  // Sequences are streamed into the controller's planner by the hub, so
+  // consecutive positions blend without a host round-trip in between
   int IsXYStageSequenceable(bool& isSequenceable) const;
-
+  int GetXYStageSequenceMaxLength(long& nrEvents) const;
+  int StartXYStageSequence();
+  int StopXYStageSequence();
+  int ClearXYStageSequence();
+  int AddToXYStageSequence(double positionX, double positionY);
+  int SendXYStageSequence();
+
+  // Tiled scan engine: covers the "Scan" region with overlapping tiles in
+  // serpentine order and streams the whole path to the controller at once.
+  // "Scan Tile" counts the tiles reached and announces each arrival.
+  int StartScan();
+  int StopScan();
+  void OnLineReached(long line);
+  // TinyGPositionListener; reports the measured position to the core
+  void OnPositionChanged(unsigned axes, const double* pos_mm);
+
+  // On-the-fly imaging: one constant-velocity G1 line from "Sweep Start"
+  // to "Sweep End", with the trigger output pulsed every interval by
+  // M-codes queued between the segments, so the pulses keep pace with the
+  // motion without the host.  "Sweep Trigger" counts the pulses reached.
+  int StartSweep();
+  int StopSweep();
+  // expected stage position of each pulse of the last sweep
+  const std::vector<TinyGScanTile>& GetSweepTriggers() const { return sweepTriggers_; }
+
+  // Visiting order for scattered positions in controller coordinates (um),
+  // starting with the one nearest the stage and costed with the stage's
+  // velocity and acceleration; z counts only with useZ.  See PathOrder.h.
+  int OrderPositions(const std::vector<TinyGPathPoint>& points, bool useZ, std::vector<long>& order);
+  // Orders the "x,y[,z]" lines (um) of a file and writes them, each
+  // prefixed with its index among the input positions, to path + ".ordered"
+  int OrderPositionFile(const std::string& path);
 
   // action interface
   // ----------------
@@ -57,18 +96,77 @@ class CShapeokoTinyGXYStage : public CXYStageBase<CShapeokoTinyGXYStage>
   int OnStepSize(MM::PropertyBase* pProp, MM::ActionType eAct);
   int OnMaxVelocity(MM::PropertyBase* pProp, MM::ActionType eAct);
   int OnAcceleration(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnAsyncMoves(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnMoveProfile(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnLongHaulFeed(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnShortStepFeed(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnShortStepThreshold(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSequenceDwell(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnScanRegion(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+  int OnScanDwell(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnScan(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnScanTiles(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnScanTile(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSweepLine(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+  int OnSweepOutput(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSweepFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSweep(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSweepTriggers(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSweepTrigger(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnPositionOrderFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnPositionOrderUsesZ(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnPositionOrderTimeLimit(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnPositionOrderResult(MM::PropertyBase* pProp, MM::ActionType eAct);
 
  private:
+  void ReadMotionSettings(ShapeokoTinyGHub* pHub);
+  int WriteVelocity();
+  int WriteJerk();
+  double MoveFeed(double distance_um) const;
+  TinyGPathOptions PathOptions() const;
+
   double stepSize_um_;
-  double max_velocity_;
-  double acceleration_;
+  double max_velocity_;     // mm/min
+  double acceleration_;     // mm/s^2
   double posX_um_;
   double posY_um_;
   bool busy_;
-  MM::TimeoutMs* timeOutTimer_;
+  bool asyncMoves_;
   bool initialized_;
   double lowerLimit_;
   double upperLimit_;
+  std::vector<double> sequenceX_um_;
+  std::vector<double> sequenceY_um_;
+  std::vector<std::string> sequenceCommands_;
+  long sequenceDwellMs_;
+  std::string moveProfile_;
+  double longHaulFeed_;     // mm/min
+  double shortStepFeed_;    // mm/min
+  double shortStepThreshold_um_;
+  // scan region values, in the order of g_ScanRegionProps
+  double scanRegion_[7];
+  long scanDwellMs_;
+  std::vector<TinyGScanTile> scanTiles_;
+  volatile bool scanActive_;
+  volatile long scanTilesReached_;
+  // line number of the first tile's move in the running scan
+  long scanFirstLine_;
+  // sweep values, in the order of g_SweepProps
+  double sweep_[7];
+  std::string sweepOutput_;
+  std::string sweepFile_;
+  std::vector<TinyGScanTile> sweepTriggers_;
+  volatile bool sweepActive_;
+  volatile long sweepTriggersReached_;
+  // line number of the first pulse of the running sweep
+  long sweepFirstLine_;
+  // set when a sweep starts and cleared once an M9 has been sent after it;
+  // the output may be on until then, even after the last pulse counted
+  bool sweepOutputArmed_;
+  std::string orderFile_;
+  bool orderUsesZ_;
+  long orderTimeLimitMs_;
+  std::string orderResult_;
 };
 
 #endif // _SHAPEOKO_TINYG_XYSTAGE_H_
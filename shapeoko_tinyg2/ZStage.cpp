@@ -15,6 +15,7 @@
 #include "ShapeokoTinyG.h"
 
 #include "ZStage.h"
+#include "LineNumbers.h"
 using namespace std;
 
 #include "MMDevice.h"
@@ -22,12 +23,21 @@ using namespace std;
 
 extern const char* g_ZStageDeviceName;
 extern const char* g_Keyword_LoadSample;
+const char* g_ZSequenceDwellProp = "Sequence Dwell (ms)";
+const char* g_ZSequenceSliceProp = "Sequence Slice";
+const char* g_ZFastFocusProp = "Fast Focus";
+
+const long g_MaxZSequenceLength = 10000;
 
 CShapeokoTinyGZStage::CShapeokoTinyGZStage() :
     // http://www.shapeoko.com/wiki/index.php/Zaxis_ACME
     stepSize_um_ (5.),
     posZ_um_(0.0),
-    initialized_ (false)
+    initialized_ (false),
+    sequenceDwellMs_(0),
+    sequenceFirstLine_(1),
+    sequenceSlice_(0),
+    fastFocus_(false)
 {
   InitializeDefaultErrorMessages();
 
@@ -71,11 +81,35 @@ int CShapeokoTinyGZStage::Initialize()
   if (ret != DEVICE_OK)
     return ret;
 
+  // Dwell at each slice of a sequence
+  pAct = new CPropertyAction(this, &CShapeokoTinyGZStage::OnSequenceDwell);
+  ret = CreateProperty(g_ZSequenceDwellProp, "0", MM::Integer, false, pAct);
+  if (ret != DEVICE_OK)
+    return ret;
+  SetPropertyLimits(g_ZSequenceDwellProp, 0, 60000);
+
+  // Slices of the running sequence the controller has reached
+  pAct = new CPropertyAction(this, &CShapeokoTinyGZStage::OnSequenceSlice);
+  ret = CreateProperty(g_ZSequenceSliceProp, "0", MM::Integer, true, pAct);
+  if (ret != DEVICE_OK)
+    return ret;
+
+  // Relative moves for autofocus
+  pAct = new CPropertyAction(this, &CShapeokoTinyGZStage::OnFastFocus);
+  ret = CreateProperty(g_ZFastFocusProp, "Off", MM::String, false, pAct);
+  if (ret != DEVICE_OK)
+    return ret;
+  AddAllowedValue(g_ZFastFocusProp, "Off");
+  AddAllowedValue(g_ZFastFocusProp, "On");
+
   // Update lower and upper limits.  These values are cached, so if they change during a session, the adapter will need to be re-initialized
   ret = UpdateStatus();
   if (ret != DEVICE_OK)
     return ret;
 
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  if (pHub != 0)
+    pHub->AddPositionListener(this);
   initialized_ = true;
 
   return DEVICE_OK;
@@ -83,6 +117,12 @@ int CShapeokoTinyGZStage::Initialize()
 
 int CShapeokoTinyGZStage::Shutdown()
 {
+  if (initialized_)
+  {
+    ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+    if (pHub != 0)
+      pHub->RemovePositionListener(this);
+  }
   initialized_ = false;
 
   return DEVICE_OK;
@@ -90,7 +130,10 @@ int CShapeokoTinyGZStage::Shutdown()
 
 bool CShapeokoTinyGZStage::Busy()
 {
-  return false;
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  if (pHub == 0)
+    return false;
+  return pHub->IsStreaming() || pHub->IsMoving();
 }
 
 int CShapeokoTinyGZStage::SetPositionUm(double pos)
@@ -103,8 +146,39 @@ int CShapeokoTinyGZStage::SetPositionUm(double pos)
   return DEVICE_OK;
 }
 
+/*
+ * Autofocus steps the stage many times per field.  Without fast focus each
+ * step reads the position back and sends an absolute move that waits for
+ * the stage; with it the step goes out as an incremental move and the
+ * caller waits on Busy() instead, which avoids both the rounding to whole
+ * steps and a second status round trip.
+ */
+int CShapeokoTinyGZStage::SetRelativePositionUm(double d)
+{
+  if (!fastFocus_)
+    return CStageBase<CShapeokoTinyGZStage>::SetRelativePositionUm(d);
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "ZStage: SetRelativePositionUm");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  double delta[3] = {0.0, 0.0, d/1000.};
+  int ret = pHub->MoveRelative(TINYG_AXIS_Z, delta, false);
+  if (ret != DEVICE_OK)
+    return ret;
+  posZ_um_ += d;
+  return DEVICE_OK;
+}
+
 int CShapeokoTinyGZStage::GetPositionUm(double& pos)
 {
+  // fast focus steps are finer than a step, so report the measured
+  // position as is
+  if (fastFocus_)
+  {
+    ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+    TinyGMachineStatus status;
+    pHub->GetMachineStatus(status);
+    pos = status.valid ? status.pos[2] * 1000. : posZ_um_;
+    return DEVICE_OK;
+  }
   long steps;
   int ret = GetPositionSteps(steps);
   if (ret != DEVICE_OK)
@@ -121,7 +195,7 @@ double CShapeokoTinyGZStage::GetStepSize() const {return stepSize_um_;}
  */
 int CShapeokoTinyGZStage::SetPositionSteps(long steps)
 {
-  LogMessage("ZStage: SetPositionSteps");
+  TINYG_TRACE(TINYG_TRACE_DEBUG, "ZStage: SetPositionSteps");
   /* if (timeOutTimer_ != 0)
      {
      if (!timeOutTimer_->expired(GetCurrentMMTime()))
@@ -132,15 +206,17 @@ int CShapeokoTinyGZStage::SetPositionSteps(long steps)
   posZ_um_ = steps * stepSize_um_;
    
 
-  char buff[100];
-  sprintf(buff, "G0 Z%f", posZ_um_/1000.);
-  std::string buffAsStdStr = buff;
+  double target[3] = {0.0, 0.0, posZ_um_/1000.};
   ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
-  int ret = pHub->SendCommand(buffAsStdStr,buffAsStdStr);
+  // status reports are consumed by the hub's reader thread, so wait for the
+  // move to finish rather than treating the first report as the answer;
+  // with the hub's coalescing window on, the move joins a pending XY move
+  // and a move arriving while Z still travels retargets the running one
+  int ret = pHub->MoveAxes(TINYG_AXIS_Z, target, true);
   if (ret != DEVICE_OK)
     return ret;
 
-  //ret = OnZStagePositionChanged(posZ_um_);
+  // the core hears about the move from the hub's status poller
    
 
   // CDeviceUtils::SleepMs(100);
@@ -148,26 +224,38 @@ int CShapeokoTinyGZStage::SetPositionSteps(long steps)
 }
 
 /*
- * Requests current z postion from the controller.  This function does the actual communication
+ * Reports the z position measured by the controller, as cached by the hub from
+ * its status reports.  Until the first report arrives the last commanded
+ * position is used.
  */
 int CShapeokoTinyGZStage::GetPositionSteps(long& steps)
 {
-  steps = (long)(posZ_um_ / stepSize_um_);
-
-  // TODO(dek): implement status to get Z position
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  TinyGMachineStatus status;
+  pHub->GetMachineStatus(status);
+  if (!status.valid)
+  {
+    steps = (long)(posZ_um_ / stepSize_um_);
+    return DEVICE_OK;
+  }
+  steps = (long) floor(status.pos[2] * 1000. / stepSize_um_ + 0.5);
   return DEVICE_OK;
 }
 
-int CShapeokoTinyGZStage::SetOrigin()
+void CShapeokoTinyGZStage::OnPositionChanged(unsigned axes, const double* pos_mm)
 {
-  // const char* cmd ="HPZP0" ;
-  // int ret = g_hub.ExecuteCommand(*this, *GetCoreCallback(),  cmd);
-  // if (ret != DEVICE_OK)
-  //    return ret;
-
-  // TODO(dek): run gcode to set origin to current location (G28.3 ?)
+  if (axes & TINYG_AXIS_Z)
+    OnStagePositionChanged(pos_mm[2] * 1000.);
+}
 
-  return DEVICE_OK;
+int CShapeokoTinyGZStage::SetOrigin()
+{
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  int ret = pHub->SetOrigin(TINYG_AXIS_Z);
+  if (ret != DEVICE_OK)
+    return ret;
+  posZ_um_ = 0.0;
+  return OnStagePositionChanged(0.0);
 }
 
 int CShapeokoTinyGZStage::GetLimits(double& lower, double& upper)
@@ -212,11 +300,121 @@ int CShapeokoTinyGZStage::OnPosition(MM::PropertyBase* pProp, MM::ActionType eAc
 
 // TODO(dek): implement OnStageLoad
 
-// Sequence functions (unimplemented)
-int CShapeokoTinyGZStage::IsStageSequenceable(bool& isSequenceable) const {isSequenceable = false; return DEVICE_OK;}
-int CShapeokoTinyGZStage::GetStageSequenceMaxLength(long& nrEvents) const  {nrEvents = 0; return DEVICE_OK;}
-int CShapeokoTinyGZStage::StartStageSequence() {return DEVICE_OK;}
-int CShapeokoTinyGZStage::StopStageSequence() {return DEVICE_OK;}
-int CShapeokoTinyGZStage::ClearStageSequence() {return DEVICE_OK;}
-int CShapeokoTinyGZStage::AddToStageSequence(double /*position*/) {return DEVICE_OK;}
-int CShapeokoTinyGZStage::SendStageSequence() {return DEVICE_OK;}
+int CShapeokoTinyGZStage::OnSequenceDwell(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sequenceDwellMs_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(sequenceDwellMs_);
+  }
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGZStage::OnFastFocus(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(fastFocus_ ? "On" : "Off");
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    std::string value;
+    pProp->Get(value);
+    fastFocus_ = (value == "On");
+  }
+  return DEVICE_OK;
+}
+
+/*
+ * Slice k is sent as line sequenceFirstLine_ + 2k and its dwell as the line
+ * after, so once the reported line number is past a slice's move the slice
+ * has been reached.  Line numbers from outside the sequence, such as a
+ * report still in flight from whatever ran before it, are ignored.
+ */
+int CShapeokoTinyGZStage::OnSequenceSlice(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+    long reached = TinyGItemsReached(pHub->GetLineNumber(), sequenceFirstLine_,
+        (long) sequenceCommands_.size() / 2, 2);
+    if (reached >= 0)
+      sequenceSlice_ = reached;
+    pProp->Set(sequenceSlice_);
+  }
+  return DEVICE_OK;
+}
+
+// Sequence functions
+int CShapeokoTinyGZStage::IsStageSequenceable(bool& isSequenceable) const {isSequenceable = true; return DEVICE_OK;}
+int CShapeokoTinyGZStage::GetStageSequenceMaxLength(long& nrEvents) const  {nrEvents = g_MaxZSequenceLength; return DEVICE_OK;}
+
+int CShapeokoTinyGZStage::StartStageSequence()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "ZStage: StartStageSequence");
+  if (sequenceCommands_.empty())
+    return DEVICE_OK;
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  long first = pHub->ReserveStreamLines((long) sequenceCommands_.size());
+  std::vector<std::string> lines;
+  lines.reserve(sequenceCommands_.size());
+  char buff[32];
+  for (size_t i = 0; i < sequenceCommands_.size(); ++i)
+  {
+    sprintf(buff, "N%ld ", first + (long) i);
+    lines.push_back(buff + sequenceCommands_[i]);
+  }
+  sequenceFirstLine_ = first;
+  sequenceSlice_ = 0;
+  int ret = pHub->StreamCommands(lines);
+  if (ret != DEVICE_OK)
+    return ret;
+  posZ_um_ = sequence_um_.back();
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGZStage::StopStageSequence()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "ZStage: StopStageSequence");
+  ShapeokoTinyGHub* pHub = static_cast<ShapeokoTinyGHub*>(GetParentHub());
+  pHub->StopStreaming();
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGZStage::ClearStageSequence()
+{
+  sequence_um_.clear();
+  sequenceCommands_.clear();
+  return DEVICE_OK;
+}
+
+int CShapeokoTinyGZStage::AddToStageSequence(double position)
+{
+  if ((long) sequence_um_.size() >= g_MaxZSequenceLength)
+    return DEVICE_SEQUENCE_TOO_LARGE;
+  sequence_um_.push_back(position);
+  return DEVICE_OK;
+}
+
+/*
+ * Builds the G-code for the Z-stack, numbered when the sequence starts.
+ * The dwell is always sent, even when zero, so that every slice has a line
+ * the controller reports once the slice has been reached.
+ */
+int CShapeokoTinyGZStage::SendStageSequence()
+{
+  TINYG_TRACE(TINYG_TRACE_INFO, "ZStage: SendStageSequence");
+  sequenceCommands_.clear();
+  char buff[100];
+  for (size_t i = 0; i < sequence_um_.size(); ++i)
+  {
+    sprintf(buff, "G0 Z%f", sequence_um_[i]/1000.);
+    sequenceCommands_.push_back(buff);
+    sprintf(buff, "G4 P%.3f", sequenceDwellMs_/1000.);
+    sequenceCommands_.push_back(buff);
+  }
+  return DEVICE_OK;
+}
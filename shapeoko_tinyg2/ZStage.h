@@ -27,7 +27,7 @@
 
 // Axioskope 2 Z stage
 //
-class CShapeokoTinyGZStage : public CStageBase<CShapeokoTinyGZStage>
+class CShapeokoTinyGZStage : public CStageBase<CShapeokoTinyGZStage>, public TinyGPositionListener
 {
  public:
   CShapeokoTinyGZStage();
@@ -41,6 +41,9 @@ class CShapeokoTinyGZStage : public CStageBase<CShapeokoTinyGZStage>
 
   // Stage API
   virtual int SetPositionUm(double pos);
+  // With "Fast Focus" on, an incremental move that returns at once; Busy()
+  // stays true until the controller reports the stage at its end position
+  virtual int SetRelativePositionUm(double d);
   virtual int GetPositionUm(double& pos);
   virtual double GetStepSize() const;
   virtual int SetPositionSteps(long steps) ;
@@ -50,18 +53,26 @@ class CShapeokoTinyGZStage : public CStageBase<CShapeokoTinyGZStage>
 
   bool IsContinuousFocusDrive() const;
 
+  // TinyGPositionListener; reports the measured position to the core
+  void OnPositionChanged(unsigned axes, const double* pos_mm);
+
   // action interface
   // ----------------
   int OnPosition(MM::PropertyBase* pProp, MM::ActionType eAct);
   int OnLoadSample(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSequenceDwell(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSequenceSlice(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnFastFocus(MM::PropertyBase* pProp, MM::ActionType eAct);
 
-  // Sequence functions (unimplemented)
+  // Sequence functions.  The Z-stack is uploaded as numbered G-code lines
+  // that the controller runs on its own; the line numbers in its status
+  // reports tell which slice has been reached.
   int IsStageSequenceable(bool& isSequenceable) const;
   int GetStageSequenceMaxLength(long& nrEvents) const;
   int StartStageSequence();
   int StopStageSequence();
   int ClearStageSequence();
-  int AddToStageSequence(double /*position*/);
+  int AddToStageSequence(double position);
   int SendStageSequence();
 
  private:
@@ -77,6 +88,14 @@ class CShapeokoTinyGZStage : public CStageBase<CShapeokoTinyGZStage>
   MM::TimeoutMs* timeOutTimer_;
 
   double upperLimit_;
+  std::vector<double> sequence_um_;
+  std::vector<std::string> sequenceCommands_;
+  long sequenceDwellMs_;
+  // line number of the running sequence's first move, and the slices it
+  // had reached by the last report within the sequence
+  long sequenceFirstLine_;
+  long sequenceSlice_;
+  bool fastFocus_;
   typedef enum {
     ZMSF_MOVING = 0x0002, // trajectory is in progress
     ZMSF_SETTLE = 0x0004  // settling after movement